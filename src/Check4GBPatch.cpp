@@ -79,6 +79,18 @@ namespace
 	}
 }
 
+bool Check4GBPatch::IsPatchInstalled()
+{
+	try
+	{
+		return Is4GBPatchInstalled();
+	}
+	catch (const std::exception&)
+	{
+		return true;  // the error has already been logged by WritePatchStatusToLogFile
+	}
+}
+
 void Check4GBPatch::WritePatchStatusToLogFile()
 {
 	Logger& logger = Logger::GetInstance();
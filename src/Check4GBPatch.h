@@ -23,4 +23,7 @@
 namespace Check4GBPatch
 {
 	void WritePatchStatusToLogFile();
+
+	// Returns true if the 4GB patch is installed or if its status cannot be determined.
+	bool IsPatchInstalled();
 }
@@ -0,0 +1,245 @@
+#include "CompactRuleIndex.h"
+#include "RuleSymmetry.h"
+#include <algorithm>
+#include <bit>
+#include <unordered_set>
+
+namespace
+{
+	constexpr uint32_t emptySlot = 0xffffffff;
+
+	// A packed tile consists of a dense piece index and a 3-bit RotFlip (19 bits in total).
+	constexpr uint32_t tileBits = 19;
+	constexpr uint32_t tileMask = (1 << tileBits) - 1;
+
+	// entry layout: second tile (bits 45-63), symmetry (bits 43-44), third tile (bits 24-42), fourth tile (bits 5-23)
+	constexpr uint32_t entryKeyShift = 45;
+	constexpr uint32_t entrySymmetryShift = 43;
+	constexpr uint32_t entryTile3Shift = 24;
+	constexpr uint32_t entryTile4Shift = 5;
+
+	// index of a rule in the build input, packed into the low bits of the sort key
+	constexpr uint32_t ordinalBits = 64 - 2 * tileBits;
+	constexpr uint64_t maxRules = uint64_t(1) << ordinalBits;
+
+	constexpr uint32_t packTile(uint32_t idx, uint32_t packedRotFlip)
+	{
+		return (idx << 3) | packedRotFlip;
+	}
+
+	constexpr uint32_t lookupHash(uint32_t id, uint32_t shift)
+	{
+		return (id * 0x9e3779b1) >> shift;
+	}
+}
+
+// The build is meant for the 2 GB address space of the game without the 4GB patch, so its transient memory stays small:
+// the piece IDs are deduplicated as they come, the rules of the current index are decoded from it rather than copied,
+// and the sort keys of the rules are turned into the entries in place, so that apart from the pending rules
+// and the finished index, the build needs 8 bytes per rule.
+bool CompactRuleIndex::Build(RuleStagingBuffer& pendingRules)
+{
+	const size_t storedCount = size;  // the rules of the current index take precedence over the pending rules
+	const size_t ruleCount = storedCount + pendingRules.Size();
+	auto ruleAt = [this, storedCount, &pendingRules](size_t i) -> cSC4NetworkTileConflictRule {
+		return i < storedCount ? RuleAt(i) : pendingRules[i - storedCount];
+	};
+	if (ruleCount >= maxRules) {
+		return false;
+	}
+
+	std::unordered_set<uint32_t> distinctPieceIds;
+	for (size_t i = 0; i < ruleCount; i++) {
+		const cSC4NetworkTileConflictRule rule = ruleAt(i);
+		distinctPieceIds.insert({rule._1.id, rule._2.id, rule._3.id, rule._4.id});
+		if (distinctPieceIds.size() > maxPieceIds) {
+			return false;
+		}
+	}
+
+	// built next to the current index, which still decodes the stored rules
+	CompactRuleIndex built;
+	built.ownedPieceIds.assign(distinctPieceIds.begin(), distinctPieceIds.end());
+	distinctPieceIds = {};  // release the memory
+	std::sort(built.ownedPieceIds.begin(), built.ownedPieceIds.end());
+	built.pieceIds = built.ownedPieceIds.data();
+	built.pieceIdCount = built.ownedPieceIds.size();
+	built.BuildLookup();
+
+	// sort by canonical key, and by order of insertion among equivalent rules
+	std::vector<uint64_t> sortKeys(ruleCount);
+	for (size_t i = 0; i < ruleCount; i++) {
+		sortKeys[i] = (built.PackKey(RuleSymmetry::Canonicalize(ruleAt(i)).key) << ordinalBits) | i;
+	}
+	std::sort(sortKeys.begin(), sortKeys.end());
+
+	// The entries replace the sort keys in place, as there are at most as many entries as sort keys read so far.
+	built.ownedGroupOffsets.assign(built.GroupCount() + 1, 0);
+	size_t entryCount = 0;
+	uint64_t previousKey = ~uint64_t(0);
+	for (size_t i = 0; i < ruleCount; i++) {
+		const uint64_t sortKey = sortKeys[i];
+		const uint64_t key = sortKey >> ordinalBits;
+		if (key == previousKey) {
+			continue;  // keep only the first of several equivalent rules
+		}
+		previousKey = key;
+
+		const cSC4NetworkTileConflictRule rule = ruleAt(static_cast<size_t>(sortKey & (maxRules - 1)));
+		uint32_t idx3 = 0, idx4 = 0;
+		built.LookupPieceId(rule._3.id, idx3);
+		built.LookupPieceId(rule._4.id, idx4);
+		const RuleSymmetry::Symmetry symmetry = RuleSymmetry::Canonicalize(rule).symmetry;
+
+		built.ownedGroupOffsets[static_cast<size_t>(key >> tileBits) + 1]++;
+		sortKeys[entryCount++] =
+			((key & tileMask) << entryKeyShift) |
+			(uint64_t(symmetry) << entrySymmetryShift) |
+			(uint64_t(packTile(idx3, RuleSymmetry::PackRotFlip(rule._3.rf))) << entryTile3Shift) |
+			(uint64_t(packTile(idx4, RuleSymmetry::PackRotFlip(rule._4.rf))) << entryTile4Shift);
+	}
+	for (size_t group = 0; group < built.GroupCount(); group++) {
+		built.ownedGroupOffsets[group + 1] += built.ownedGroupOffsets[group];
+	}
+	sortKeys.resize(entryCount);
+	if (entryCount < ruleCount - ruleCount / 8) {
+		sortKeys.shrink_to_fit();  // which needs both buffers at once, so a little slack is not worth it
+	}
+	built.ownedEntries = std::move(sortKeys);
+
+	built.groupOffsets = built.ownedGroupOffsets.data();
+	built.entries = built.ownedEntries.data();
+	built.size = entryCount;
+	*this = std::move(built);
+	pendingRules = {};  // release the memory
+	return true;
+}
+
+void CompactRuleIndex::Attach(const uint32_t* pieceIds, size_t pieceIdCount, const uint32_t* groupOffsets, const uint64_t* entries, size_t size, std::shared_ptr<const void> backing)
+{
+	this->ownedPieceIds = {};
+	this->ownedGroupOffsets = {};
+	this->ownedEntries = {};
+	this->backing = std::move(backing);
+	this->pieceIds = pieceIds;
+	this->pieceIdCount = pieceIdCount;
+	this->groupOffsets = groupOffsets;
+	this->entries = entries;
+	this->size = size;
+	BuildLookup();
+}
+
+bool CompactRuleIndex::HasValidTiles(const uint64_t* entries, size_t size, size_t pieceIdCount)
+{
+	for (size_t i = 0; i < size; i++) {
+		const uint64_t entry = entries[i];
+		for (const uint32_t shift : {entryKeyShift, entryTile3Shift, entryTile4Shift}) {
+			if (((entry >> shift) & tileMask) >> 3 >= pieceIdCount) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void CompactRuleIndex::BuildLookup()
+{
+	const uint32_t capacity = std::bit_ceil(static_cast<uint32_t>(std::max<size_t>(pieceIdCount * 2, 16)));
+	lookupShift = 32 - std::countr_zero(capacity);
+	lookupKeys.assign(capacity, 0);
+	lookupValues.assign(capacity, emptySlot);
+	for (uint32_t idx = 0; idx < pieceIdCount; idx++) {
+		uint32_t i = lookupHash(pieceIds[idx], lookupShift);
+		while (lookupValues[i] != emptySlot) {
+			i = (i + 1) & (capacity - 1);
+		}
+		lookupKeys[i] = pieceIds[idx];
+		lookupValues[i] = idx;
+	}
+}
+
+bool CompactRuleIndex::LookupPieceId(uint32_t id, uint32_t& idx) const
+{
+	const uint32_t mask = static_cast<uint32_t>(lookupKeys.size()) - 1;
+	for (uint32_t i = lookupHash(id, lookupShift); lookupValues[i] != emptySlot; i = (i + 1) & mask) {
+		if (lookupKeys[i] == id) {
+			idx = lookupValues[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+uint64_t CompactRuleIndex::PackKey(const RuleSymmetry::Key& key) const
+{
+	uint32_t idx1 = 0, idx2 = 0;
+	LookupPieceId(key.Id1(), idx1);
+	LookupPieceId(key.Id2(), idx2);
+	return (uint64_t(packTile(idx1, key.rotFlips >> 3)) << tileBits) | packTile(idx2, key.rotFlips & 0x7);
+}
+
+Tile CompactRuleIndex::UnpackTile(uint32_t tile) const
+{
+	return {pieceIds[tile >> 3], RuleSymmetry::UnpackRotFlip(tile & 0x7)};
+}
+
+RuleSymmetry::RuleOutput CompactRuleIndex::DecodeOutput(uint64_t entry) const
+{
+	return {
+		UnpackTile(static_cast<uint32_t>(entry >> entryTile3Shift) & tileMask),
+		UnpackTile(static_cast<uint32_t>(entry >> entryTile4Shift) & tileMask),
+		static_cast<RuleSymmetry::Symmetry>((entry >> entrySymmetryShift) & 0x3),
+	};
+}
+
+cSC4NetworkTileConflictRule CompactRuleIndex::RuleAt(size_t position) const
+{
+	// the group of an entry is the last one starting at or before it
+	const uint32_t* const groupEnd = std::upper_bound(groupOffsets, groupOffsets + GroupCount() + 1, static_cast<uint32_t>(position));
+	return Decode(static_cast<uint32_t>(groupEnd - groupOffsets - 1), entries[position]);
+}
+
+cSC4NetworkTileConflictRule CompactRuleIndex::Decode(uint32_t group, uint64_t entry) const
+{
+	const RuleSymmetry::RuleOutput output = DecodeOutput(entry);
+	const Tile c1 = UnpackTile(group);
+	const Tile c2 = UnpackTile(static_cast<uint32_t>(entry >> entryKeyShift) & tileMask);
+	const auto [t1, t2] = RuleSymmetry::Transform(output.symmetry, c1, c2);  // the inverse of each symmetry is the symmetry itself
+	return {t1, t2, output._3, output._4};
+}
+
+bool CompactRuleIndex::Find(const RuleSymmetry::Key& key, RuleSymmetry::RuleOutput& output, uint32_t& position) const
+{
+	uint32_t idx1, idx2;
+	if (size == 0 || !LookupPieceId(key.Id1(), idx1) || !LookupPieceId(key.Id2(), idx2)) {
+		return false;
+	}
+	const uint32_t group = packTile(idx1, key.rotFlips >> 3);
+	const uint64_t tile2 = packTile(idx2, key.rotFlips & 0x7);
+
+	const uint64_t* const first = entries + groupOffsets[group];
+	const uint64_t* const last = entries + groupOffsets[group + 1];
+	const uint64_t* const it = std::lower_bound(first, last, tile2 << entryKeyShift);
+	if (it == last || (*it >> entryKeyShift) != tile2) {
+		return false;
+	}
+	output = DecodeOutput(*it);
+	position = static_cast<uint32_t>(it - entries);
+	return true;
+}
+
+std::vector<cSC4NetworkTileConflictRule> CompactRuleIndex::Rules() const
+{
+	std::vector<cSC4NetworkTileConflictRule> rules;
+	rules.reserve(size);
+	ForEachRule([&rules](const cSC4NetworkTileConflictRule& rule) { rules.push_back(rule); });
+	return rules;
+}
+
+size_t CompactRuleIndex::MemoryUsage() const
+{
+	return pieceIdCount * sizeof(uint32_t) +
+		(GroupCount() + 1) * sizeof(uint32_t) +
+		size * sizeof(uint64_t) +
+		lookupKeys.size() * (sizeof(uint32_t) + sizeof(uint32_t));
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include "RuleStagingBuffer.h"
+#include "RuleSymmetry.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A compact, read-only alternative to RuleIndex for RUL2 override rules, trading some lookup speed for memory.
+//
+// Only a few thousand distinct piece IDs appear in the RUL2 files, so the IDs are dictionary-encoded as dense 16-bit indices.
+// Each rule is stored once in its canonical orientation (see RuleSymmetry),
+// grouped by its first tile in a CSR layout: `groupOffsets` maps the first tile to a range of `entries`,
+// sorted by the second tile. An entry packs the second tile, the symmetry that recovers the original orientation,
+// and the two result tiles into 8 bytes (compared to 32 bytes for cSC4NetworkTileConflictRule).
+class CompactRuleIndex
+{
+public:
+	static constexpr size_t maxPieceIds = 0x10000;
+
+	// Inserts the pending rules into the index, keeping the first of several equivalent rules, and clears the pending rules.
+	// Returns false (leaving everything untouched) if the rules contain too many distinct piece IDs to be encoded.
+	bool Build(RuleStagingBuffer& pendingRules);
+
+	// Replaces the index by one that was built previously, e.g. from a memory-mapped cache file.
+	// The `backing` keeps the memory of the arrays alive for as long as it is in use.
+	void Attach(const uint32_t* pieceIds, size_t pieceIdCount, const uint32_t* groupOffsets, const uint64_t* entries, size_t size, std::shared_ptr<const void> backing);
+
+	// Checks that the tiles of the entries refer to one of the `pieceIdCount` piece IDs, e.g. before attaching entries read from a file.
+	static bool HasValidTiles(const uint64_t* entries, size_t size, size_t pieceIdCount);
+
+	// Looks up the rule with the given canonical key and stores its output in `output` and its position in `position`.
+	bool Find(const RuleSymmetry::Key& key, RuleSymmetry::RuleOutput& output, uint32_t& position) const;
+
+	// Decodes all the stored rules.
+	std::vector<cSC4NetworkTileConflictRule> Rules() const;
+
+	template <typename F>
+	void ForEachRule(F&& f) const
+	{
+		ForEachRuleWithPosition([&f](size_t, const cSC4NetworkTileConflictRule& rule) { f(rule); });
+	}
+
+	// Like ForEachRule, also passing the position of each rule, i.e. its entry.
+	template <typename F>
+	void ForEachRuleWithPosition(F&& f) const
+	{
+		for (uint32_t group = 0; group < GroupCount(); group++) {
+			for (uint32_t i = groupOffsets[group]; i < groupOffsets[group + 1]; i++) {
+				f(size_t(i), Decode(group, entries[i]));
+			}
+		}
+	}
+
+	size_t Size() const { return size; }
+	size_t PieceIdCount() const { return pieceIdCount; }
+	size_t GroupCount() const { return pieceIdCount * 8; }
+	size_t MemoryUsage() const;
+	bool IsAttached() const { return backing != nullptr; }
+
+	const uint32_t* PieceIdData() const { return pieceIds; }
+	const uint32_t* GroupOffsetData() const { return groupOffsets; }
+	const uint64_t* EntryData() const { return entries; }
+
+private:
+	void BuildLookup();
+	bool LookupPieceId(uint32_t id, uint32_t& idx) const;
+	uint64_t PackKey(const RuleSymmetry::Key& key) const;  // dictionary-encoded key, all IDs must be contained
+	Tile UnpackTile(uint32_t tile) const;
+	RuleSymmetry::RuleOutput DecodeOutput(uint64_t entry) const;
+	cSC4NetworkTileConflictRule Decode(uint32_t group, uint64_t entry) const;
+	cSC4NetworkTileConflictRule RuleAt(size_t position) const;  // decodes the rule of an entry
+
+	std::vector<uint32_t> ownedPieceIds;  // sorted
+	std::vector<uint32_t> ownedGroupOffsets;
+	std::vector<uint64_t> ownedEntries;
+	std::shared_ptr<const void> backing;
+
+	// either point to the owned vectors or to the attached memory
+	const uint32_t* pieceIds = nullptr;
+	const uint32_t* groupOffsets = nullptr;
+	const uint64_t* entries = nullptr;
+	size_t pieceIdCount = 0;
+	size_t size = 0;
+
+	// open-addressing hash table from piece ID to dense index
+	std::vector<uint32_t> lookupKeys;
+	std::vector<uint32_t> lookupValues;  // emptySlot or dense index
+	uint32_t lookupShift = 32;
+};
@@ -54,6 +54,8 @@
 static constexpr uint32_t kNAMDllDirectorID = 0x4AC2AEFF;
 
 static constexpr uint32_t kSC4MessagePostCityInit = 0x26D31EC1;
+static constexpr uint32_t kSC4MessagePreCityShutdown = 0x26D31EC2;
+static constexpr uint32_t kSC4MessagePostSave = 0x26C63345;
 
 static constexpr uint32_t kMonorailKeyboardShortcut = 0x8BE098F4;
 static constexpr uint32_t kOneWayRoadKeyboardShortcut = 0x4BE098F7;
@@ -186,7 +188,7 @@ noMatchingTunnelNetwork:
 		InstallWhen(settings.disableAutoconnect, "Disable auto-connect for RHW and Streets patch", InstallDisableAutoconnectForStreetsPatch);
 		InstallWhen(settings.enableTunnels, "Tunnels patch for RHW, Street and Lightrail", InstallTunnelsPatch);
 		InstallWhen(settings.reduceFerryBridgeHeightPatch, "Ferry Bridge Height patch", InstallFerryBridgeHeightPatch);
-		InstallWhen(settings.enableRUL2EnginePatch, "RUL2 Engine patch", Rul2Engine::Install);
+		InstallWhen(settings.enableRUL2EnginePatch, "RUL2 Engine patch", [&settings]() { Rul2Engine::Install(settings, GetDllFolderPath()); });
 		InstallWhen(settings.enableNetworkSlopePatch, "Network Slopes patch", NetworkSlopes::Install);
 		InstallWhen(settings.enableFlexPuzzlePiecePatch, "FLEX Puzzle Piece RUL0 patch", FlexPieces::Install);
 		InstallWhen(settings.enableCommuteLoopPatch, "Eternal Commute Loop patch", CommuteLoop::Install);
@@ -292,6 +294,9 @@ public:
 
 	void PostCityInit(cIGZMessage2Standard* pStandardMessage)
 	{
+		if (settings.enableRUL2EnginePatch) {
+			Rul2Engine::StartIndexBuild();  // in case RUL2 files have been loaded with the city
+		}
 		RegisterDllVersionInLua();
 		static bool logged = false;  // write log only once
 		if (!logged) {
@@ -302,6 +307,22 @@ public:
 		}
 	}
 
+	void PreCityShutdown()
+	{
+		if (settings.enableRUL2EnginePatch) {
+			Rul2Engine::LogStatistics();
+			Rul2Engine::WriteRuleProfile();
+		}
+	}
+
+	void PostSave()
+	{
+		if (settings.enableRUL2EnginePatch) {
+			Rul2Engine::LogStatistics();  // so that saving the city writes the statistics on demand, without exiting the city
+			Rul2Engine::WriteRuleProfile();
+		}
+	}
+
 	void ProcessKeyboardShortcut(uint32_t dwMessageID)
 	{
 		cISC4AppPtr pSC4App;
@@ -350,6 +371,12 @@ public:
 		case kSC4MessagePostCityInit:
 			PostCityInit(pStandardMessage);
 			break;
+		case kSC4MessagePreCityShutdown:
+			PreCityShutdown();
+			break;
+		case kSC4MessagePostSave:
+			PostSave();
+			break;
 		case kMonorailKeyboardShortcut:
 		case kOneWayRoadKeyboardShortcut:
 		case kDirtRoadKeyboardShortcut:
@@ -374,6 +401,8 @@ public:
 			requiredNotifications.push_back(kDirtRoadKeyboardShortcut);
 			requiredNotifications.push_back(kGroundHighwayKeyboardShortcut);
 			requiredNotifications.push_back(kSC4MessagePostCityInit);
+			requiredNotifications.push_back(kSC4MessagePreCityShutdown);
+			requiredNotifications.push_back(kSC4MessagePostSave);
 
 			for (uint32_t messageID : requiredNotifications)
 			{
@@ -390,7 +419,17 @@ public:
 			return false;
 		}
 
+		if (settings.enableRUL2EnginePatch) {
+			Rul2Engine::StartIndexBuild();  // of the RUL2 files loaded during startup
+		}
+		return true;
+	}
 
+	bool PreAppShutdown()
+	{
+		if (settings.enableRUL2EnginePatch) {
+			Rul2Engine::WaitForIndexBuild();
+		}
 		return true;
 	}
 
@@ -0,0 +1,17 @@
+#pragma once
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define NAM_HAS_PREFETCH
+#endif
+
+// Asks the CPU to load the cache line at `p` in the background, so that a later lookup of it does not stall.
+// Issuing the prefetches of several independent lookups before resolving any of them overlaps their memory latency.
+// This is a hint only: it never faults, and it does nothing on platforms other than x86.
+inline void prefetch(const void* p)
+{
+#ifdef NAM_HAS_PREFETCH
+	_mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#else
+	(void)p;
+#endif
+}
@@ -11,14 +11,24 @@
 #include "wil/win32_helpers.h"
 #include "SC4Vector.h"
 #include <vector>
-#include <array>
-#include <algorithm>
 #include "cSC4NetworkTileConflictRule.h"
 #include "NetworkStubs.h"
-#include <unordered_set>
-#include "RuleEquivalence.h"
-#include <utility>
+#include "Rul2Rules.h"
+#include "Rul2Solver.h"
+#include "Rul2World.h"
+#include "Rul2Trace.h"
+#include "Rul2Instrumentation.h"
+#include "RuleCycles.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
 #include "Logger.h"
+#include "Check4GBPatch.h"
 
 std::ostream& operator<<(std::ostream& os, const cSC4NetworkTool::tSolvedCell& t)
 {
@@ -43,76 +53,198 @@ struct MultiMapRange
 
 namespace
 {
-	constexpr int32_t maxRepetitions = 100;
-	constexpr int32_t maxCellsBufferSize = 256 * 3;  // e.g. enough for a diagonal double-tile network across the entire map
-
 	// OverrideRuleNode* const sTileConflictRules = *(reinterpret_cast<OverrideRuleNode**>(0xb466d0));
-	std::unordered_set<cSC4NetworkTileConflictRule, RuleEquivalenceHash, RuleEquivalence> sTileConflictRules2 = {};
+	// The rules are collected while the game loads the RUL2 files and are then inserted into the index in bulk.
+	Rul2Rules sRules = {};
+	Rul2Solver sSolver{sRules};
+	std::filesystem::path sIndexCacheFilePath = {};  // empty if the cache is disabled
+
+	constexpr std::string_view IndexCacheFileName = "NAM-RUL2.cache";
+
+	std::filesystem::path sTraceFilePath = {};  // empty if tracing is disabled
+	Rul2Trace::Writer sTraceWriter = {};
+	Rul2Trace::Record sTraceRecord = {};
+
+	constexpr std::string_view TraceFileName = "NAM-RUL2-trace.bin";
+
+	std::filesystem::path sRuleProfileFilePath = {};  // empty if rule profiling is disabled
 
-	enum Rul2PatchResult : uint32_t { NoMatch, Matched, Prevent };
-	typedef Rul2PatchResult (__thiscall* pfn_cSC4NetworkTool_PatchTilePair)(cSC4NetworkTool* pThis, MultiMapRange const& range, cSC4NetworkTool::tSolvedCell& cell1, cSC4NetworkTool::tSolvedCell& cell2, int8_t dir);
+	constexpr std::string_view RuleProfileFileName = "NAM-RUL2-profile.csv";
+	constexpr size_t RuleProfileTopCount = 1000;
+
+	uint32_t sTimeBudgetMillis = 0;  // 0 if unlimited
+	bool sKeepOverridesOnTimeout = false;
+
+	bool sCycleDetection = false;
+	constexpr uint32_t CycleDetectionMinChainLength = 4;
+	constexpr size_t CycleDetectionMaxLoggedChains = 100;
+
+	typedef Rul2Rules::PatchResult (__thiscall* pfn_cSC4NetworkTool_PatchTilePair)(cSC4NetworkTool* pThis, MultiMapRange const& range, cSC4NetworkTool::tSolvedCell& cell1, cSC4NetworkTool::tSolvedCell& cell2, int8_t dir);
 	// pfn_cSC4NetworkTool_PatchTilePair PatchTilePair = reinterpret_cast<pfn_cSC4NetworkTool_PatchTilePair>(0x6337e0);
 
 	void addRuleOverride(cSC4NetworkTileConflictRule* rule) {
-		if (rule->_2.id != 0) {  // we don't check _1.id != 0 as vanilla doesn't do that either, presumably
-			sTileConflictRules2.insert(*rule);
-		} else {
-			// For the (few) overrides with 0 in 2nd tile (e.g. next to bridges), we add all rotations, to simplify lookup.
-			// (TODO A different solution would special-case the implementation of RuleEquivalence to handle ID 0, but that would be more complex.)
-			for (const auto rf : rotFlipValues) {
-				cSC4NetworkTileConflictRule tmpRule = *rule;
-				tmpRule._2.rf = rf;
-				sTileConflictRules2.insert(tmpRule);
+		sRules.AddRule(*rule);
+	}
+
+	// The index is built on a background thread (see Rul2Engine::StartIndexBuild), which only touches the index,
+	// while the game thread may keep queueing rules. The logger is not thread-safe, so the outcome of the build
+	// is logged on the game thread once the build has finished.
+	struct IndexBuildReport
+	{
+		bool loadedFromCache = false;
+		bool switchedToRegularIndex = false;
+		uint32_t threadCount = 0;
+		double seconds = 0;
+		std::string cacheLoadError = {};
+		std::string cacheSaveError = {};
+		std::string buildError = {};
+		std::vector<std::string> cycleReport = {};  // lines of the log file, see EnableRUL2CycleDetection
+	};
+
+	std::thread sIndexBuildThread = {};
+	IndexBuildReport sIndexBuildReport = {};
+
+	uint32_t indexBuildThreadCount()
+	{
+		const uint32_t cores = std::thread::hardware_concurrency();
+		return std::clamp<uint32_t>(cores > 1 ? cores - 1 : 1, 1, 8);  // leaving one core to the game
+	}
+
+	// Analyzes the rules of the index with RuleCycles. The index holds the first of the equivalent rules only,
+	// without the prefixes of the RUL2 files, so the rules are logged in the orientation and with the prefixes of the index.
+	std::vector<std::string> findRuleCycles()
+	{
+		std::vector<cSC4NetworkTileConflictRule> rules;
+		rules.reserve(sRules.Size());
+		sRules.ForEachRule([&rules](const cSC4NetworkTileConflictRule& rule) { rules.push_back(rule); });
+		const RuleCycles::Result result = RuleCycles::Analyze(rules, CycleDetectionMinChainLength);
+
+		std::vector<std::string> lines;
+		auto addRules = [&lines, &rules](const char* kind, const std::vector<uint32_t>& ruleIndices) {
+			lines.push_back(std::string("RUL2 override ") + kind + " of " + std::to_string(ruleIndices.size()) + " rules:");
+			for (const uint32_t i : ruleIndices) {
+				lines.push_back("  " + Rul2Rules::FormatRule(rules[i]));
 			}
+		};
+		for (const std::vector<uint32_t>& cycle : result.cycles) {
+			addRules("cycle", cycle);
 		}
+		for (size_t i = 0; i < result.chains.size() && i < CycleDetectionMaxLoggedChains; i++) {
+			addRules("chain", result.chains[i]);
+		}
+		lines.push_back("Found " + std::to_string(result.cycles.size()) + " RUL2 override cycles and " + std::to_string(result.chains.size()) +
+				" chains of at least " + std::to_string(CycleDetectionMinChainLength) + " overrides (logging at most the " + std::to_string(CycleDetectionMaxLoggedChains) + " longest chains).");
+		return lines;
 	}
 
-	// Lookup an override rule matching the two tiles and apply it if it exists.
-	Rul2PatchResult PatchTilePair2(cSC4NetworkTool::tSolvedCell& cell1, cSC4NetworkTool::tSolvedCell& cell2, int8_t dir)
+	void buildRuleIndex(Rul2Rules::PendingRules& pendingRules, uint32_t threadCount)
 	{
-		// First we need to convert the absolute rotations of cell1 and cell2 to the relative rotations of RUL2:
-		// dir = 0 (cell2 is west of cell1)
-		// dir = 1 (cell2 is north of cell1)
-		// dir = 2 (cell2 is east of cell1) (this is the case we usually think of when writing RUL2)
-		// dir = 3 (cell2 is south of cell1)
-		cSC4NetworkTileConflictRule dummy = {{cell1.id, absoluteToRelative(cell1.rf, dir)}, {cell2.id, absoluteToRelative(cell2.rf, dir)}};  // tile 3 and 4 uninitialized
-		const auto pRule = sTileConflictRules2.find(dummy);
-		if (pRule == sTileConflictRules2.end()) {
-			return NoMatch;
-		} else if (pRule->_3.id == 0) {
-			return Prevent;
-		} else {
-			const cSC4NetworkTileConflictRule& rule = *pRule;
-			Tile& a = dummy._1;
-			Tile& b = dummy._2;
-			// Here we check not only `a.rf` but also `b.rf` as this could be relevant if `a.id == b.id`.
-			// If `b.id == 0`, its rotation does not matter, which is used for overriding tiles adjacent to bridges for example.
-			if (a.id == rule._1.id && a.rf == rule._1.rf && (b.rf == rule._2.rf || b.id == 0)) {
-				// case R0F0
-				cell1.id = rule._3.id; cell1.rf = relativeToAbsolute(rule._3.rf, dir);
-				cell2.id = rule._4.id; cell2.rf = relativeToAbsolute(rule._4.rf, dir);
-				return Matched;
-			} else if (a.id == rule._1.id && a.rf == flipVertically(rule._1.rf) && (b.rf == flipVertically(rule._2.rf) || b.id == 0)) {
-				// case R2F1
-				cell1.id = rule._3.id; cell1.rf = relativeToAbsolute(flipVertically(rule._3.rf), dir);
-				cell2.id = rule._4.id; cell2.rf = relativeToAbsolute(flipVertically(rule._4.rf), dir);
-				return Matched;
-			} else if (a.id == rule._2.id && a.rf == rotate180(rule._2.rf) && (b.rf == rotate180(rule._1.rf) || b.id == 0)) {
-				// case R2F0
-				cell1.id = rule._4.id; cell1.rf = relativeToAbsolute(rotate180(rule._4.rf), dir);
-				cell2.id = rule._3.id; cell2.rf = relativeToAbsolute(rotate180(rule._3.rf), dir);
-				return Matched;
-			} else if (a.id == rule._2.id && a.rf == flipHorizontally(rule._2.rf) && (b.rf == flipHorizontally(rule._1.rf) || b.id == 0)) {
-				// case R0F1
-				cell1.id = rule._4.id; cell1.rf = relativeToAbsolute(flipHorizontally(rule._4.rf), dir);
-				cell2.id = rule._3.id; cell2.rf = relativeToAbsolute(flipHorizontally(rule._3.rf), dir);
-				return Matched;
-			} else {
-				return NoMatch;  // should not happen
+		IndexBuildReport& report = sIndexBuildReport;
+		report = {};
+		report.threadCount = threadCount;
+		const auto start = std::chrono::steady_clock::now();
+		try {
+			if (!sIndexCacheFilePath.empty()) {
+				try {
+					report.loadedFromCache = sRules.LoadCache(sIndexCacheFilePath, pendingRules.fingerprint);
+					if (report.loadedFromCache) {
+						pendingRules.rules = {};  // release the memory
+					}
+				} catch (const std::exception& e) {
+					report.cacheLoadError = e.what();
+				}
 			}
+			if (!report.loadedFromCache) {
+				const bool useCompactIndex = sRules.UsesCompactIndex();
+				sRules.Build(pendingRules, threadCount);
+				report.switchedToRegularIndex = useCompactIndex && !sRules.UsesCompactIndex();
+
+				if (!sIndexCacheFilePath.empty()) {
+					try {
+						sRules.SaveCache(sIndexCacheFilePath);
+					} catch (const std::exception& e) {
+						report.cacheSaveError = e.what();
+					}
+				}
+			}
+			if (sCycleDetection) {
+				report.cycleReport = findRuleCycles();
+			}
+		} catch (const std::exception& e) {
+			report.buildError = e.what();
+		}
+		report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void logIndexBuild()
+	{
+		Logger& logger = Logger::GetInstance();
+		const IndexBuildReport& report = sIndexBuildReport;
+		if (!report.cacheLoadError.empty()) {
+			logger.WriteLineFormatted(LogLevel::Error, "Failed to load the RUL2 index cache file, so rebuilding the index.\n%s", report.cacheLoadError.c_str());
+		}
+		if (!report.buildError.empty()) {
+			logger.WriteLineFormatted(LogLevel::Error, "Failed to build the RUL2 index.\n%s", report.buildError.c_str());
+			return;
+		}
+		for (const std::string& line : report.cycleReport) {
+			logger.WriteLine(LogLevel::Info, line.c_str());
+		}
+		if (report.loadedFromCache) {
+			logger.WriteLineFormatted(LogLevel::Info, "Loaded the RUL2 index with %u override rules from the cache file.", static_cast<uint32_t>(sRules.Size()));
+			return;
+		}
+
+		if (report.switchedToRegularIndex) {
+			logger.WriteLine(LogLevel::Info, "The RUL2 files contain too many distinct piece IDs for the compact RUL2 index, so using the regular index instead.");
+		}
+		if (sRules.UsesCompactIndex()) {
+			const CompactRuleIndex& index = sRules.CompactIndex();
+			logger.WriteLineFormatted(LogLevel::Info, "Built the compact RUL2 index with %u override rules and %u piece IDs (%u KB) in %.2f s.",
+					static_cast<uint32_t>(index.Size()), static_cast<uint32_t>(index.PieceIdCount()), static_cast<uint32_t>(index.MemoryUsage() / 1024), report.seconds);
+		} else {
+			const RuleIndex& index = sRules.Index();
+			logger.WriteLineFormatted(LogLevel::Info, "Built the RUL2 index with %u override rules (%u slots, %u KB) in %.2f s with %u threads.",
+					static_cast<uint32_t>(index.Size()), static_cast<uint32_t>(index.Capacity()), static_cast<uint32_t>(index.MemoryUsage() / 1024), report.seconds, report.threadCount);
+		}
+		logger.WriteLineFormatted(LogLevel::Info, "Built the RUL2 wildcard index with %u override rules with ID 0 as second tile.",
+				static_cast<uint32_t>(sRules.WildcardIndex().Size()));
+		logger.WriteLineFormatted(LogLevel::Info, "Found %u RUL2 Prevent rules that are checked before evaluating a drag.",
+				static_cast<uint32_t>(sRules.GuaranteedPreventCount()));
+		logger.WriteLineFormatted(LogLevel::Info, "Built the RUL2 lookup filter (%u KB).", static_cast<uint32_t>(sRules.Filter().MemoryUsage() / 1024));
+
+		if (!report.cacheSaveError.empty()) {
+			logger.WriteLineFormatted(LogLevel::Error, "Failed to write the RUL2 index cache file.\n%s", report.cacheSaveError.c_str());
 		}
 	}
 
+	// Waits for the background build, if any.
+	void joinIndexBuild()
+	{
+		if (sIndexBuildThread.joinable()) {
+			const auto start = std::chrono::steady_clock::now();
+			sIndexBuildThread.join();
+			const double waitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			logIndexBuild();
+			Logger::GetInstance().WriteLineFormatted(LogLevel::Debug, "Waited %.2f s for the RUL2 index build in the background.", waitSeconds);
+		}
+	}
+
+	void ensureRuleIndex()
+	{
+		joinIndexBuild();
+		if (sRules.HasPendingRules()) {  // the RUL2 files have been loaded since the last build
+			Rul2Rules::PendingRules pendingRules = sRules.TakePendingRules();
+			buildRuleIndex(pendingRules, indexBuildThreadCount());
+			logIndexBuild();
+		}
+	}
+
+	// Replaces the game's parsed RUL2 rule by our own `addRuleOverride`.
+	// The jump from the inject point to the return address skips over the game's insertion of the rule into its own
+	// multimap (OverrideRuleNode, 5 words of tree overhead per rule), so the rules are not stored twice.
+	// The multimap therefore remains empty, so the game's own lookup in it (PatchTilePair at 0x6337e0) would not find any rules.
+	// Its calls from AdjustTileSubsets are replaced by Hook_AdjustTileSubsets, which looks up the rules in our index instead.
 	constexpr uint32_t AddRuleOverrides_InjectPoint = 0x63d316;
 	constexpr uint32_t AddRuleOverrides_Return = 0x63d33c;
 
@@ -134,236 +266,118 @@ namespace
 		}
 	}
 
-	const std::vector<Tile> orthogonalSurrogateTiles = {
-		{0x00004B00, R1F0},  // Road
-		{0x57000000, R1F0},  // Dirtroad
-		{0x05004B00, R1F0},  // Street
-		{0x5D540000, R1F0},  // Rail
-		{0x08031500, R1F0},  // Lightrail
-		{0x09004B00, R1F0},  // Onewayroad
-		{0x04006100, R1F0},  // Avenue
-		{0x0D031500, R1F0},  // Monorail
-		{0x02001500, R0F0},  // Highway
-		{0x0A001500, R0F0},  // Groundhighway
-	};
-
-	const std::vector<std::pair<Tile, Tile>> diagonalSurrogateTiles = {  // diagonals in west-south direction on first tile, north-east on second tile
-		std::make_pair<Tile, Tile>({0x00000A00, R1F0}, {0x00000A00, R3F0}),  // Road
-		std::make_pair<Tile, Tile>({0x57000200, R1F0}, {0x57000200, R3F0}),  // Dirtroad
-		std::make_pair<Tile, Tile>({0x5F500200, R1F0}, {0x5F500200, R3F0}),  // Street
-		std::make_pair<Tile, Tile>({0x5D540100, R1F0}, {0x5D540100, R3F0}),  // Rail
-		std::make_pair<Tile, Tile>({0x08001A00, R1F0}, {0x08001A00, R3F0}),  // Lightrail
-		std::make_pair<Tile, Tile>({0x09000A00, R1F0}, {0x09000A00, R3F0}),  // Onewayroad
-		std::make_pair<Tile, Tile>({0x04000200, R2F0}, {0x04003800, R0F0}),  // Avenue~SW | Avenue~SharedDiagLeft (we don't need 0x04003800,R2F0 as this duplication should already be part of the RUL2 file)
-		std::make_pair<Tile, Tile>({0x04003800, R0F0}, {0x04000200, R0F0}),  // Avenue~SharedDiagLeft | Avenue~NE
-		std::make_pair<Tile, Tile>({0x0D001A00, R1F0}, {0x0D001A00, R3F0}),  // Monorail
-		std::make_pair<Tile, Tile>({0x02002200, R1F0}, {0x02002100, R1F0}),  // Highway~SW | Highway~SharedDiagLeft
-		std::make_pair<Tile, Tile>({0x02002100, R1F0}, {0x02002200, R3F0}),  // Highway~SharedDiagLeft | Highway~NE
-		std::make_pair<Tile, Tile>({0x0A002200, R1F0}, {0x0A002100, R1F0}),  // Groundhighway~SW | Groundhighway~SharedDiagLeft
-		std::make_pair<Tile, Tile>({0x0A002100, R1F0}, {0x0A002200, R3F0}),  // Groundhighway~SharedDiagLeft | Groundhighway~NE
-	};
-
-	// Try to find a surrogate tile that fits between the two tiles with two suitable override rules.
-	// The override is then applied from the first to the last tile.
-	// This avoids the need for direct adjacencies between the two tiles.
-	// For diagonals, this employs two surrogate tiles instead of one.
-	Rul2PatchResult tryAdjacencies(cSC4NetworkTool::tSolvedCell& cell1, cSC4NetworkTool::tSolvedCell& cell2, int8_t dir)
+	// The network world as seen by the network tool of the game.
+	class NetworkToolWorld final : public Rul2World
 	{
-		for (auto&& surrogate : orthogonalSurrogateTiles) {
-			for (auto&& opposite : {false, true}) {
-				cSC4NetworkTool::tSolvedCell a = cell1;
-				cSC4NetworkTool::tSolvedCell b = {surrogate.id, relativeToAbsolute(surrogate.rf, opposite ? dir+2 : dir), 0xffffffff};
-				cSC4NetworkTool::tSolvedCell c = cell2;
-
-				Rul2PatchResult result = PatchTilePair2(a, b, dir);
-				if (result != Matched ||
-					a.id != cell1.id || a.rf != cell1.rf ||  // a must remain unchanged for a proper adjacency
-					a.id == b.id) {  // a must not be an orthogonal override network
-					// TODO also check that b has changed?
-					continue;  // next surrogate tile
-				}
-				cSC4NetworkTool::tSolvedCell bBackup = b;
-
-				result = PatchTilePair2(b, c, dir);
-				if (result != Matched ||
-					b.id != bBackup.id || b.rf != bBackup.rf ||  //  b must remain unchanged (in 2nd override) for a proper adjacency
-					b.id == c.id ||  // c must not be an orthogonal override network
-					(c.id == cell2.id && c.rf == cell2.rf)) {  // c must change (in 2nd override) for a proper adjacency
-					continue;  // next surrogate tile
-				}
-
-				cell1 = a;
-				cell2 = c;
-				return Matched;
+	public:
+		explicit NetworkToolWorld(cSC4NetworkTool* networkTool) : networkTool(networkTool) {}
+
+		bool GetCell(uint32_t xz, Rul2WorldCell& cell) override
+		{
+			cSC4NetworkCellInfo* cellInfo = networkTool->networkWorldCache.GetCell(xz);
+			if (cellInfo == nullptr) {
+				return false;
 			}
+			cell = {};
+			cell.isImmovable = cellInfo->isImmovable;
+			cell.isNetworkLot = cellInfo->isNetworkLot;
+			cell.idxInCellsBuffer = cellInfo->idxInCellsBuffer;
+			cISC4NetworkOccupant* networkOccupant = cellInfo->networkOccupant;
+			if (networkOccupant != nullptr) {
+				cell.hasOccupant = true;
+				cell.id = networkOccupant->PieceId();
+				cell.rf = static_cast<RotFlip>(networkOccupant->GetRotationAndFlip());
+			}
+			return true;
 		}
 
-		for (auto&& surrogatePair : diagonalSurrogateTiles) {
-			for (auto&& southBound : {true, false}) {
-				cSC4NetworkTool::tSolvedCell a = cell1;
-				cSC4NetworkTool::tSolvedCell b = {surrogatePair.first.id, relativeToAbsolute(surrogatePair.first.rf, southBound ? dir : dir+1), 0xffffffff};
-				cSC4NetworkTool::tSolvedCell c = {surrogatePair.second.id, relativeToAbsolute(surrogatePair.second.rf, southBound ? dir : dir+1), 0xffffffff};
-				cSC4NetworkTool::tSolvedCell d = cell2;
-
-				Rul2PatchResult result = PatchTilePair2(a, b, dir);
-				if (result != Matched ||
-					a.id != cell1.id || a.rf != cell1.rf ||  // a must remain unchanged for a proper adjacency
-					a.id == b.id) {  // a must not be a straight diagonal override network
-					continue;
-				}
-				cSC4NetworkTool::tSolvedCell bBackup = b;
-
-				// Assuming dir == 2, then c is south of b if southBound (dir+1) or north of b if northBound (dir-1).
-				result = PatchTilePair2(b, c, (dir + (southBound ? 1 : -1)) & 3);
-				if (result != Matched ||
-					b.id != bBackup.id || b.rf != bBackup.rf ||  // b must remain unchanged (in 2nd override) for a proper adjacency
-					(c.id == cell1.id && c.rf == cell1.rf)) {  // otherwise we haven't gone anywhere
-					continue;
-				}
-				cSC4NetworkTool::tSolvedCell cBackup = c;
-
-				result = PatchTilePair2(c, d, dir);
-				if (result != Matched ||
-					c.id != cBackup.id || c.rf != cBackup.rf ||  // c must remain unchanged (in 3rd override) for a proper adjacency
-					c.id == d.id || b.id == d.id ||  // d must not be a pure diagonal
-					(d.id == cell2.id && d.rf == cell2.rf)) {  // d must change (in 3rd override) for a proper adjacency
-					continue;
-				}
+		void SetCellsBufferIndex(uint32_t xz, int32_t idx) override
+		{
+			networkTool->networkWorldCache.GetCell(xz)->idxInCellsBuffer = idx;
+		}
+
+	private:
+		cSC4NetworkTool* networkTool;
+	};
+
+	std::vector<Rul2Cell> sCells = {};  // reused across invocations
+	cSC4NetworkTool* sLastNetworkTool = nullptr;
 
-				cell1 = a;
-				cell2 = d;
-				return Matched;
+	// Solves sCells like sSolver.Solve, but also appends the invocation to the trace file.
+	Rul2Solver::Outcome solveAndTrace(Rul2World& world, bool forgotLastFrame)
+	{
+		Logger& logger = Logger::GetInstance();
+		if (!sTraceWriter.IsOpen()) {
+			try {
+				sTraceWriter.Open(sTraceFilePath, {sSolver.IsIncremental(), sRules.UsesCompactIndex(), sSolver.HasSolutionCache(), sRules.Fingerprint()});
+				logger.WriteLineFormatted(LogLevel::Info, "Recording the RUL2 evaluations of network drags in %s.", sTraceFilePath.string().c_str());
+			} catch (const std::exception& e) {
+				logger.WriteLineFormatted(LogLevel::Error, "Failed to create the RUL2 trace file, so disabling the trace.\n%s", e.what());
+				sTraceFilePath.clear();
+				return sSolver.Solve(world, sCells);
 			}
+			sSolver.ForgetLastFrame();  // the replay starts without a last frame as well
+			sSolver.ClearSolutionCache();  // and without cached solutions
+			forgotLastFrame = true;
 		}
 
-		return NoMatch;
+		Rul2Trace::Record& record = sTraceRecord;
+		record.forgotLastFrame = forgotLastFrame;
+		record.input = sCells;
+		record.reads.clear();
+		Rul2Trace::RecordingWorld recordingWorld(world, record);
+		const auto start = std::chrono::steady_clock::now();
+		record.outcome = sSolver.Solve(recordingWorld, sCells);
+		record.durationMicros = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+		record.output = sCells;
+
+		try {
+			sTraceWriter.Write(record);
+		} catch (const std::exception& e) {
+			logger.WriteLineFormatted(LogLevel::Error, "Failed to write the RUL2 trace file, so disabling the trace.\n%s", e.what());
+			sTraceFilePath.clear();
+		}
+		return record.outcome;
 	}
 
 	bool AdjustTileSubsets2(cSC4NetworkTool* networkTool, SC4Vector<cSC4NetworkTool::tSolvedCell>& cellsBuffer)
 	{
-		// if (sTileConflictRules == nullptr) {
-		// 	return true;  // success as RUL2 file was not yet loaded
-		// }
+		ensureRuleIndex();
 
-		int32_t countMatchesDown = cellsBuffer.size() * 8;  // 4 directions * {non-swapped,swapped}
-		if (countMatchesDown <= maxRepetitions) {
-			countMatchesDown = maxRepetitions;
+		const bool forgotLastFrame = networkTool != sLastNetworkTool;
+		if (forgotLastFrame) {
+			sSolver.ForgetLastFrame();
+			sLastNetworkTool = networkTool;
 		}
 
-		if (cellsBuffer.empty()) {
-			return true;
+		const uint32_t inputSize = cellsBuffer.size();
+		sCells.clear();
+		for (const cSC4NetworkTool::tSolvedCell& cell : cellsBuffer) {
+			sCells.push_back({cell.id, cell.rf, cell.xz});
 		}
-		cSC4NetworkTool::tSolvedCell* cell = cellsBuffer.begin();
-		bool foundMatch = false;
-
-		int32_t countPatchesCurrentCell = 0;
-		while (true) {
-mainLoop:
-			// Well-foundedness: Either countPatchesCurrentCell is incremented, or it's reset to 0 but cell is incremented, or cell is reset to begin() but foundMatch was true, so countMatchesDown was decremented.
-			// Hence, the triple (-countMatchesDown, cell, countPatchesCurrentCell) is strictly increasing, with countMatchesDown and countPatchesCurrentCell being bounded by constants.
-			// The only termination problem can arise when cellsBuffer grows without bounds, for some reason, so we bound it by maxCellsBufferSize.
-			if (countPatchesCurrentCell <= maxRepetitions) {
-				for (uint32_t dir = 0; dir < 4; dir++) {
-					uint32_t z = cell->xz >> 16;
-					uint32_t x = cell->xz & 0xffff;
-					uint32_t nextCellXZ = (kNextZ[dir] + z) * 0x10000 + (kNextX[dir] + x);
-
-					cSC4NetworkCellInfo* cell2Info = networkTool->networkWorldCache.GetCell(nextCellXZ);
-					if (cell2Info == nullptr) {
-						continue;  // next direction
-					}
-
-					cSC4NetworkTool::tSolvedCell temp;
-					cSC4NetworkTool::tSolvedCell* cell2 = nullptr;
-					bool isCell2StackLocal = false;
-
-					if (cell2Info->idxInCellsBuffer < 0) {
-						cISC4NetworkOccupant* networkOccupant = cell2Info->networkOccupant;
-						if (networkOccupant == nullptr) {
-							continue;  // next direction
-						}
-						cell2 = &temp;
-						temp.xz = nextCellXZ;
-						temp.id = networkOccupant->PieceId();
-						temp.rf = static_cast<RotFlip>(networkOccupant->GetRotationAndFlip());
-						isCell2StackLocal = true;
-					} else {
-						cell2 = cellsBuffer.begin() + (cell2Info->idxInCellsBuffer);
-						if (cell2 == nullptr) {
-							continue;  // next direction
-						}
-					}
-					// now cell2 is not nullptr
-
-					if (cell2Info->isImmovable || cell2Info->isNetworkLot) {
-						if (!isCell2StackLocal) {
-							temp = *cell2;
-							cell2 = &temp;
-						}
-						temp.id = 0;
-						isCell2StackLocal = true;
-					}
-
-					if (cell2 == nullptr) {
-						continue;  // next direction
-					}
-
-					Rul2PatchResult patchResult = PatchTilePair2(*cell, *cell2, dir);
-
-					if (patchResult == NoMatch) {
-						patchResult = tryAdjacencies(*cell, *cell2, dir);  // cell -> surrogate -> cell2
-						if (patchResult != Matched) {  // potential Prevents from adjacencies are discarded
-							if (isCell2StackLocal) {  // otherwise, cell2 is queued in buffer, so we will eventually process it from cell2's point of view anyway
-								patchResult = tryAdjacencies(*cell2, *cell, (dir - 2) & 3);  // cell2 -> surrogate -> cell
-							}
-							if (patchResult != Matched) {
-								continue;  // next direction
-							}
-						}
-					}
-
-					if (patchResult == Prevent) {
-						return false; // Prevent
-					}
-					// Matched and no Prevent
 
-					countMatchesDown--;
-					if (countMatchesDown < 0) {
-						return false;  // Prevent
-					}
+		NetworkToolWorld world(networkTool);
+		const Rul2Solver::Outcome outcome = sTraceFilePath.empty() ? sSolver.Solve(world, sCells) : solveAndTrace(world, forgotLastFrame);
 
-					foundMatch = true;
-
-					if (isCell2StackLocal) {  // cell is not in buffer
-						uint32_t idx = cell - cellsBuffer.begin();
-						uint32_t idx2 = cellsBuffer.size();
-						if (idx2 >= maxCellsBufferSize) {  // safe-guard to ensure termination
-							Logger& logger = Logger::GetInstance();
-							logger.WriteLineFormatted(LogLevel::Info, "Unexpectedly many cells in RUL2 evaluation queue (size=%d, idx=%d), so terminating evaluation with a red-drag.", idx2, idx);
-							return false;  // Prevent (Returning true would also be an option. It would result in random unstable overrides.)
-						}
-						cell2Info->idxInCellsBuffer = idx2;
-						cellsBuffer.push_back(*cell2);
-						cell = cellsBuffer.begin() + idx;  // push_back might have triggered reallocation of the cells, so we retrieve the current address again
-					}
-
-					countPatchesCurrentCell++;
-					goto mainLoop;
-				}
-			}
-
-			cell = cell + 1;
-			countPatchesCurrentCell = 0;
-			if (cell != cellsBuffer.end()) {  // if not reached end
-				continue;  // main loop
-			} else if (foundMatch) {  // reached end, but also foundMatch, so continue until all cells remain unchanged
-				cell = cellsBuffer.begin();
-				foundMatch = false;
-				continue;  // main loop
+		for (uint32_t i = 0; i < sCells.size(); i++) {
+			const Rul2Cell& cell = sCells[i];
+			if (i < inputSize) {
+				cellsBuffer.begin()[i] = {cell.id, cell.rf, cell.xz};
 			} else {
-				return true;
+				cellsBuffer.push_back({cell.id, cell.rf, cell.xz});
 			}
 		}
+
+		if (outcome == Rul2Solver::TooManyCells) {
+			Logger::GetInstance().WriteLineFormatted(LogLevel::Info, "Unexpectedly many cells in RUL2 evaluation queue (size=%d), so terminating evaluation with a red-drag.", static_cast<int32_t>(sCells.size()));
+		} else if (outcome == Rul2Solver::TooManyMatches) {
+			Logger::GetInstance().WriteLineFormatted(LogLevel::Info, "Too many RUL2 overrides matched in evaluation queue (size=%d), presumably overriding each other, so terminating evaluation with a red-drag.", static_cast<int32_t>(sCells.size()));
+		} else if (outcome == Rul2Solver::TimeBudgetExceeded) {
+			Logger::GetInstance().WriteLineFormatted(LogLevel::Info, "RUL2 evaluation exceeded the time budget of %u ms (queue size=%d), so terminating evaluation with %s.",
+					sTimeBudgetMillis, static_cast<int32_t>(sCells.size()), sKeepOverridesOnTimeout ? "the overrides of the last consistent state" : "a red-drag");
+			return sKeepOverridesOnTimeout;
+		}
+		return outcome == Rul2Solver::Solved;  // otherwise Prevent
 	}
 
 	constexpr uint32_t AdjustTileSubsets_InjectPoint = 0x634d79;
@@ -389,9 +403,91 @@ mainLoop:
 
 }
 
-void Rul2Engine::Install()
+void Rul2Engine::StartIndexBuild()
+{
+	if (!sIndexBuildThread.joinable() && sRules.HasPendingRules()) {
+		auto pendingRules = std::make_shared<Rul2Rules::PendingRules>(sRules.TakePendingRules());
+		const uint32_t threadCount = indexBuildThreadCount();
+		try {
+			sIndexBuildThread = std::thread([pendingRules, threadCount]() { buildRuleIndex(*pendingRules, threadCount); });
+		} catch (const std::system_error& e) {
+			Logger::GetInstance().WriteLineFormatted(LogLevel::Error, "Failed to start building the RUL2 index in the background, so building it right away.\n%s", e.what());
+			buildRuleIndex(*pendingRules, threadCount);
+			logIndexBuild();
+		}
+	}
+}
+
+void Rul2Engine::WaitForIndexBuild()
+{
+	joinIndexBuild();
+}
+
+void Rul2Engine::LogStatistics()
 {
-	// sTileConflictRules2.reserve(4500 * 1000);  // TODO
+	if (sIndexBuildThread.joinable()) {
+		return;  // no lookups happen until the index has been built
+	}
+	Rul2Rules::LookupStatistics& stats = sRules.Statistics();
+	if (stats.lookups > 0 || stats.skippedAdjacencySearches > 0) {
+		Logger::GetInstance().WriteLineFormatted(LogLevel::Info,
+				"RUL2 lookups: %llu, rejected by filter: %llu (tiles: %llu, pairs: %llu), answered by lookup cache: %llu of %llu, filter false positives: %llu, skipped adjacency searches: %llu.",
+				stats.lookups, stats.rejectedTile + stats.rejectedPair, stats.rejectedTile, stats.rejectedPair,
+				stats.cacheHits, stats.lookups - stats.rejectedTile - stats.rejectedPair, stats.missed, stats.skippedAdjacencySearches);
+	}
+	stats = {};
+	Rul2Solver::SolutionCacheStatistics& cacheStats = sSolver.CacheStatistics();
+	if (cacheStats.hits + cacheStats.misses > 0) {
+		Logger::GetInstance().WriteLineFormatted(LogLevel::Info,
+				"RUL2 evaluations answered by solution cache: %llu of %llu (%.1f%%), cache size: %u KB.",
+				cacheStats.hits, cacheStats.hits + cacheStats.misses, 100.0 * cacheStats.hits / (cacheStats.hits + cacheStats.misses),
+				static_cast<uint32_t>(sSolver.SolutionCacheMemoryUsage() / 1024));
+	}
+	cacheStats = {};
+#ifdef NAM_RUL2_INSTRUMENTATION
+	for (const std::string& line : Rul2Instrumentation::FormatReport()) {
+		Logger::GetInstance().WriteLine(LogLevel::Info, line.c_str());
+	}
+	Rul2Instrumentation::report = {};
+#endif
+}
+
+void Rul2Engine::WriteRuleProfile()
+{
+	if (sRuleProfileFilePath.empty() || sIndexBuildThread.joinable()) {
+		return;
+	}
+	Logger& logger = Logger::GetInstance();
+	std::ofstream out(sRuleProfileFilePath, std::ios::binary);
+	sRules.WriteRuleProfile(out, RuleProfileTopCount);
+	out.close();
+	if (out) {
+		logger.WriteLineFormatted(LogLevel::Info, "Wrote the RUL2 rule profile to %s.", sRuleProfileFilePath.string().c_str());
+	} else {
+		logger.WriteLineFormatted(LogLevel::Error, "Failed to write the RUL2 rule profile to %s.", sRuleProfileFilePath.string().c_str());
+	}
+}
+
+void Rul2Engine::Install(const Settings& settings, const std::filesystem::path& dllFolderPath)
+{
+	// Without the 4GB patch, the game has only 2GB of address space, so we prefer the smaller index.
+	sRules.SetUseCompactIndex(settings.enableCompactRUL2Index || !Check4GBPatch::IsPatchInstalled());
+	if (settings.enableRUL2IndexCache) {
+		sIndexCacheFilePath = dllFolderPath / IndexCacheFileName;
+	}
+	sSolver.SetIncremental(settings.enableIncrementalRUL2Evaluation);
+	sSolver.SetSolutionCache(settings.enableRUL2SolutionCache);
+	sTimeBudgetMillis = settings.rul2TimeBudgetMillis;
+	sKeepOverridesOnTimeout = settings.keepRUL2OverridesOnTimeout;
+	sSolver.SetTimeBudget(std::chrono::milliseconds(sTimeBudgetMillis));
+	if (settings.enableRUL2DragTrace) {
+		sTraceFilePath = dllFolderPath / TraceFileName;
+	}
+	sRules.SetRuleProfiling(settings.enableRUL2RuleProfiling);
+	if (settings.enableRUL2RuleProfiling) {
+		sRuleProfileFilePath = dllFolderPath / RuleProfileFileName;
+	}
+	sCycleDetection = settings.enableRUL2CycleDetection;
 	Patching::InstallHook(AdjustTileSubsets_InjectPoint, Hook_AdjustTileSubsets);
 	Patching::InstallHook(AddRuleOverrides_InjectPoint, Hook_AddRuleOverrides);
 }
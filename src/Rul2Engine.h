@@ -1,6 +1,23 @@
 #pragma once
+#include "Settings.h"
+#include <filesystem>
 
 namespace Rul2Engine
 {
-	void Install();
+	void Install(const Settings& settings, const std::filesystem::path& dllFolderPath);
+
+	// Starts building the RUL2 index from the rules loaded so far on a background thread, so that the build overlaps
+	// with the rest of the game's startup. The first RUL2 lookup waits for the build to finish.
+	void StartIndexBuild();
+
+	// Waits for a build started by StartIndexBuild to finish, e.g. before the game shuts down.
+	void WaitForIndexBuild();
+
+	// Writes the counters of the RUL2 rule lookups and of the solution cache to the log file and resets them,
+	// including the histograms of the RUL2 evaluations if compiled with NAM_RUL2_INSTRUMENTATION (see Rul2Instrumentation).
+	void LogStatistics();
+
+	// Writes the most matched and the never matched RUL2 rules to a CSV file next to the DLL, if enabled by EnableRUL2RuleProfiling.
+	// The counts accumulate until the index is rebuilt.
+	void WriteRuleProfile();
 }
@@ -0,0 +1,114 @@
+#include "Rul2Instrumentation.h"
+
+#ifdef NAM_RUL2_INSTRUMENTATION
+#include "Rul2Solver.h"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+namespace
+{
+	constexpr std::array<const char*, 5> outcomeNames = {"solved", "prevented", "too many matches", "too many cells", "time budget exceeded"};
+	static_assert(Rul2Solver::Solved == 0 && Rul2Solver::Prevented == 1 && Rul2Solver::TooManyMatches == 2 && Rul2Solver::TooManyCells == 3 &&
+			Rul2Solver::TimeBudgetExceeded == 4);
+
+	constexpr uint32_t bucketUpperBound(uint32_t bucket)
+	{
+		return bucket == 0 ? 0 : static_cast<uint32_t>((uint64_t(1) << bucket) - 1);
+	}
+
+	template <typename... Args>
+	std::string format(const char* format, Args... args)
+	{
+		char buffer[256];
+		std::snprintf(buffer, sizeof(buffer), format, args...);
+		return buffer;
+	}
+}
+
+void Rul2Instrumentation::Histogram::Add(uint32_t value)
+{
+	buckets[std::bit_width(value)]++;
+	count++;
+	sum += value;
+	max = std::max(max, value);
+}
+
+uint32_t Rul2Instrumentation::Histogram::QuantileBound(double p) const
+{
+	const double rank = p * count;
+	uint64_t cumulative = 0;
+	for (uint32_t bucket = 0; bucket < bucketCount; bucket++) {
+		cumulative += buckets[bucket];
+		if (cumulative > 0 && cumulative >= rank) {
+			return std::min(bucketUpperBound(bucket), max);
+		}
+	}
+	return max;
+}
+
+std::string Rul2Instrumentation::Histogram::Format() const
+{
+	std::string s;
+	for (uint32_t bucket = 0; bucket < bucketCount; bucket++) {
+		if (buckets[bucket] == 0) {
+			continue;
+		}
+		if (!s.empty()) {
+			s += ", ";
+		}
+		const uint32_t low = bucket == 0 ? 0 : bucketUpperBound(bucket - 1) + 1;
+		s += low == bucketUpperBound(bucket) ? format("%u", low) : format("%u-%u", low, bucketUpperBound(bucket));
+		s += format(": %llu", static_cast<unsigned long long>(buckets[bucket]));
+	}
+	return s;
+}
+
+void Rul2Instrumentation::End(uint32_t outcome, uint32_t cellCount)
+{
+	const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	report.outcomes[outcome]++;
+	report.micros.Add(static_cast<uint32_t>(std::min<int64_t>(micros, UINT32_MAX)));
+	report.cells.Add(cellCount);
+	report.lookups.Add(current.lookups);
+	report.hits.Add(current.hits);
+	report.prevents.Add(current.prevents);
+	report.adjacencySearches.Add(current.adjacencySearches);
+	report.surrogateProbes.Add(current.surrogateProbes);
+	report.restarts.Add(current.restarts);
+	report.remainingMatches.Add(static_cast<uint32_t>(std::max(current.remainingMatches, 0)));
+}
+
+std::vector<std::string> Rul2Instrumentation::FormatReport()
+{
+	std::vector<std::string> lines;
+	const Histogram& micros = report.micros;
+	if (micros.Count() == 0) {
+		return lines;
+	}
+	auto count = [](uint64_t n) { return static_cast<unsigned long long>(n); };
+	lines.push_back(format("RUL2 evaluations: %llu (%s: %llu, %s: %llu, %s: %llu, %s: %llu, %s: %llu) in %.1f ms.", count(micros.Count()),
+			outcomeNames[0], count(report.outcomes[0]), outcomeNames[1], count(report.outcomes[1]), outcomeNames[2], count(report.outcomes[2]),
+			outcomeNames[3], count(report.outcomes[3]), outcomeNames[4], count(report.outcomes[4]), micros.Sum() / 1000.0));
+	lines.push_back(format("RUL2 evaluation latency: mean %.1f us, p50 <= %u us, p90 <= %u us, p99 <= %u us, max %u us.",
+			static_cast<double>(micros.Sum()) / micros.Count(), micros.QuantileBound(0.5), micros.QuantileBound(0.9), micros.QuantileBound(0.99), micros.Max()));
+	lines.push_back("RUL2 evaluation latency histogram (us): " + micros.Format());
+
+	const std::array<std::pair<const char*, const Histogram*>, 8> counters = {{
+		{"cells", &report.cells},
+		{"lookups", &report.lookups},
+		{"hits", &report.hits},
+		{"prevents", &report.prevents},
+		{"adjacency searches", &report.adjacencySearches},
+		{"surrogate probes", &report.surrogateProbes},
+		{"restarts", &report.restarts},
+		{"remaining matches", &report.remainingMatches},
+	}};
+	for (const auto& [name, histogram] : counters) {
+		lines.push_back(format("RUL2 %s per evaluation: mean %.1f, p90 <= %u, max %u; histogram: ",
+				name, static_cast<double>(histogram->Sum()) / histogram->Count(), histogram->QuantileBound(0.9), histogram->Max()) + histogram->Format());
+	}
+	return lines;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Counters of the RUL2 evaluations of network drags (Rul2Solver::Solve), aggregated into histograms for profiling in the field.
+//
+// The instrumentation is only compiled in if NAM_RUL2_INSTRUMENTATION is defined (e.g. /D "NAM_RUL2_INSTRUMENTATION" for the DLL,
+// or CXXFLAGS=-DNAM_RUL2_INSTRUMENTATION for the host tools). Otherwise the NAM_RUL2_COUNT and NAM_RUL2_RECORD macros expand to nothing.
+// The counters are plain globals, as the game evaluates the drags on its main thread only.
+#ifdef NAM_RUL2_INSTRUMENTATION
+
+namespace Rul2Instrumentation
+{
+	// The counters of a single invocation of Rul2Solver::Solve.
+	struct Invocation
+	{
+		uint32_t lookups = 0;  // PatchTilePair of two cells
+		uint32_t hits = 0;  // lookups that matched a rule (not counting Prevents)
+		uint32_t prevents = 0;
+		uint32_t adjacencySearches = 0;  // TryAdjacencies
+		uint32_t surrogateProbes = 0;  // surrogate candidates tried by TryAdjacencies
+		uint32_t restarts = 0;  // rescans of the cells after a pass with a match
+		int32_t remainingMatches = 0;  // matches left before TooManyMatches when the evaluation ended
+	};
+
+	// Counts of values in power-of-2 buckets: bucket 0 holds the value 0, bucket i > 0 the values from 2^(i-1) to 2^i - 1.
+	class Histogram
+	{
+	public:
+		static constexpr uint32_t bucketCount = 33;
+
+		void Add(uint32_t value);
+		uint64_t Count() const { return count; }
+		uint64_t Sum() const { return sum; }
+		uint32_t Max() const { return max; }
+
+		// An upper bound of the p-th quantile (0 < p <= 1), as the histogram does not keep the values themselves.
+		uint32_t QuantileBound(double p) const;
+
+		// e.g. "0: 12, 1: 5, 2-3: 7" listing the non-empty buckets
+		std::string Format() const;
+
+	private:
+		std::array<uint64_t, bucketCount> buckets = {};
+		uint64_t count = 0;
+		uint64_t sum = 0;
+		uint32_t max = 0;
+	};
+
+	// The invocations since the report was last reset.
+	struct Report
+	{
+		std::array<uint64_t, 5> outcomes = {};  // indexed by Rul2Solver::Outcome
+		Histogram micros;
+		Histogram cells;  // including the overridden neighbors appended to them
+		Histogram lookups;
+		Histogram hits;
+		Histogram prevents;
+		Histogram adjacencySearches;
+		Histogram surrogateProbes;
+		Histogram restarts;
+		Histogram remainingMatches;
+	};
+
+	inline Invocation current = {};
+	inline Report report = {};
+	inline std::chrono::steady_clock::time_point start = {};
+
+	inline void Begin()
+	{
+		current = {};
+		start = std::chrono::steady_clock::now();
+	}
+
+	// Adds the current invocation to the report.
+	void End(uint32_t outcome, uint32_t cellCount);
+
+	// The report as lines of text for the log file, empty if there were no invocations.
+	std::vector<std::string> FormatReport();
+}
+
+#define NAM_RUL2_COUNT(counter) (Rul2Instrumentation::current.counter++)
+#define NAM_RUL2_RECORD(counter, value) (Rul2Instrumentation::current.counter = (value))
+
+#else
+
+#define NAM_RUL2_COUNT(counter) ((void)0)
+#define NAM_RUL2_RECORD(counter, value) ((void)0)
+
+#endif
@@ -0,0 +1,626 @@
+#include "Rul2Rules.h"
+#include "Rul2Instrumentation.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <ostream>
+#include <unordered_set>
+#include <utility>
+
+namespace
+{
+	const std::vector<Tile> orthogonalSurrogateTiles = {
+		{0x00004B00, R1F0},  // Road
+		{0x57000000, R1F0},  // Dirtroad
+		{0x05004B00, R1F0},  // Street
+		{0x5D540000, R1F0},  // Rail
+		{0x08031500, R1F0},  // Lightrail
+		{0x09004B00, R1F0},  // Onewayroad
+		{0x04006100, R1F0},  // Avenue
+		{0x0D031500, R1F0},  // Monorail
+		{0x02001500, R0F0},  // Highway
+		{0x0A001500, R0F0},  // Groundhighway
+	};
+
+	const std::vector<std::pair<Tile, Tile>> diagonalSurrogateTiles = {  // diagonals in west-south direction on first tile, north-east on second tile
+		std::make_pair<Tile, Tile>({0x00000A00, R1F0}, {0x00000A00, R3F0}),  // Road
+		std::make_pair<Tile, Tile>({0x57000200, R1F0}, {0x57000200, R3F0}),  // Dirtroad
+		std::make_pair<Tile, Tile>({0x5F500200, R1F0}, {0x5F500200, R3F0}),  // Street
+		std::make_pair<Tile, Tile>({0x5D540100, R1F0}, {0x5D540100, R3F0}),  // Rail
+		std::make_pair<Tile, Tile>({0x08001A00, R1F0}, {0x08001A00, R3F0}),  // Lightrail
+		std::make_pair<Tile, Tile>({0x09000A00, R1F0}, {0x09000A00, R3F0}),  // Onewayroad
+		std::make_pair<Tile, Tile>({0x04000200, R2F0}, {0x04003800, R0F0}),  // Avenue~SW | Avenue~SharedDiagLeft (we don't need 0x04003800,R2F0 as this duplication should already be part of the RUL2 file)
+		std::make_pair<Tile, Tile>({0x04003800, R0F0}, {0x04000200, R0F0}),  // Avenue~SharedDiagLeft | Avenue~NE
+		std::make_pair<Tile, Tile>({0x0D001A00, R1F0}, {0x0D001A00, R3F0}),  // Monorail
+		std::make_pair<Tile, Tile>({0x02002200, R1F0}, {0x02002100, R1F0}),  // Highway~SW | Highway~SharedDiagLeft
+		std::make_pair<Tile, Tile>({0x02002100, R1F0}, {0x02002200, R3F0}),  // Highway~SharedDiagLeft | Highway~NE
+		std::make_pair<Tile, Tile>({0x0A002200, R1F0}, {0x0A002100, R1F0}),  // Groundhighway~SW | Groundhighway~SharedDiagLeft
+		std::make_pair<Tile, Tile>({0x0A002100, R1F0}, {0x0A002200, R3F0}),  // Groundhighway~SharedDiagLeft | Groundhighway~NE
+	};
+
+	// The surrogate candidates of TryAdjacencies, numbered in the order in which they are tried:
+	// first the orthogonal surrogates (each facing in direction of the search and opposite to it),
+	// then the diagonal surrogate pairs (each south-bound and north-bound).
+	constexpr uint32_t orthogonalCandidateCount = 2 * 10;
+	constexpr uint32_t candidateCount = orthogonalCandidateCount + 2 * 13;
+
+	// The surrogate tile of a candidate, relative to the direction of the search.
+	Tile candidateSurrogateTile(uint32_t candidate)
+	{
+		if (candidate < orthogonalCandidateCount) {
+			const Tile& surrogate = orthogonalSurrogateTiles[candidate / 2];
+			return {surrogate.id, (candidate & 1) ? rotate180(surrogate.rf) : surrogate.rf};
+		} else {
+			const Tile& surrogate = diagonalSurrogateTiles[(candidate - orthogonalCandidateCount) / 2].first;
+			return {surrogate.id, (candidate & 1) ? rotate(surrogate.rf, 1) : surrogate.rf};
+		}
+	}
+
+	constexpr uint64_t tileKey(uint32_t id, RotFlip rf)
+	{
+		return (uint64_t(id) << 8) | rf;
+	}
+}
+
+std::vector<uint32_t> Rul2Rules::SurrogateTileIds()
+{
+	std::vector<uint32_t> ids;
+	for (const Tile& tile : orthogonalSurrogateTiles) {
+		ids.push_back(tile.id);
+	}
+	for (const auto& [first, second] : diagonalSurrogateTiles) {
+		ids.push_back(first.id);
+		ids.push_back(second.id);
+	}
+	return ids;
+}
+
+std::string Rul2Rules::FormatRule(const cSC4NetworkTileConflictRule& rule)
+{
+	auto rot = [](const Tile& t) { return t.rf & 3; };
+	auto flip = [](const Tile& t) { return t.rf >> 7; };
+	char buffer[128];
+	std::snprintf(buffer, sizeof(buffer), "1,0x%08X,%u,%u,0x%08X,%u,%u=2,0x%08X,%u,%u,0x%08X,%u,%u",
+			rule._1.id, rot(rule._1), flip(rule._1), rule._2.id, rot(rule._2), flip(rule._2),
+			rule._3.id, rot(rule._3), flip(rule._3), rule._4.id, rot(rule._4), flip(rule._4));
+	return buffer;
+}
+
+void Rul2Rules::AddRule(const cSC4NetworkTileConflictRule& rule)
+{
+	const uint32_t ordinal = static_cast<uint32_t>(pendingRules.fingerprint.ruleCount);
+	pendingRules.fingerprint.Add(rule);
+	if (rule._2.id != 0) {  // we don't check _1.id != 0 as vanilla doesn't do that either, presumably
+		pendingRules.rules.Push(rule);
+		if (rule._1.id == 0) {
+			// may be equivalent to a wildcard rule, whichever comes first wins
+			pendingRules.wildcardRules.push_back({rule, ordinal});
+		}
+	} else {
+		// The (few) overrides with 0 in 2nd tile (e.g. next to bridges) ignore its RotFlip, see WildcardRuleIndex.
+		pendingRules.wildcardRules.push_back({rule, ordinal});
+	}
+}
+
+Rul2Rules::PendingRules Rul2Rules::TakePendingRules()
+{
+	PendingRules rules = std::move(pendingRules);
+	pendingRules = {{}, {}, rules.fingerprint};
+	return rules;
+}
+
+bool Rul2Rules::LoadCache(const std::filesystem::path& cacheFilePath)
+{
+	if (!LoadCache(cacheFilePath, pendingRules.fingerprint)) {
+		return false;
+	}
+	pendingRules.rules = {};
+	pendingRules.wildcardRules.clear();
+	return true;
+}
+
+bool Rul2Rules::LoadCache(const std::filesystem::path& cacheFilePath, const RuleIndexCache::Fingerprint& fingerprint)
+{
+	const bool loaded = useCompactIndex
+		? RuleIndexCache::Load(cacheFilePath, fingerprint, compactIndex, wildcardIndex)
+		: RuleIndexCache::Load(cacheFilePath, fingerprint, index, wildcardIndex);
+	if (loaded) {
+		this->fingerprint = fingerprint;
+		BuildLookupAccelerators();
+	}
+	return loaded;
+}
+
+void Rul2Rules::Build()
+{
+	PendingRules rules = TakePendingRules();
+	Build(rules, 1);
+}
+
+void Rul2Rules::Build(PendingRules& rules, uint32_t threadCount)
+{
+	if (useCompactIndex && !compactIndex.Build(rules.rules)) {
+		// too many distinct piece IDs for the compact index
+		RuleStagingBuffer allRules;
+		compactIndex.ForEachRule([&allRules](const cSC4NetworkTileConflictRule& rule) { allRules.Push(rule); });  // rules from previous builds take precedence
+		rules.rules.ForEach([&allRules](const cSC4NetworkTileConflictRule& rule) { allRules.Push(rule); });
+		rules.rules = std::move(allRules);
+		compactIndex = {};
+		useCompactIndex = false;
+	}
+	if (!useCompactIndex) {
+		index.Build(rules.rules, threadCount);
+	}
+	wildcardIndex.Add(rules.wildcardRules);
+	rules.wildcardRules.clear();
+	fingerprint = rules.fingerprint;
+	BuildLookupAccelerators();
+}
+
+void Rul2Rules::SaveCache(const std::filesystem::path& cacheFilePath) const
+{
+	if (useCompactIndex) {
+		RuleIndexCache::Save(cacheFilePath, fingerprint, compactIndex, wildcardIndex);
+	} else {
+		RuleIndexCache::Save(cacheFilePath, fingerprint, index, wildcardIndex);
+	}
+}
+
+void Rul2Rules::BuildLookupAccelerators()
+{
+	filter.Init(Size() - wildcardIndex.Size());
+	ForEachIndexedRule([this](const cSC4NetworkTileConflictRule& rule) { filter.Add(rule); });
+	lookupCache.Clear();  // before the lookups of BuildSurrogateIndex
+	BuildSurrogateIndex();
+	BuildPreventIndex();
+	statistics = {};  // only count the lookups of actual drags
+	profile.Reset(PositionCount());
+}
+
+Rul2Rules::PreparedLookup Rul2Rules::PrepareLookup(const Tile& a, const Tile& b) const
+{
+	PreparedLookup lookup = {PreparedLookup::RejectedTile, {}, 0};
+	if (filter.MayContainTiles(a, b)) {
+		lookup.form = RuleSymmetry::Canonicalize(a, b);
+		lookup.hash = RuleSymmetry::Hash(lookup.form.key);
+		lookup.stage = filter.MayContainKey(lookup.hash) ? PreparedLookup::Candidate : PreparedLookup::RejectedPair;
+	}
+	return lookup;
+}
+
+// The keys and hashes are computed together, and the memory that the lookups read is prefetched before any of it is needed:
+// first the blocks of the filter, then the home slots of the flat index for the keys that are not in the lookup cache.
+// (The compact index needs to look up the piece IDs before it knows where to look, so it is not prefetched.)
+void Rul2Rules::PrepareTilePairs(const TilePair* pairs, size_t count, PreparedLookup* lookups) const
+{
+	std::array<RuleSymmetry::Key, maxPreparedLookups> keys = {};
+	for (size_t i = 0; i < count; i++) {
+		const Tile a = {pairs[i].cell1->id, absoluteToRelative(pairs[i].cell1->rf, pairs[i].dir)};
+		const Tile b = {pairs[i].cell2->id, absoluteToRelative(pairs[i].cell2->rf, pairs[i].dir)};
+		if (filter.MayContainTiles(a, b)) {
+			lookups[i].stage = PreparedLookup::Candidate;
+			lookups[i].form = RuleSymmetry::Canonicalize(a, b);
+			keys[i] = lookups[i].form.key;
+		} else {
+			lookups[i].stage = PreparedLookup::RejectedTile;
+		}
+	}
+	std::array<uint32_t, maxPreparedLookups> hashes;
+	RuleSymmetry::Hash4(keys, hashes);
+	for (size_t i = 0; i < count; i++) {
+		lookups[i].hash = hashes[i];
+		if (lookups[i].stage == PreparedLookup::Candidate) {
+			filter.PrefetchKey(hashes[i]);
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		if (lookups[i].stage != PreparedLookup::Candidate) {
+			continue;
+		}
+		if (!filter.MayContainKey(hashes[i])) {
+			lookups[i].stage = PreparedLookup::RejectedPair;
+			continue;
+		}
+		if (!useCompactIndex && lookupCache.Find(lookups[i].form.key, hashes[i]) == nullptr) {
+			index.Prefetch(hashes[i]);
+		}
+	}
+}
+
+bool Rul2Rules::FindRule(const PreparedLookup& lookup, RuleSymmetry::RuleOutput& output, uint32_t& position)
+{
+	statistics.lookups++;
+	if (lookup.stage == PreparedLookup::RejectedTile) {
+		statistics.rejectedTile++;
+		return false;
+	} else if (lookup.stage == PreparedLookup::RejectedPair) {
+		statistics.rejectedPair++;
+		return false;
+	}
+	const RuleSymmetry::Key& key = lookup.form.key;
+	const uint32_t hash = lookup.hash;
+
+	if (const RuleLookupCache::Entry* entry = lookupCache.Find(key, hash)) {
+		statistics.cacheHits++;
+		if (!entry->IsFound()) {
+			statistics.missed++;
+			return false;
+		}
+		output = entry->output;
+		position = entry->position;
+		return true;
+	}
+
+	bool found = false;
+	if (useCompactIndex) {
+		found = compactIndex.Find(key, output, position);
+	} else if (const RuleIndex::Slot* slot = index.Find(key, hash)) {
+		output = slot->output;
+		position = static_cast<uint32_t>(slot - index.SlotData());
+		found = true;
+	}
+	if (!found) {
+		statistics.missed++;
+	}
+	if (found) {
+		lookupCache.Insert(key, hash, true, output, position);
+	} else {
+		lookupCache.Insert(key, hash, false, {}, 0);
+	}
+	return found;
+}
+
+// The lookups of a tile next to ID 0 (an immovable occupant or a network lot), which match the wildcard rules in any RotFlip of ID 0.
+// The index stores the orientations with ID 0 as second tile, so the swapped orientations are looked up swapped,
+// and `symmetry` maps the output to the orientation of the lookup. If an equivalent rule of the main index was added
+// before the wildcard rule, that rule wins and the lookup fails.
+bool Rul2Rules::FindWildcardRule(const Tile& a, const Tile& b, RuleSymmetry::Symmetry& symmetry, Tile& t3, Tile& t4, uint32_t& position)
+{
+	symmetry = RuleSymmetry::Identity;
+	uint32_t ordinal;
+	bool found = b.id == 0 && wildcardIndex.Find(a, t3, t4, position, ordinal);
+	if (!found && a.id == 0) {
+		symmetry = RuleSymmetry::SwapRotate180;
+		found = wildcardIndex.Find(RuleSymmetry::Transform(symmetry, a, b).first, t3, t4, position, ordinal);
+	}
+	if (found && wildcardIndex.HasEarlierIndexedRule(RuleSymmetry::Canonicalize(a, b).key, ordinal)) {
+		return false;
+	}
+	if (found) {
+		statistics.lookups++;
+		position += static_cast<uint32_t>(IndexPositionCount());
+	}
+	return found;
+}
+
+Rul2Rules::PatchResult Rul2Rules::PatchTilePair(Rul2Cell& cell1, Rul2Cell& cell2, int8_t dir)
+{
+	uint32_t position;
+	const PatchResult result = ApplyRule(cell1, cell2, dir, position);
+	if (result != NoMatch && profile.IsEnabled()) {
+		profile.Count(position, result == Prevent ? RuleProfile::Prevent : RuleProfile::Direct);
+	}
+	return result;
+}
+
+Rul2Rules::PatchResult Rul2Rules::PatchPreparedTilePair(const PreparedLookup& lookup, Rul2Cell& cell1, Rul2Cell& cell2, int8_t dir)
+{
+	uint32_t position;
+	const PatchResult result = ApplyRule(cell1, cell2, dir, position, &lookup);
+	if (result != NoMatch && profile.IsEnabled()) {
+		profile.Count(position, result == Prevent ? RuleProfile::Prevent : RuleProfile::Direct);
+	}
+	return result;
+}
+
+Rul2Rules::PatchResult Rul2Rules::ApplyRule(Rul2Cell& cell1, Rul2Cell& cell2, int8_t dir, uint32_t& position, const PreparedLookup* prepared)
+{
+	// First we need to convert the absolute rotations of cell1 and cell2 to the relative rotations of RUL2:
+	// dir = 0 (cell2 is west of cell1)
+	// dir = 1 (cell2 is north of cell1)
+	// dir = 2 (cell2 is east of cell1) (this is the case we usually think of when writing RUL2)
+	// dir = 3 (cell2 is south of cell1)
+	const Tile a = {cell1.id, absoluteToRelative(cell1.rf, dir)};
+	const Tile b = {cell2.id, absoluteToRelative(cell2.rf, dir)};
+	RuleSymmetry::Symmetry symmetry;
+	Tile _3, _4;
+	if ((a.id == 0 || b.id == 0) && FindWildcardRule(a, b, symmetry, _3, _4, position)) {
+		// matched a rule with ID 0 as second tile, see WildcardRuleIndex
+	} else {
+		const PreparedLookup lookup = prepared != nullptr ? *prepared : PrepareLookup(a, b);
+		RuleSymmetry::RuleOutput output;
+		if (!FindRule(lookup, output, position)) {
+			return NoMatch;
+		}
+		// The tiles and the rule are both stored relative to their canonical orientation, so the symmetry (R0F0, R2F1, R2F0 or R0F1)
+		// that maps the rule to the tiles follows from the two, and the output is transformed the same way.
+		symmetry = RuleSymmetry::Resolve(lookup.form, output.symmetry);
+		_3 = output._3;
+		_4 = output._4;
+	}
+	if (_3.id == 0) {
+		return Prevent;
+	}
+	const auto [t3, t4] = RuleSymmetry::Transform(symmetry, _3, _4);
+	cell1.id = t3.id; cell1.rf = relativeToAbsolute(t3.rf, dir);
+	cell2.id = t4.id; cell2.rf = relativeToAbsolute(t4.rf, dir);
+	return Matched;
+}
+
+// The lookups of the index build (e.g. of all the rules with a surrogate tile) spread across the whole index,
+// so they mostly miss the CPU caches, which PrepareTilePairs lets overlap.
+void Rul2Rules::ApplyRules(std::vector<std::pair<Rul2Cell, Rul2Cell>>& tilePairs, int8_t dir, std::vector<std::pair<PatchResult, uint32_t>>& results)
+{
+	results.resize(tilePairs.size());
+	std::array<TilePair, maxPreparedLookups> batch;
+	std::array<PreparedLookup, maxPreparedLookups> lookups;
+	for (size_t i = 0; i < tilePairs.size(); i += maxPreparedLookups) {
+		const size_t count = std::min(maxPreparedLookups, tilePairs.size() - i);
+		for (size_t k = 0; k < count; k++) {
+			batch[k] = {&tilePairs[i + k].first, &tilePairs[i + k].second, dir};
+		}
+		PrepareTilePairs(batch.data(), count, lookups.data());
+		for (size_t k = 0; k < count; k++) {
+			auto& [result, position] = results[i + k];
+			result = ApplyRule(tilePairs[i + k].first, tilePairs[i + k].second, dir, position, &lookups[k]);
+		}
+	}
+}
+
+// The first step of the adjacency check only depends on the first tile and the candidate (in relative terms),
+// so we evaluate it once for every first tile for which a rule with a surrogate tile as second tile exists,
+// and TryAdjacencies only visits the candidates that pass it.
+void Rul2Rules::BuildSurrogateIndex()
+{
+	std::vector<std::pair<uint64_t, uint32_t>> candidatesByTile;  // surrogate tile -> candidate
+	for (uint32_t candidate = 0; candidate < candidateCount; candidate++) {
+		const Tile surrogate = candidateSurrogateTile(candidate);
+		candidatesByTile.emplace_back(tileKey(surrogate.id, surrogate.rf), candidate);
+	}
+	std::sort(candidatesByTile.begin(), candidatesByTile.end());
+
+	// collect the first tiles of all rules (in any of the 4 equivalent orientations) that have a surrogate tile as second tile
+	std::vector<std::pair<uint64_t, uint32_t>> pairs;  // first tile -> candidate
+	auto addRule = [&candidatesByTile, &pairs](const cSC4NetworkTileConflictRule& rule) {
+		for (const auto symmetry : {RuleSymmetry::Identity, RuleSymmetry::FlipVertically, RuleSymmetry::SwapRotate180, RuleSymmetry::SwapFlipHorizontally}) {
+			const auto [a, b] = RuleSymmetry::Transform(symmetry, rule._1, rule._2);
+			const uint64_t key = tileKey(b.id, b.rf);
+			auto it = std::lower_bound(candidatesByTile.begin(), candidatesByTile.end(), std::make_pair(key, uint32_t(0)));
+			for (; it != candidatesByTile.end() && it->first == key; ++it) {
+				pairs.emplace_back(tileKey(a.id, a.rf), it->second);
+			}
+		}
+	};
+	ForEachIndexedRule(addRule);
+	wildcardIndex.ForEachRule([&addRule](cSC4NetworkTileConflictRule rule) {
+		for (const auto rf : rotFlipValues) {  // matching ID 0 in any RotFlip
+			rule._2.rf = rf;
+			addRule(rule);
+		}
+	});
+	std::sort(pairs.begin(), pairs.end());
+	pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+	// evaluate the first step (for dir = 2, absolute and relative RotFlips coincide)
+	auto firstCell = [](uint64_t key) { return Rul2Cell{static_cast<uint32_t>(key >> 8), static_cast<RotFlip>(key & 0xff), 0xffffffff}; };
+	std::vector<std::pair<Rul2Cell, Rul2Cell>> tilePairs;
+	tilePairs.reserve(pairs.size());
+	for (const auto& [key, candidate] : pairs) {
+		const Tile surrogate = candidateSurrogateTile(candidate);
+		tilePairs.emplace_back(firstCell(key), Rul2Cell{surrogate.id, surrogate.rf, 0xffffffff});
+	}
+	std::vector<std::pair<PatchResult, uint32_t>> results;
+	ApplyRules(tilePairs, 2, results);
+
+	surrogateIndex.clear();
+	for (size_t i = 0; i < pairs.size(); i++) {
+		const auto& [key, candidate] = pairs[i];
+		const Rul2Cell cell1 = firstCell(key);
+		const auto& [a, b] = tilePairs[i];
+		const auto [result, position] = results[i];
+		if (result == Matched &&
+			a.id == cell1.id && a.rf == cell1.rf &&  // a must remain unchanged for a proper adjacency
+			a.id != b.id)  // a must not be an orthogonal or straight diagonal override network
+		{
+			surrogateIndex.push_back({key, candidate, {b.id, b.rf}, position});
+		}
+	}
+	surrogateIndex.shrink_to_fit();  // already sorted, as the pairs are
+}
+
+// A tile changes only through a match of a rule other than a Prevent rule, or of an adjacency, which is made of such rules.
+// So a tile whose piece ID occurs on the left side of none of these rules keeps its piece ID and RotFlip throughout Rul2Solver.
+// (ID 0 is the exception, but the solver looks up immovable neighbors and network lots with ID 0 whatever they are overridden with.)
+// We keep the Prevent rules whose two tiles are of this kind, as determined by an actual lookup, which resolves
+// equivalent and wildcard rules the same way as PatchTilePair.
+void Rul2Rules::BuildPreventIndex()
+{
+	std::unordered_set<uint32_t> overriddenIds;
+	std::vector<std::pair<Tile, Tile>> candidates;
+	ForEachIndexedRule([&overriddenIds, &candidates](const cSC4NetworkTileConflictRule& rule) {
+		if (rule._3.id != 0) {
+			overriddenIds.insert(rule._1.id);
+			overriddenIds.insert(rule._2.id);
+		} else {
+			candidates.emplace_back(rule._1, rule._2);
+		}
+	});
+	wildcardIndex.ForEachRule([&overriddenIds, &candidates](const cSC4NetworkTileConflictRule& rule) {
+		if (rule._3.id != 0) {
+			overriddenIds.insert(rule._1.id);
+		} else {
+			for (const auto rf : rotFlipValues) {  // matching ID 0 in any RotFlip
+				candidates.emplace_back(rule._1, Tile{0, rf});
+			}
+		}
+	});
+
+	candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&overriddenIds](const std::pair<Tile, Tile>& candidate) {
+		const auto& [a, b] = candidate;
+		return (a.id == 0 && b.id == 0) || overriddenIds.count(a.id) != 0 || overriddenIds.count(b.id) != 0;
+	}), candidates.end());
+	std::vector<std::pair<Rul2Cell, Rul2Cell>> tilePairs;
+	tilePairs.reserve(candidates.size());
+	for (const auto& [a, b] : candidates) {
+		// for dir = 2, absolute and relative RotFlips coincide
+		tilePairs.emplace_back(Rul2Cell{a.id, a.rf, 0xffffffff}, Rul2Cell{b.id, b.rf, 0xffffffff});
+	}
+	std::vector<std::pair<PatchResult, uint32_t>> results;
+	ApplyRules(tilePairs, 2, results);
+
+	guaranteedPrevents.clear();
+	for (size_t i = 0; i < candidates.size(); i++) {
+		const auto& [a, b] = candidates[i];
+		if (results[i].first == Prevent) {
+			guaranteedPrevents.push_back({RuleSymmetry::Canonicalize(a, b).key, results[i].second});
+		}
+	}
+	std::sort(guaranteedPrevents.begin(), guaranteedPrevents.end());
+	guaranteedPrevents.erase(std::unique(guaranteedPrevents.begin(), guaranteedPrevents.end(),
+			[](const GuaranteedPrevent& p, const GuaranteedPrevent& q) { return p.key == q.key; }), guaranteedPrevents.end());
+	guaranteedPrevents.shrink_to_fit();
+
+	preventFilter.Init(guaranteedPrevents.size());
+	for (const GuaranteedPrevent& prevent : guaranteedPrevents) {
+		preventFilter.Add({prevent.key.Tile1(), prevent.key.Tile2(), {0, R0F0}, {0, R0F0}});
+	}
+}
+
+bool Rul2Rules::MatchesGuaranteedPrevent(const Rul2Cell& cell1, const Rul2Cell& cell2, int8_t dir)
+{
+	const Tile a = {cell1.id, absoluteToRelative(cell1.rf, dir)};
+	const Tile b = {cell2.id, absoluteToRelative(cell2.rf, dir)};
+	if (!preventFilter.MayContainTiles(a, b)) {
+		return false;
+	}
+	const GuaranteedPrevent prevent = {RuleSymmetry::Canonicalize(a, b).key, 0};
+	if (!preventFilter.MayContainKey(RuleSymmetry::Hash(prevent.key))) {
+		return false;
+	}
+	const auto it = std::lower_bound(guaranteedPrevents.begin(), guaranteedPrevents.end(), prevent);
+	if (it == guaranteedPrevents.end() || !(it->key == prevent.key)) {
+		return false;
+	}
+	statistics.guaranteedPrevents++;
+	if (profile.IsEnabled()) {
+		profile.Count(it->position, RuleProfile::Prevent);
+	}
+	return true;
+}
+
+// Try to find a surrogate tile that fits between the two tiles with two suitable override rules.
+// The override is then applied from the first to the last tile.
+// This avoids the need for direct adjacencies between the two tiles.
+// For diagonals, this employs two surrogate tiles instead of one.
+Rul2Rules::PatchResult Rul2Rules::TryAdjacencies(Rul2Cell& cell1, Rul2Cell& cell2, int8_t dir)
+{
+	// The first step (an override of cell1 and a surrogate tile in direction `dir`) has been evaluated in advance, see BuildSurrogateIndex.
+	const uint64_t key = tileKey(cell1.id, absoluteToRelative(cell1.rf, dir));
+	const auto range = std::equal_range(surrogateIndex.begin(), surrogateIndex.end(), SurrogateCandidate{key, 0, {}, 0},
+			[](const SurrogateCandidate& p, const SurrogateCandidate& q) { return p.key < q.key; });
+	if (range.first == range.second) {
+		statistics.skippedAdjacencySearches++;
+		return NoMatch;
+	}
+
+	for (auto it = range.first; it != range.second; ++it) {
+		NAM_RUL2_COUNT(surrogateProbes);
+		const Rul2Cell a = cell1;  // remains unchanged by the first step
+		const Rul2Cell bBackup = {it->surrogate.id, relativeToAbsolute(it->surrogate.rf, dir), 0xffffffff};
+		Rul2Cell b = bBackup;
+
+		if (it->candidate < orthogonalCandidateCount) {
+			Rul2Cell c = cell2;
+
+			uint32_t position;
+			PatchResult result = ApplyRule(b, c, dir, position);
+			if (result != Matched ||
+				b.id != bBackup.id || b.rf != bBackup.rf ||  //  b must remain unchanged (in 2nd override) for a proper adjacency
+				b.id == c.id ||  // c must not be an orthogonal override network
+				(c.id == cell2.id && c.rf == cell2.rf)) {  // c must change (in 2nd override) for a proper adjacency
+				continue;  // next surrogate tile
+			}
+
+			if (profile.IsEnabled()) {
+				profile.Count(it->position, RuleProfile::Adjacency);
+				profile.Count(position, RuleProfile::Adjacency);
+			}
+			cell1 = a;
+			cell2 = c;
+			return Matched;
+		} else {
+			const auto& surrogatePair = diagonalSurrogateTiles[(it->candidate - orthogonalCandidateCount) / 2];
+			const bool southBound = (it->candidate & 1) == 0;
+			Rul2Cell c = {surrogatePair.second.id, relativeToAbsolute(surrogatePair.second.rf, southBound ? dir : dir+1), 0xffffffff};
+			Rul2Cell d = cell2;
+
+			// Assuming dir == 2, then c is south of b if southBound (dir+1) or north of b if northBound (dir-1).
+			uint32_t position2;
+			PatchResult result = ApplyRule(b, c, (dir + (southBound ? 1 : -1)) & 3, position2);
+			if (result != Matched ||
+				b.id != bBackup.id || b.rf != bBackup.rf ||  // b must remain unchanged (in 2nd override) for a proper adjacency
+				(c.id == cell1.id && c.rf == cell1.rf)) {  // otherwise we haven't gone anywhere
+				continue;
+			}
+			Rul2Cell cBackup = c;
+
+			uint32_t position3;
+			result = ApplyRule(c, d, dir, position3);
+			if (result != Matched ||
+				c.id != cBackup.id || c.rf != cBackup.rf ||  // c must remain unchanged (in 3rd override) for a proper adjacency
+				c.id == d.id || b.id == d.id ||  // d must not be a pure diagonal
+				(d.id == cell2.id && d.rf == cell2.rf)) {  // d must change (in 3rd override) for a proper adjacency
+				continue;
+			}
+
+			if (profile.IsEnabled()) {
+				profile.Count(it->position, RuleProfile::Adjacency);
+				profile.Count(position2, RuleProfile::Adjacency);
+				profile.Count(position3, RuleProfile::Adjacency);
+			}
+			cell1 = a;
+			cell2 = d;
+			return Matched;
+		}
+	}
+
+	return NoMatch;
+}
+
+void Rul2Rules::WriteRuleProfile(std::ostream& out, size_t topCount) const
+{
+	std::vector<std::pair<uint32_t, cSC4NetworkTileConflictRule>> hit;
+	std::vector<std::pair<uint32_t, cSC4NetworkTileConflictRule>> neverHit;
+	if (profile.PositionCount() == PositionCount()) {  // otherwise profiling was not enabled for the current index
+		auto addRule = [this, &hit, &neverHit](size_t position, const cSC4NetworkTileConflictRule& rule) {
+			(profile.At(position).Total() > 0 ? hit : neverHit).emplace_back(static_cast<uint32_t>(position), rule);
+		};
+		if (useCompactIndex) {
+			compactIndex.ForEachRuleWithPosition(addRule);
+		} else {
+			index.ForEachRuleWithPosition(addRule);
+		}
+		wildcardIndex.ForEachRuleWithPosition([this, &addRule](size_t position, const cSC4NetworkTileConflictRule& rule) {
+			addRule(IndexPositionCount() + position, rule);
+		});
+	}
+	topCount = std::min(topCount, hit.size());
+	std::partial_sort(hit.begin(), hit.begin() + topCount, hit.end(), [this](const auto& p, const auto& q) {
+		const uint64_t totalP = profile.At(p.first).Total();
+		const uint64_t totalQ = profile.At(q.first).Total();
+		return totalP > totalQ || (totalP == totalQ && p.first < q.first);
+	});
+
+	out << "list,direct,adjacency,prevent,rule\n";
+	auto writeRule = [this, &out](const char* list, uint32_t position, const cSC4NetworkTileConflictRule& rule) {
+		const RuleProfile::Counters& counters = profile.At(position);
+		out << list << ',' << counters.hits[RuleProfile::Direct] << ',' << counters.hits[RuleProfile::Adjacency] << ',' << counters.hits[RuleProfile::Prevent]
+			<< ",\"" << FormatRule(rule) << "\"\n";
+	};
+	for (size_t i = 0; i < topCount; i++) {
+		writeRule("top", hit[i].first, hit[i].second);
+	}
+	for (const auto& [position, rule] : neverHit) {
+		writeRule("never", position, rule);
+	}
+}
@@ -0,0 +1,220 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include "Rul2World.h"
+#include "RuleIndex.h"
+#include "CompactRuleIndex.h"
+#include "RuleFilter.h"
+#include "RuleIndexCache.h"
+#include "RuleLookupCache.h"
+#include "RuleProfile.h"
+#include "RuleStagingBuffer.h"
+#include "RuleSymmetry.h"
+#include "WildcardRuleIndex.h"
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// The RUL2 override rules and the lookups of the RUL2 engine, independent of the game.
+//
+// The rules are collected while the game loads the RUL2 files and are then inserted into the index in bulk,
+// either the flat RuleIndex or the CompactRuleIndex, except for the rules with ID 0 as second tile,
+// which go into a small WildcardRuleIndex checked only for lookups involving ID 0. On top of the index,
+// a RuleFilter rejects most lookups of tile pairs without any rule, a RuleLookupCache answers the repeated
+// lookups of a drag, and a precomputed surrogate index speeds up TryAdjacencies.
+// The Prevent rules that the solver is bound to hit get a filter and an index of their own, see MatchesGuaranteedPrevent.
+class Rul2Rules
+{
+public:
+	enum PatchResult : uint32_t { NoMatch, Matched, Prevent };  // as returned by the game's PatchTilePair
+
+	// Counts the rule lookups since the statistics were last reset.
+	struct LookupStatistics
+	{
+		uint64_t lookups = 0;
+		uint64_t rejectedTile = 0;  // by RuleFilter without any hashing
+		uint64_t rejectedPair = 0;  // by RuleFilter
+		uint64_t cacheHits = 0;  // passed RuleFilter and answered by RuleLookupCache (found or not)
+		uint64_t missed = 0;  // passed RuleFilter, but not found in the index
+		uint64_t skippedAdjacencySearches = 0;  // as no surrogate candidate exists for the first tile
+		uint64_t guaranteedPrevents = 0;  // found by MatchesGuaranteedPrevent
+	};
+
+	// A tile pair to look up, as passed to PatchTilePair.
+	struct TilePair
+	{
+		const Rul2Cell* cell1;
+		const Rul2Cell* cell2;
+		int8_t dir;
+	};
+
+	// The lookup of a tile pair in the main index, as far as it gets without reading the index.
+	struct PreparedLookup
+	{
+		enum Stage : uint8_t { RejectedTile, RejectedPair, Candidate };
+
+		Stage stage;
+		RuleSymmetry::CanonicalForm form;
+		uint32_t hash;  // of the canonical key
+	};
+	static constexpr size_t maxPreparedLookups = 4;
+
+	// The rules queued since the last build, together with the fingerprint of all the rules queued so far.
+	struct PendingRules
+	{
+		RuleStagingBuffer rules;
+		std::vector<WildcardRuleIndex::OrderedRule> wildcardRules;  // with ID 0 as second tile, or as first tile only (see WildcardRuleIndex)
+		RuleIndexCache::Fingerprint fingerprint;
+	};
+
+	// Queues a rule as parsed from a RUL2 file. Rules with ID 0 as second tile match that tile in any RotFlip.
+	void AddRule(const cSC4NetworkTileConflictRule& rule);
+	bool HasPendingRules() const { return !pendingRules.rules.Empty() || !pendingRules.wildcardRules.empty(); }
+
+	// Takes over the queued rules, so that they can be built on another thread by Build(PendingRules&, uint32_t)
+	// while new rules are queued on this one. The fingerprint keeps accumulating.
+	PendingRules TakePendingRules();
+
+	// Whether to use CompactRuleIndex rather than RuleIndex. Takes effect with the next Build or LoadCache.
+	void SetUseCompactIndex(bool useCompactIndex) { this->useCompactIndex = useCompactIndex; }
+	bool UsesCompactIndex() const { return useCompactIndex; }
+
+	// Replaces the index by the one in the cache file if it matches the queued rules, and discards the queued rules.
+	// Returns false if the cache file does not exist or is outdated. Throws if the file cannot be read.
+	bool LoadCache(const std::filesystem::path& cacheFilePath);
+
+	// Loads the index from a cache file of the rules with the given fingerprint, without the rules themselves,
+	// e.g. for replaying a trace (see Rul2Trace).
+	bool LoadCache(const std::filesystem::path& cacheFilePath, const RuleIndexCache::Fingerprint& fingerprint);
+
+	// Inserts the queued rules into the index. If the rules do not fit into the compact index,
+	// this switches to the regular index (see UsesCompactIndex).
+	void Build();
+
+	// Inserts rules taken by TakePendingRules into the index, using up to `threadCount` threads.
+	// This does not touch the queued rules, so AddRule may be called concurrently, but nothing else.
+	void Build(PendingRules& rules, uint32_t threadCount);
+
+	// Throws if the file cannot be written.
+	void SaveCache(const std::filesystem::path& cacheFilePath) const;
+
+	// Looks up an override rule matching the two tiles and applies it if it exists.
+	// `dir` is the direction from cell1 to cell2 (0 = west, 1 = north, 2 = east, 3 = south).
+	PatchResult PatchTilePair(Rul2Cell& cell1, Rul2Cell& cell2, int8_t dir);
+
+	// Prepares the lookups of up to 4 tile pairs at once: computes their canonical keys and hashes (see RuleSymmetry::Hash4),
+	// checks them against the filter and prefetches the index slots that the remaining lookups read, so that resolving them
+	// one by one with PatchPreparedTilePair does not wait for the memory of each in turn. This pays off for lookups that miss
+	// the CPU caches, such as those of BuildSurrogateIndex and BuildPreventIndex. Rul2Solver does not use it: RuleLookupCache
+	// answers most of its lookups, and preparing the 4 neighbors of every cell made its frames slower.
+	// The lookups are only counted when they are resolved.
+	void PrepareTilePairs(const TilePair* pairs, size_t count, PreparedLookup* lookups) const;
+
+	// Like PatchTilePair, for a tile pair prepared by PrepareTilePairs, whose tiles must not have changed since.
+	PatchResult PatchPreparedTilePair(const PreparedLookup& lookup, Rul2Cell& cell1, Rul2Cell& cell2, int8_t dir);
+
+	// Tries to find surrogate tiles that fit between the two tiles with suitable override rules, and applies them if they exist.
+	PatchResult TryAdjacencies(Rul2Cell& cell1, Rul2Cell& cell2, int8_t dir);
+
+	// Checks whether the two tiles match a Prevent rule whose piece IDs no other rule overrides (ID 0 standing for an immovable
+	// neighbor or a network lot). Such tiles never change, so Rul2Solver is bound to hit the Prevent rule once it examines them,
+	// and can report a red drag right away. Counts the match like PatchTilePair.
+	bool MatchesGuaranteedPrevent(const Rul2Cell& cell1, const Rul2Cell& cell2, int8_t dir);
+	bool HasGuaranteedPrevents() const { return !guaranteedPrevents.empty(); }
+	size_t GuaranteedPreventCount() const { return guaranteedPrevents.size(); }
+
+	// The piece IDs of the surrogate tiles of TryAdjacencies, which fit between two cells without being built by the game.
+	static std::vector<uint32_t> SurrogateTileIds();
+
+	// Formats a rule as a line of a RUL2 file with the prefixes 1 and 2, for the logs.
+	static std::string FormatRule(const cSC4NetworkTileConflictRule& rule);
+
+	// Whether to count the matches of each rule in PatchTilePair and TryAdjacencies (see RuleProfile).
+	// Takes effect with the next Build or LoadCache.
+	void SetRuleProfiling(bool enabled) { profile.SetEnabled(enabled); }
+	const RuleProfile& Profile() const { return profile; }
+
+	// Writes the `topCount` most matched rules and the rules that have never matched as CSV,
+	// with the columns list ("top" or "never"), direct, adjacency, prevent and rule.
+	void WriteRuleProfile(std::ostream& out, size_t topCount) const;
+
+	template <typename F>
+	void ForEachRule(F&& f) const
+	{
+		ForEachIndexedRule(f);
+		wildcardIndex.ForEachRule(f);
+	}
+
+	size_t Size() const { return (useCompactIndex ? compactIndex.Size() : index.Size()) + wildcardIndex.Size(); }
+	size_t IndexMemoryUsage() const { return (useCompactIndex ? compactIndex.MemoryUsage() : index.MemoryUsage()) + wildcardIndex.MemoryUsage(); }
+	const RuleIndex& Index() const { return index; }
+	const CompactRuleIndex& CompactIndex() const { return compactIndex; }
+	const WildcardRuleIndex& WildcardIndex() const { return wildcardIndex; }
+	const RuleFilter& Filter() const { return filter; }
+	size_t SurrogateCandidateCount() const { return surrogateIndex.size(); }
+	const RuleIndexCache::Fingerprint& Fingerprint() const { return fingerprint; }
+
+	LookupStatistics& Statistics() { return statistics; }
+
+private:
+	// A surrogate candidate that passes the first step of the adjacency check for a given first tile,
+	// together with the overridden surrogate tile (relative to the direction of the search).
+	struct SurrogateCandidate
+	{
+		uint64_t key;  // first tile (relative to the direction of the search)
+		uint32_t candidate;
+		Tile surrogate;
+		uint32_t position;  // of the rule overriding the first tile and the surrogate tile, for RuleProfile
+
+		bool operator<(const SurrogateCandidate& other) const { return key < other.key || (key == other.key && candidate < other.candidate); }
+	};
+
+	// The canonical left side of a Prevent rule whose piece IDs no other rule overrides, see MatchesGuaranteedPrevent.
+	struct GuaranteedPrevent
+	{
+		RuleSymmetry::Key key;
+		uint32_t position;  // of the Prevent rule, for RuleProfile
+
+		bool operator<(const GuaranteedPrevent& other) const { return key.ids < other.key.ids || (key.ids == other.key.ids && key.rotFlips < other.key.rotFlips); }
+	};
+
+	// the rules of the main index, without the wildcard rules
+	template <typename F>
+	void ForEachIndexedRule(F&& f) const
+	{
+		if (useCompactIndex) {
+			compactIndex.ForEachRule(f);
+		} else {
+			index.ForEachRule(f);
+		}
+	}
+
+	void BuildLookupAccelerators();
+	void BuildSurrogateIndex();
+	void BuildPreventIndex();
+	PreparedLookup PrepareLookup(const Tile& a, const Tile& b) const;
+	bool FindRule(const PreparedLookup& lookup, RuleSymmetry::RuleOutput& output, uint32_t& position);
+	bool FindWildcardRule(const Tile& a, const Tile& b, RuleSymmetry::Symmetry& symmetry, Tile& t3, Tile& t4, uint32_t& position);
+	// PatchTilePair without profiling, for a tile pair optionally prepared by PrepareTilePairs
+	PatchResult ApplyRule(Rul2Cell& cell1, Rul2Cell& cell2, int8_t dir, uint32_t& position, const PreparedLookup* prepared = nullptr);
+	// ApplyRule for many independent tile pairs in the same direction, overriding them in place, with the lookups prepared in batches
+	void ApplyRules(std::vector<std::pair<Rul2Cell, Rul2Cell>>& tilePairs, int8_t dir, std::vector<std::pair<PatchResult, uint32_t>>& results);
+	// the positions of the main index, followed by those of the wildcard rules
+	size_t IndexPositionCount() const { return useCompactIndex ? compactIndex.Size() : index.Capacity(); }
+	size_t PositionCount() const { return IndexPositionCount() + wildcardIndex.Size(); }
+
+	PendingRules pendingRules;
+	RuleIndexCache::Fingerprint fingerprint;  // of the rules in the index
+	bool useCompactIndex = false;
+	RuleIndex index;
+	CompactRuleIndex compactIndex;
+	WildcardRuleIndex wildcardIndex;
+	RuleFilter filter;
+	std::vector<SurrogateCandidate> surrogateIndex;  // sorted by key and candidate
+	RuleFilter preventFilter;  // of the guaranteed Prevents
+	std::vector<GuaranteedPrevent> guaranteedPrevents;  // sorted by key
+	LookupStatistics statistics;
+	RuleProfile profile;
+	RuleLookupCache lookupCache;
+};
@@ -0,0 +1,557 @@
+#include "Rul2Solver.h"
+#include "Rul2Instrumentation.h"
+#include <algorithm>
+#include <bit>
+#include <span>
+
+namespace
+{
+	constexpr int32_t kNextX[] = {-1, 0, 1, 0};
+	constexpr int32_t kNextZ[] = {0, -1, 0, 1};
+
+	constexpr uint32_t neighborXZ(uint32_t xz, uint32_t dir)
+	{
+		uint32_t z = xz >> 16;
+		uint32_t x = xz & 0xffff;
+		return (kNextZ[dir] + z) * 0x10000 + (kNextX[dir] + x);
+	}
+
+	constexpr bool isSameCell(const Rul2Cell& a, const Rul2Cell& b)
+	{
+		return a.xz == b.xz && a.id == b.id && a.rf == b.rf;
+	}
+
+	// compares everything except for the index in the cells buffer, which is not part of the world as such
+	constexpr bool isSameWorldCell(const Rul2WorldCell& a, const Rul2WorldCell& b)
+	{
+		return a.hasOccupant == b.hasOccupant && a.id == b.id && a.rf == b.rf && a.isImmovable == b.isImmovable && a.isNetworkLot == b.isNetworkLot;
+	}
+
+	// the slot of cellsByXZ where the probing for xz starts, from the high bits of the hash
+	constexpr size_t cellSlot(uint32_t xz, uint32_t shift)
+	{
+		return static_cast<size_t>((xz * 0x9e3779b1u) >> shift);
+	}
+
+	uint64_t hashCells(const std::vector<Rul2Cell>& cells)
+	{
+		uint64_t hash = 0xcbf29ce484222325;  // FNV-1a
+		for (const Rul2Cell& cell : cells) {
+			for (const uint32_t value : {cell.id, static_cast<uint32_t>(cell.rf), cell.xz}) {
+				hash = (hash ^ value) * 0x100000001b3;
+			}
+		}
+		return hash;
+	}
+
+	template <typename NeighborSnapshot>
+	bool isSameNeighborhood(Rul2World& world, const NeighborSnapshot* begin, const NeighborSnapshot* end)
+	{
+		for (const NeighborSnapshot& neighbor : std::span(begin, end)) {
+			Rul2WorldCell cell;
+			const bool hasCell = world.GetCell(neighbor.xz, cell);
+			if (hasCell != neighbor.hasCell || (hasCell && !isSameWorldCell(cell, neighbor.cell))) {
+				return false;  // e.g. a network was built or bulldozed in the meantime
+			}
+		}
+		return true;
+	}
+}
+
+void Rul2Solver::IndexCells(const std::vector<Rul2Cell>& cells)
+{
+	const uint32_t capacity = std::bit_ceil(static_cast<uint32_t>(std::max<size_t>(4 * cells.size(), 64)));  // room for appended neighbors
+	cellsByXZ.assign(capacity, 0);
+	cellsByXZShift = 32 - std::countr_zero(capacity);
+	cellsByXZCount = 0;
+	for (uint32_t i = 0; i < cells.size(); i++) {
+		IndexCell(cells[i].xz, i);
+	}
+}
+
+void Rul2Solver::IndexCell(uint32_t xz, uint32_t idx)
+{
+	if (2 * (cellsByXZCount + 1) > cellsByXZ.size()) {  // grow, which is rare, as the cells start at most a quarter full
+		std::vector<uint64_t> entries;
+		entries.swap(cellsByXZ);
+		cellsByXZ.assign(2 * entries.size(), 0);
+		cellsByXZShift--;
+		cellsByXZCount = 0;
+		for (const uint64_t entry : entries) {
+			if (entry != 0) {
+				IndexCell(static_cast<uint32_t>(entry >> 32), static_cast<uint32_t>(entry) - 1);
+			}
+		}
+	}
+	cellsByXZCount++;
+	const size_t mask = cellsByXZ.size() - 1;
+	size_t i = cellSlot(xz, cellsByXZShift);
+	while (cellsByXZ[i] != 0) {
+		i = (i + 1) & mask;
+	}
+	cellsByXZ[i] = (uint64_t(xz) << 32) | (idx + 1);
+}
+
+// Marks the cells at xz and at its 4 neighbors for re-examination, as they read the tile at xz.
+void Rul2Solver::MarkDirtyAround(uint32_t xz)
+{
+	const size_t mask = cellsByXZ.size() - 1;
+	for (uint32_t dir = 0; dir <= 4; dir++) {
+		const uint32_t key = dir < 4 ? neighborXZ(xz, dir) : xz;
+		for (size_t i = cellSlot(key, cellsByXZShift); cellsByXZ[i] != 0; i = (i + 1) & mask) {
+			if ((cellsByXZ[i] >> 32) == key) {
+				uint8_t& dirty = dirtyCells[static_cast<uint32_t>(cellsByXZ[i]) - 1];
+				dirtyCount += 1 - dirty;
+				dirty = 1;
+			}
+		}
+	}
+}
+
+uint32_t Rul2Solver::NextDirtyCell(uint32_t start) const
+{
+	return static_cast<uint32_t>(std::find(dirtyCells.begin() + start, dirtyCells.end(), 1) - dirtyCells.begin());
+}
+
+void Rul2Solver::RestoreConsistentState(Rul2World& world, std::vector<Rul2Cell>& cells)
+{
+	for (auto it = undoLog.rbegin(); it != undoLog.rend(); ++it) {
+		cells[it->first] = it->second;
+	}
+	for (size_t i = cells.size(); i-- > consistentSize; ) {
+		world.SetCellsBufferIndex(cells[i].xz, appendedWorldIndices[i - consistentSize]);
+	}
+	cells.resize(consistentSize);
+}
+
+// Examines the dirty cells in order, overriding tile pairs until no more matches are found.
+// Instead of rescanning all cells after any match, we only re-examine the cells whose own tile or a neighbor's tile
+// has changed since they were last examined without a match. Examining any other cell would not find a match again,
+// so the sequence of matches (and hence the result) is the same as when rescanning all cells in order.
+// The deadline is checked every timeCheckInterval examined cells, so that reading the clock does not slow down the evaluation.
+// With a deadline, the changes since the last consistent state are recorded, see SetTimeBudget. In the first pass, the cells
+// not reached yet are all dirty, so the state is consistent when these are the only dirty cells, between two examined cells.
+// The first pass over the cells saves the checkpoint when it reaches checkpointIdx, see ResumeLastFrame.
+Rul2Solver::Outcome Rul2Solver::SolveDirtyCells(Rul2World& world, std::vector<Rul2Cell>& cells, int32_t maxMatches, Progress progress, std::chrono::steady_clock::time_point deadline)
+{
+	uint32_t idx = progress.idx;
+	if (idx == cells.size()) {
+		return Solved;  // nothing has changed
+	}
+	int32_t matchCount = progress.matchCount;
+	bool foundMatch = progress.foundMatch;
+	bool isFirstPass = true;
+	uint32_t examinedCells = 0;
+	const bool hasDeadline = deadline != std::chrono::steady_clock::time_point::max();
+	dirtyCount = static_cast<uint32_t>(std::count(dirtyCells.begin(), dirtyCells.end(), 1));
+
+	int32_t countPatchesCurrentCell = 0;
+	while (true) {
+mainLoop:
+		if (hasDeadline && ++examinedCells % timeCheckInterval == 0 && std::chrono::steady_clock::now() >= deadline) {
+			RestoreConsistentState(world, cells);
+			return TimeBudgetExceeded;
+		}
+		if (hasDeadline && isFirstPass && countPatchesCurrentCell == 0 && dirtyCount == cells.size() - idx) {
+			undoLog.clear();
+			appendedWorldIndices.clear();
+			consistentSize = static_cast<uint32_t>(cells.size());
+		}
+		if (idx == checkpointIdx && isFirstPass && countPatchesCurrentCell == 0 && checkpointIdx != 0) {
+			SaveCheckpoint(cells, {idx, matchCount, foundMatch});
+		}
+		// Well-foundedness: Either countPatchesCurrentCell is incremented, or it's reset to 0 but idx is incremented, or idx is reset to the start but foundMatch was true, so matchCount was incremented.
+		// Hence, the triple (matchCount, idx, countPatchesCurrentCell) is strictly increasing, with matchCount and countPatchesCurrentCell being bounded by constants.
+		// The only termination problem can arise when the cells grow without bounds, for some reason, so we bound them by maxCellsBufferSize.
+		if (countPatchesCurrentCell <= maxRepetitions) {
+			Rul2Cell* cell = cells.data() + idx;
+			for (uint32_t dir = 0; dir < 4; dir++) {
+				const uint32_t nextCellXZ = neighborXZ(cell->xz, dir);
+
+				Rul2WorldCell cell2Info;
+				if (!world.GetCell(nextCellXZ, cell2Info)) {
+					continue;  // next direction
+				}
+
+				Rul2Cell temp;
+				Rul2Cell* cell2 = nullptr;
+				bool isCell2StackLocal = false;
+
+				if (cell2Info.idxInCellsBuffer < 0) {
+					if (!cell2Info.hasOccupant) {
+						continue;  // next direction
+					}
+					cell2 = &temp;
+					temp.xz = nextCellXZ;
+					temp.id = cell2Info.id;
+					temp.rf = cell2Info.rf;
+					isCell2StackLocal = true;
+				} else {
+					cell2 = cells.data() + cell2Info.idxInCellsBuffer;
+				}
+				// now cell2 is not nullptr
+
+				if (cell2Info.isImmovable || cell2Info.isNetworkLot) {
+					if (!isCell2StackLocal) {
+						temp = *cell2;
+						cell2 = &temp;
+					}
+					temp.id = 0;
+					isCell2StackLocal = true;
+				}
+
+				const Rul2Cell previousCell = *cell;
+				const Rul2Cell previousCell2 = *cell2;
+				Rul2Rules::PatchResult patchResult = rules.PatchTilePair(*cell, *cell2, dir);
+				NAM_RUL2_COUNT(lookups);
+
+				if (patchResult == Rul2Rules::NoMatch) {
+					patchResult = rules.TryAdjacencies(*cell, *cell2, dir);  // cell -> surrogate -> cell2
+					NAM_RUL2_COUNT(adjacencySearches);
+					if (patchResult != Rul2Rules::Matched) {  // potential Prevents from adjacencies are discarded
+						if (isCell2StackLocal) {  // otherwise, cell2 is queued in buffer, so we will eventually process it from cell2's point of view anyway
+							patchResult = rules.TryAdjacencies(*cell2, *cell, (dir - 2) & 3);  // cell2 -> surrogate -> cell
+							NAM_RUL2_COUNT(adjacencySearches);
+						}
+						if (patchResult != Rul2Rules::Matched) {
+							continue;  // next direction
+						}
+					}
+				}
+
+				if (patchResult == Rul2Rules::Prevent) {
+					NAM_RUL2_COUNT(prevents);
+					return Prevented;
+				}
+				// Matched and no Prevent
+				NAM_RUL2_COUNT(hits);
+
+				matchCount++;
+				NAM_RUL2_RECORD(remainingMatches, maxMatches - matchCount);
+				if (matchCount > maxMatches) {
+					return TooManyMatches;
+				}
+
+				foundMatch = true;
+
+				if (hasDeadline) {
+					undoLog.emplace_back(idx, previousCell);
+					if (!isCell2StackLocal) {
+						undoLog.emplace_back(cell2Info.idxInCellsBuffer, previousCell2);
+					}
+				}
+				const uint32_t cellXZ = cell->xz;
+				if (isCell2StackLocal) {  // cell is not in buffer
+					uint32_t idx2 = cells.size();
+					if (idx2 >= maxCellsBufferSize) {  // safe-guard to ensure termination
+						return TooManyCells;  // (Ignoring the neighbor would also be an option. It would result in random unstable overrides.)
+					}
+					if (hasDeadline) {
+						appendedWorldIndices.push_back(cell2Info.idxInCellsBuffer);
+					}
+					world.SetCellsBufferIndex(nextCellXZ, idx2);
+					cells.push_back(*cell2);  // might reallocate the cells, so `cell` is retrieved again at mainLoop
+					dirtyCells.push_back(1);
+					dirtyCount++;
+					IndexCell(nextCellXZ, idx2);
+				}
+				MarkDirtyAround(cellXZ);
+				MarkDirtyAround(nextCellXZ);
+
+				countPatchesCurrentCell++;
+				goto mainLoop;
+			}
+			dirtyCells[idx] = 0;  // no match in any direction
+			dirtyCount--;
+		}
+
+		idx = NextDirtyCell(idx + 1);
+		countPatchesCurrentCell = 0;
+		if (idx != cells.size()) {  // if not reached end
+			continue;  // main loop
+		} else if (foundMatch) {  // reached end, but also foundMatch, so continue until all cells remain unchanged
+			idx = NextDirtyCell(0);
+			foundMatch = false;
+			isFirstPass = false;
+			NAM_RUL2_COUNT(restarts);
+			if (idx != cells.size()) {
+				continue;  // main loop
+			} else {
+				return Solved;  // all cells remain unchanged
+			}
+		} else {
+			return Solved;
+		}
+	}
+}
+
+void Rul2Solver::SnapshotNeighbors(Rul2World& world, const std::vector<Rul2Cell>& cells, std::vector<SolvedFrame::NeighborSnapshot>& neighbors)
+{
+	neighbors.clear();
+	for (const Rul2Cell& cell : cells) {
+		for (uint32_t dir = 0; dir <= 4; dir++) {
+			SolvedFrame::NeighborSnapshot neighbor = {dir < 4 ? neighborXZ(cell.xz, dir) : cell.xz, false, {}};
+			neighbor.hasCell = world.GetCell(neighbor.xz, neighbor.cell);
+			neighbors.push_back(neighbor);
+		}
+	}
+}
+
+void Rul2Solver::SaveCheckpoint(const std::vector<Rul2Cell>& cells, const Progress& progress)
+{
+	checkpoint.idx = progress.idx;
+	checkpoint.matchCount = progress.matchCount;
+	checkpoint.foundMatch = progress.foundMatch;
+	checkpoint.cells = cells;
+	checkpoint.dirtyCells = dirtyCells;
+}
+
+// Prepares the cells and the dirty cells to continue from the checkpoint of the last frame, if the cells passed by the game share a prefix
+// with those of the last frame that includes the checkpoint. The cells after the common prefix of both frames (old and new) are considered changed.
+// Up to the checkpoint, the first pass of a full evaluation of the new cells examines the same cells as in the last frame, in the same order.
+// Unless one of them is next to a changed cell, or the world cells at or next to them have changed, these cells read the same tiles as
+// in the last frame, so they find the same matches and override the same cells (none of them changed), and the evaluation reaches
+// the same state at the checkpoint. Continuing from there gives exactly the result of the full evaluation, including the order of
+// the appended neighbors and the outcome.
+// Returns false if a full evaluation is needed, leaving the cells untouched in that case.
+bool Rul2Solver::ResumeLastFrame(Rul2World& world, std::vector<Rul2Cell>& cells, int32_t maxMatches, Progress& progress)
+{
+	if (lastFrame == nullptr || lastFrame->checkpoint.idx == 0) {
+		return false;
+	}
+	const SolvedFrame& last = *lastFrame;
+	const SolvedFrame::Checkpoint& saved = last.checkpoint;
+	const size_t n = cells.size();
+	const size_t m = last.input.size();
+	size_t prefix = 0;
+	while (prefix < n && prefix < m && isSameCell(cells[prefix], last.input[prefix])) {
+		prefix++;
+	}
+	if (prefix < saved.idx || n == saved.idx) {
+		return false;  // a cell examined before the checkpoint has changed, or the checkpoint is the end of the cells
+	}
+	const size_t appendedCount = saved.cells.size() - m;
+	if (saved.matchCount > maxMatches || n + appendedCount > maxCellsBufferSize) {
+		return false;  // the full evaluation gives up before the checkpoint
+	}
+
+	changedXZ.clear();
+	for (size_t i = prefix; i < m; i++) {
+		changedXZ.push_back(last.input[i].xz);
+	}
+	for (size_t i = prefix; i < n; i++) {
+		changedXZ.push_back(cells[i].xz);
+	}
+	std::sort(changedXZ.begin(), changedXZ.end());
+	auto isNextToChange = [this](uint32_t xz) {
+		if (std::binary_search(changedXZ.begin(), changedXZ.end(), xz)) {
+			return true;
+		}
+		for (uint32_t dir = 0; dir < 4; dir++) {
+			if (std::binary_search(changedXZ.begin(), changedXZ.end(), neighborXZ(xz, dir))) {
+				return true;
+			}
+		}
+		return false;
+	};
+	for (size_t i = 0; i < saved.idx; i++) {
+		if (isNextToChange(cells[i].xz)) {
+			return false;
+		}
+	}
+	const auto neighbors = last.neighbors.data();
+	if (!isSameNeighborhood(world, neighbors, neighbors + 5 * saved.idx)) {  // the snapshots of the cells before the checkpoint
+		return false;
+	}
+
+	// now restore the checkpoint, with the changed cells in place of those of the last frame, which have not been examined or overridden yet
+	const bool hasTimeBudget = timeBudget.count() > 0;
+	for (size_t i = 0; i < prefix; i++) {
+		if (hasTimeBudget && !isSameCell(cells[i], saved.cells[i])) {
+			undoLog.emplace_back(static_cast<uint32_t>(i), cells[i]);  // the input is consistent, unlike the checkpoint in general
+		}
+		cells[i] = saved.cells[i];
+	}
+	dirtyCells.assign(saved.dirtyCells.begin(), saved.dirtyCells.begin() + prefix);
+	dirtyCells.resize(n, 1);
+	for (size_t i = m; i < saved.cells.size(); i++) {
+		Rul2WorldCell cell;
+		if (hasTimeBudget) {
+			appendedWorldIndices.push_back(world.GetCell(saved.cells[i].xz, cell) ? cell.idxInCellsBuffer : -1);
+		}
+		world.SetCellsBufferIndex(saved.cells[i].xz, static_cast<int32_t>(cells.size()));
+		cells.push_back(saved.cells[i]);
+		dirtyCells.push_back(saved.dirtyCells[i]);
+	}
+	IndexCells(cells);
+	progress = {saved.idx, saved.matchCount, saved.foundMatch};
+	return true;
+}
+
+Rul2Solver::Outcome Rul2Solver::Solve(Rul2World& world, std::vector<Rul2Cell>& cells)
+{
+#ifdef NAM_RUL2_INSTRUMENTATION
+	Rul2Instrumentation::Begin();
+	const Outcome outcome = SolveCells(world, cells);
+	Rul2Instrumentation::End(outcome, static_cast<uint32_t>(cells.size()));
+	return outcome;
+#else
+	return SolveCells(world, cells);
+#endif
+}
+
+// Checks the tile pairs of the cells passed by the game and their neighbors for a guaranteed Prevent (see Rul2Rules::MatchesGuaranteedPrevent),
+// looking up the neighbors as SolveDirtyCells does. Neither tile of such a pair ever changes, so SolveDirtyCells would examine the pair
+// eventually and end in a Prevent, unless it runs out of matches or cells before, which gives a red drag, too. This way, a red drag
+// is detected without the matches of all the cells examined before the pair.
+bool Rul2Solver::HasGuaranteedPrevent(Rul2World& world, const std::vector<Rul2Cell>& cells)
+{
+	if (!rules.HasGuaranteedPrevents()) {
+		return false;
+	}
+	for (const Rul2Cell& cell : cells) {
+		if (cell.id == 0) {
+			continue;  // only a neighbor has ID 0 regardless of its overrides
+		}
+		for (uint32_t dir = 0; dir < 4; dir++) {
+			const uint32_t nextCellXZ = neighborXZ(cell.xz, dir);
+			Rul2WorldCell cell2Info;
+			if (!world.GetCell(nextCellXZ, cell2Info)) {
+				continue;
+			}
+			Rul2Cell cell2;
+			if (cell2Info.idxInCellsBuffer >= 0) {
+				cell2 = cells[cell2Info.idxInCellsBuffer];
+			} else if (cell2Info.hasOccupant) {
+				cell2 = {cell2Info.id, cell2Info.rf, nextCellXZ};
+			} else {
+				continue;
+			}
+			if (cell2Info.isImmovable || cell2Info.isNetworkLot) {
+				cell2.id = 0;
+			} else if (cell2.id == 0) {
+				continue;
+			}
+			if (rules.MatchesGuaranteedPrevent(cell, cell2, dir)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+Rul2Solver::Outcome Rul2Solver::SolveCells(Rul2World& world, std::vector<Rul2Cell>& cells)
+{
+	int32_t maxMatches = cells.size() * 8;  // 4 directions * {non-swapped,swapped}
+	if (maxMatches <= maxRepetitions) {
+		maxMatches = maxRepetitions;
+	}
+	NAM_RUL2_RECORD(remainingMatches, maxMatches);
+
+	if (cells.empty()) {
+		return Solved;
+	}
+	const auto deadline = timeBudget.count() > 0 ? std::chrono::steady_clock::now() + timeBudget : std::chrono::steady_clock::time_point::max();
+	const RuleIndexCache::Fingerprint& fingerprint = rules.Fingerprint();
+	if (fingerprint.hash != solutionCacheFingerprint.hash || fingerprint.ruleCount != solutionCacheFingerprint.ruleCount) {
+		ClearSolutionCache();
+		solutionCacheFingerprint = fingerprint;
+	}
+
+	uint64_t inputHash = 0;
+	Outcome outcome;
+	if (solutionCacheEnabled) {
+		inputHash = hashCells(cells);
+		if (FindSolution(world, cells, inputHash, outcome)) {
+			return outcome;
+		}
+	}
+
+	frameInput = cells;
+	checkpoint.idx = 0;
+	checkpointIdx = incremental && cells.size() > checkpointDistance ? static_cast<uint32_t>(cells.size()) - checkpointDistance : 0;
+	// This reports Prevented even if the evaluation would have given up with TooManyMatches or TooManyCells before reaching
+	// the Prevent, which are red drags as well (see NAM.ini).
+	if (HasGuaranteedPrevent(world, cells)) {
+		NAM_RUL2_COUNT(prevents);
+		outcome = Prevented;
+	} else {
+		Progress progress = {0, 0, false};
+		undoLog.clear();
+		appendedWorldIndices.clear();
+		consistentSize = static_cast<uint32_t>(cells.size());
+		if (!incremental || !ResumeLastFrame(world, cells, maxMatches, progress)) {
+			dirtyCells.assign(cells.size(), 1);
+			IndexCells(cells);
+		}
+		outcome = SolveDirtyCells(world, cells, maxMatches, progress, deadline);
+	}
+	if (outcome == TimeBudgetExceeded) {
+		lastFrame = nullptr;  // the cells are in an intermediate state, and the next attempt may have more time
+		return outcome;
+	}
+	if (!solutionCacheEnabled && !(incremental && outcome == Solved)) {
+		lastFrame = nullptr;
+		return outcome;  // nothing to keep
+	}
+
+	SolvedFrame& frame = StoreSolution(inputHash, outcome);
+	frame.input.swap(frameInput);
+	frame.output = cells;
+	SnapshotNeighbors(world, cells, frame.neighbors);
+	std::swap(frame.checkpoint, checkpoint);  // keeps the buffers of the replaced one for the next invocation
+	lastFrame = incremental && outcome == Solved ? &frame : nullptr;  // otherwise the cells are in an intermediate state
+	return outcome;
+}
+
+bool Rul2Solver::FindSolution(Rul2World& world, std::vector<Rul2Cell>& cells, uint64_t inputHash, Outcome& outcome)
+{
+	for (auto it = solutionCache.begin(); it != solutionCache.end(); ) {
+		if (it->inputHash != inputHash || !std::equal(cells.begin(), cells.end(), it->frame.input.begin(), it->frame.input.end(), isSameCell)) {
+			++it;
+			continue;
+		}
+		const auto neighbors = it->frame.neighbors.data();
+		if (!isSameNeighborhood(world, neighbors, neighbors + it->frame.neighbors.size())) {
+			++it;  // e.g. a network was built next to the cells in the meantime, which may be undone again, so the solution is kept
+			continue;
+		}
+		solutionCache.splice(solutionCache.begin(), solutionCache, it);
+		const SolvedFrame& frame = it->frame;
+		cells = frame.output;
+		for (size_t i = frame.input.size(); i < cells.size(); i++) {
+			world.SetCellsBufferIndex(cells[i].xz, static_cast<int32_t>(i));  // as for the overridden neighbors appended by the solver
+		}
+		outcome = it->outcome;
+		lastFrame = incremental && outcome == Solved ? &frame : nullptr;
+		cacheStatistics.hits++;
+		return true;
+	}
+	cacheStatistics.misses++;
+	return false;
+}
+
+Rul2Solver::SolvedFrame& Rul2Solver::StoreSolution(uint64_t inputHash, Outcome outcome)
+{
+	if (solutionCache.size() < (solutionCacheEnabled ? solutionCacheCapacity : 1)) {
+		solutionCache.emplace_front();
+	} else {
+		solutionCache.splice(solutionCache.begin(), solutionCache, std::prev(solutionCache.end()));  // reuses the buffers of the least recently used
+	}
+	CachedSolution& solution = solutionCache.front();
+	solution.inputHash = inputHash;
+	solution.outcome = outcome;
+	return solution.frame;
+}
+
+size_t Rul2Solver::SolutionCacheMemoryUsage() const
+{
+	size_t bytes = 0;
+	for (const CachedSolution& solution : solutionCache) {
+		bytes += sizeof(CachedSolution) + 2 * sizeof(void*);  // including the list node
+		bytes += (solution.frame.input.capacity() + solution.frame.output.capacity()) * sizeof(Rul2Cell);
+		bytes += solution.frame.neighbors.capacity() * sizeof(SolvedFrame::NeighborSnapshot);
+		bytes += solution.frame.checkpoint.cells.capacity() * sizeof(Rul2Cell) + solution.frame.checkpoint.dirtyCells.capacity();
+	}
+	return bytes;
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include "Rul2Rules.h"
+#include "Rul2World.h"
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+// Applies the RUL2 override rules to the cells of a network drag until no more rules match,
+// replacing the game's cSC4NetworkTool::AdjustTileSubsets.
+//
+// Optionally, the solutions of the most recent invocations are kept in a small LRU cache, for when the game solves the same cells
+// again (e.g. when redragging an existing network). A cached solution is replayed if the cells passed by the game are the same
+// and the world cells at and next to the solved cells are unchanged, which are all the world cells the solver could have read.
+// As this snapshot of the world cells is taken after every evaluation, the cache only pays off if enough invocations hit it,
+// see SetSolutionCache. The cache is cleared when the rules change.
+class Rul2Solver
+{
+public:
+	enum Outcome
+	{
+		Solved,
+		Prevented,  // by a RUL2 Prevent rule
+		TooManyMatches,  // presumably the rules keep overriding each other
+		TooManyCells,  // too many neighbors have been appended to the cells buffer
+		TimeBudgetExceeded,  // see SetTimeBudget
+	};
+
+	static constexpr int32_t maxRepetitions = 100;
+	static constexpr int32_t maxCellsBufferSize = 256 * 3;  // e.g. enough for a diagonal double-tile network across the entire map
+	static constexpr uint32_t timeCheckInterval = 64;  // examined cells between two reads of the clock
+	static constexpr size_t solutionCacheCapacity = 32;
+	static constexpr uint32_t checkpointDistance = 4;  // cells before the end of the cells passed by the game, see SolvedFrame::Checkpoint
+
+	struct SolutionCacheStatistics
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+	};
+
+	explicit Rul2Solver(Rul2Rules& rules) : rules(rules) {}
+
+	// While dragging, continue the evaluation of the last frame from a checkpoint near the end of the drag, see ResumeLastFrame.
+	// This gives the same result as a full evaluation.
+	void SetIncremental(bool incremental) { this->incremental = incremental; }
+	bool IsIncremental() const { return incremental; }
+
+	// Bounds the wall-clock time of Solve, which then gives up with TimeBudgetExceeded (0 = unlimited).
+	// Unlike the other limits, this depends on the speed of the machine, so the outcome of such a drag is not reproducible.
+	// With a time budget, the solver keeps track of the last consistent state of the cells, which it returns when giving up:
+	// the last state of the first pass over the cells in which every cell examined so far has been examined again since its tiles
+	// last changed, so that the overrides applied up to there are complete, while the cells not reached yet are unchanged
+	// or overridden together with a neighbor before. This is the input of the game if there is no such state with overrides.
+	void SetTimeBudget(std::chrono::milliseconds timeBudget) { this->timeBudget = timeBudget; }
+
+	// Whether to keep the solutions of the most recent invocations (see above). Without the cache, only the last frame
+	// of the incremental evaluation is kept.
+	void SetSolutionCache(bool enabled)
+	{
+		solutionCacheEnabled = enabled;
+		ClearSolutionCache();
+	}
+	bool HasSolutionCache() const { return solutionCacheEnabled; }
+
+	// Forgets the last solved frame, e.g. when switching to a different network tool.
+	void ForgetLastFrame() { lastFrame = nullptr; }
+
+	// Forgets the cached solutions, e.g. when starting a trace, which is replayed without them.
+	void ClearSolutionCache()
+	{
+		solutionCache.clear();
+		lastFrame = nullptr;
+	}
+	SolutionCacheStatistics& CacheStatistics() { return cacheStatistics; }
+	size_t SolutionCacheMemoryUsage() const;
+
+	// Overrides the cells in place, appending overridden neighbors from the world.
+	// If the outcome is TimeBudgetExceeded, the cells are in the last consistent state (see SetTimeBudget),
+	// otherwise if it is not Solved, they are in an intermediate state.
+	Outcome Solve(Rul2World& world, std::vector<Rul2Cell>& cells);
+
+private:
+	// The outcome of an invocation of Solve, for the solution cache and for the incremental evaluation.
+	// While the user drags a network, the game solves the dragged cells in every frame, and usually only a few cells
+	// at the end of the drag change, so the incremental evaluation continues from a checkpoint of the previous successful invocation.
+	// This is always the most recently used solution of the cache, which is only replaced once the next invocation has resumed it
+	// and is stored itself. Without the solution cache, the cache holds just this frame.
+	struct SolvedFrame
+	{
+		struct NeighborSnapshot
+		{
+			uint32_t xz;
+			bool hasCell;
+			Rul2WorldCell cell;
+		};
+
+		// The state of the evaluation when its first pass over the cells reached the cell checkpointDistance cells
+		// before the end of the input, i.e. after examining all the cells before it.
+		struct Checkpoint
+		{
+			uint32_t idx = 0;  // of the cell reached, 0 if there is no checkpoint
+			int32_t matchCount = 0;
+			bool foundMatch = false;
+			std::vector<Rul2Cell> cells;
+			std::vector<uint8_t> dirtyCells;
+		};
+
+		std::vector<Rul2Cell> input;  // the cells passed by the game
+		std::vector<Rul2Cell> output;  // the solved cells, including the overridden neighbors appended to them
+		std::vector<NeighborSnapshot> neighbors;  // the world cells at and next to the solved cells, in the order of the cells
+		Checkpoint checkpoint;  // only kept for the incremental evaluation
+	};
+
+	// where SolveDirtyCells starts
+	struct Progress
+	{
+		uint32_t idx;  // of the next cell to examine
+		int32_t matchCount;
+		bool foundMatch;  // in the current pass over the cells
+	};
+
+	struct CachedSolution
+	{
+		uint64_t inputHash;
+		Outcome outcome;
+		SolvedFrame frame;
+	};
+
+	Outcome SolveCells(Rul2World& world, std::vector<Rul2Cell>& cells);
+	bool HasGuaranteedPrevent(Rul2World& world, const std::vector<Rul2Cell>& cells);
+	void IndexCells(const std::vector<Rul2Cell>& cells);
+	void IndexCell(uint32_t xz, uint32_t idx);
+	void MarkDirtyAround(uint32_t xz);
+	uint32_t NextDirtyCell(uint32_t start) const;
+	void RestoreConsistentState(Rul2World& world, std::vector<Rul2Cell>& cells);
+	Outcome SolveDirtyCells(Rul2World& world, std::vector<Rul2Cell>& cells, int32_t maxMatches, Progress progress, std::chrono::steady_clock::time_point deadline);
+	void SaveCheckpoint(const std::vector<Rul2Cell>& cells, const Progress& progress);
+	void SnapshotNeighbors(Rul2World& world, const std::vector<Rul2Cell>& cells, std::vector<SolvedFrame::NeighborSnapshot>& neighbors);
+	bool ResumeLastFrame(Rul2World& world, std::vector<Rul2Cell>& cells, int32_t maxMatches, Progress& progress);
+	bool FindSolution(Rul2World& world, std::vector<Rul2Cell>& cells, uint64_t inputHash, Outcome& outcome);
+	SolvedFrame& StoreSolution(uint64_t inputHash, Outcome outcome);
+
+	Rul2Rules& rules;
+	bool incremental = false;
+	bool solutionCacheEnabled = false;
+	std::chrono::milliseconds timeBudget{0};
+
+	// buffers reused across invocations
+	std::vector<uint8_t> dirtyCells;  // whether the cell at the same index of the cells needs to be examined (again)
+	uint32_t dirtyCount = 0;
+	// Open-addressing multimap from xz to the index in the cells (an overridden immovable neighbor may appear twice),
+	// kept at most half full. An entry is (xz << 32) | (index + 1), 0 being an empty slot.
+	std::vector<uint64_t> cellsByXZ;
+	uint32_t cellsByXZShift = 32;
+	uint32_t cellsByXZCount = 0;
+
+	const SolvedFrame* lastFrame = nullptr;  // in the solution cache
+	std::vector<Rul2Cell> frameInput;
+	std::vector<uint32_t> changedXZ;  // sorted
+	uint32_t checkpointIdx = 0;  // where SolveDirtyCells saves the checkpoint, 0 for none
+	// the changes since the last consistent state (see SetTimeBudget), to undo when giving up
+	std::vector<std::pair<uint32_t, Rul2Cell>> undoLog;  // index and previous tile of an overridden cell
+	std::vector<int32_t> appendedWorldIndices;  // the previous index in the cells buffer of the world cell of each appended neighbor
+	uint32_t consistentSize = 0;  // of the cells
+	SolvedFrame::Checkpoint checkpoint;  // of the current invocation
+
+	std::list<CachedSolution> solutionCache;  // most recently used first
+	RuleIndexCache::Fingerprint solutionCacheFingerprint;  // of the rules of the cached solutions
+	SolutionCacheStatistics cacheStatistics;
+};
@@ -0,0 +1,208 @@
+#include "Rul2Trace.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	constexpr char traceMagic[8] = {'N', 'A', 'M', 'R', 'U', 'L', '2', 'T'};
+	constexpr uint32_t traceVersion = 1;  // increment whenever the layout of the file changes
+	constexpr uint32_t maxCellCount = 1 << 20;  // bounds the allocations when reading corrupt files
+
+	enum HeaderFlags : uint32_t { Incremental = 0x1, CompactIndex = 0x2, NoSolutionCache = 0x4 };  // the solution cache used to be always on
+	enum ReadFlags : uint8_t { HasCell = 0x1, HasOccupant = 0x2, IsImmovable = 0x4, IsNetworkLot = 0x8 };
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t flags;
+		uint64_t fingerprint;
+		uint64_t ruleCount;
+	};
+	static_assert(sizeof(FileHeader) == 0x20);
+
+	struct RecordHeader
+	{
+		uint8_t outcome;
+		uint8_t forgotLastFrame;
+		uint16_t reserved;
+		uint32_t durationMicros;
+		uint32_t inputCount;
+		uint32_t readCount;
+		uint32_t outputCount;
+	};
+	static_assert(sizeof(RecordHeader) == 0x14);
+
+	struct PackedRead
+	{
+		uint32_t xz;
+		uint32_t id;
+		int32_t idxInCellsBuffer;
+		RotFlip rf;
+		uint8_t flags;
+		uint16_t reserved;
+	};
+	static_assert(sizeof(PackedRead) == 0x10);
+
+	template <typename T>
+	void writeArray(std::ofstream& out, const std::vector<T>& values)
+	{
+		out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+	}
+
+	template <typename T>
+	void readArray(std::ifstream& in, std::vector<T>& values, uint32_t count)
+	{
+		if (count > maxCellCount) {
+			throw std::runtime_error("Corrupt RUL2 trace file.");
+		}
+		values.resize(count);
+		in.read(reinterpret_cast<char*>(values.data()), count * sizeof(T));
+	}
+}
+
+bool Rul2Trace::RecordingWorld::GetCell(uint32_t xz, Rul2WorldCell& cell)
+{
+	const bool hasCell = world.GetCell(xz, cell);
+	if (readsByXZ.emplace(xz, static_cast<uint32_t>(record.reads.size())).second) {
+		record.reads.push_back({xz, hasCell, hasCell ? cell : Rul2WorldCell{}});
+	}
+	return hasCell;
+}
+
+void Rul2Trace::RecordingWorld::SetCellsBufferIndex(uint32_t xz, int32_t idx)
+{
+	world.SetCellsBufferIndex(xz, idx);
+}
+
+Rul2Trace::ReplayWorld::ReplayWorld(const Record& record)
+{
+	for (const Read& read : record.reads) {
+		reads.emplace(read.xz, read);
+	}
+}
+
+bool Rul2Trace::ReplayWorld::GetCell(uint32_t xz, Rul2WorldCell& cell)
+{
+	auto it = reads.find(xz);
+	if (it == reads.end()) {
+		unrecordedReads++;
+		return false;
+	}
+	cell = it->second.cell;
+	return it->second.hasCell;
+}
+
+void Rul2Trace::ReplayWorld::SetCellsBufferIndex(uint32_t xz, int32_t idx)
+{
+	auto it = reads.find(xz);
+	if (it == reads.end()) {
+		unrecordedReads++;
+		return;
+	}
+	it->second.cell.idxInCellsBuffer = idx;
+}
+
+void Rul2Trace::Writer::Open(const std::filesystem::path& traceFilePath, const Header& header)
+{
+	out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+	out.open(traceFilePath, std::ios::binary | std::ios::trunc);
+
+	FileHeader fileHeader = {};
+	std::memcpy(fileHeader.magic, traceMagic, sizeof(traceMagic));
+	fileHeader.version = traceVersion;
+	fileHeader.flags = (header.incremental ? Incremental : 0) | (header.compactIndex ? CompactIndex : 0) | (header.solutionCache ? 0 : NoSolutionCache);
+	fileHeader.fingerprint = header.fingerprint.hash;
+	fileHeader.ruleCount = header.fingerprint.ruleCount;
+	out.write(reinterpret_cast<const char*>(&fileHeader), sizeof(FileHeader));
+	out.flush();
+}
+
+void Rul2Trace::Writer::Write(const Record& record)
+{
+	const RecordHeader recordHeader = {
+		static_cast<uint8_t>(record.outcome),
+		static_cast<uint8_t>(record.forgotLastFrame),
+		0,
+		record.durationMicros,
+		static_cast<uint32_t>(record.input.size()),
+		static_cast<uint32_t>(record.reads.size()),
+		static_cast<uint32_t>(record.output.size()),
+	};
+	out.write(reinterpret_cast<const char*>(&recordHeader), sizeof(RecordHeader));
+	writeArray(out, record.input);
+	for (const Read& read : record.reads) {
+		const PackedRead packed = {
+			read.xz,
+			read.cell.id,
+			read.cell.idxInCellsBuffer,
+			read.cell.rf,
+			static_cast<uint8_t>(
+				(read.hasCell ? HasCell : 0) |
+				(read.cell.hasOccupant ? HasOccupant : 0) |
+				(read.cell.isImmovable ? IsImmovable : 0) |
+				(read.cell.isNetworkLot ? IsNetworkLot : 0)),
+			0,
+		};
+		out.write(reinterpret_cast<const char*>(&packed), sizeof(PackedRead));
+	}
+	writeArray(out, record.output);
+	out.flush();
+}
+
+Rul2Trace::Reader::Reader(const std::filesystem::path& traceFilePath) : in(traceFilePath, std::ios::binary), header()
+{
+	if (!in) {
+		throw std::runtime_error("Failed to open the RUL2 trace file.");
+	}
+	FileHeader fileHeader;
+	if (!in.read(reinterpret_cast<char*>(&fileHeader), sizeof(FileHeader)) ||
+		std::memcmp(fileHeader.magic, traceMagic, sizeof(traceMagic)) != 0 ||
+		fileHeader.version != traceVersion)
+	{
+		throw std::runtime_error("Not a RUL2 trace file of a supported version.");
+	}
+	header.incremental = (fileHeader.flags & Incremental) != 0;
+	header.compactIndex = (fileHeader.flags & CompactIndex) != 0;
+	header.solutionCache = (fileHeader.flags & NoSolutionCache) == 0;
+	header.fingerprint.hash = fileHeader.fingerprint;
+	header.fingerprint.ruleCount = fileHeader.ruleCount;
+}
+
+bool Rul2Trace::Reader::Next(Record& record)
+{
+	RecordHeader recordHeader;
+	if (!in.read(reinterpret_cast<char*>(&recordHeader), sizeof(RecordHeader))) {
+		if (in.gcount() == 0) {
+			return false;  // end of file
+		}
+		throw std::runtime_error("Truncated RUL2 trace file.");
+	}
+	if (recordHeader.outcome > Rul2Solver::TimeBudgetExceeded) {
+		throw std::runtime_error("Corrupt RUL2 trace file.");
+	}
+	record.outcome = static_cast<Rul2Solver::Outcome>(recordHeader.outcome);
+	record.forgotLastFrame = recordHeader.forgotLastFrame != 0;
+	record.durationMicros = recordHeader.durationMicros;
+	readArray(in, record.input, recordHeader.inputCount);
+
+	std::vector<PackedRead> packedReads;
+	readArray(in, packedReads, recordHeader.readCount);
+	record.reads.clear();
+	for (const PackedRead& packed : packedReads) {
+		Read read = {packed.xz, (packed.flags & HasCell) != 0, {}};
+		read.cell.hasOccupant = (packed.flags & HasOccupant) != 0;
+		read.cell.id = packed.id;
+		read.cell.rf = packed.rf;
+		read.cell.isImmovable = (packed.flags & IsImmovable) != 0;
+		read.cell.isNetworkLot = (packed.flags & IsNetworkLot) != 0;
+		read.cell.idxInCellsBuffer = packed.idxInCellsBuffer;
+		record.reads.push_back(read);
+	}
+
+	readArray(in, record.output, recordHeader.outputCount);
+	if (!in) {
+		throw std::runtime_error("Truncated RUL2 trace file.");
+	}
+	return true;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "Rul2Solver.h"
+#include "Rul2World.h"
+#include "RuleIndexCache.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+// Traces of the invocations of the RUL2 engine, recorded in the game and replayed offline by tools/rul2replay.
+//
+// A trace file consists of a header, identifying the RUL2 rules and the settings of the engine, followed by one record per invocation.
+// A record contains the cells passed by the game, every cell of the network world read by the engine (as it was before its first read),
+// and the solved cells. This suffices to replay the invocation deterministically, given the RUL2 index of the same rules (see RuleIndexCache).
+namespace Rul2Trace
+{
+	struct Header
+	{
+		bool incremental;  // see Rul2Solver::SetIncremental
+		bool compactIndex;  // the layout of the index, see Rul2Rules::UsesCompactIndex
+		bool solutionCache;  // see Rul2Solver::SetSolutionCache
+		RuleIndexCache::Fingerprint fingerprint;
+	};
+
+	struct Read
+	{
+		uint32_t xz;
+		bool hasCell;
+		Rul2WorldCell cell;
+	};
+
+	struct Record
+	{
+		bool forgotLastFrame = false;  // see Rul2Solver::ForgetLastFrame
+		Rul2Solver::Outcome outcome = Rul2Solver::Solved;
+		uint32_t durationMicros = 0;  // as measured in the game
+		std::vector<Rul2Cell> input;
+		std::vector<Read> reads;  // in order of first read
+		std::vector<Rul2Cell> output;
+	};
+
+	// Forwards to another world, recording the first read of every cell.
+	class RecordingWorld final : public Rul2World
+	{
+	public:
+		RecordingWorld(Rul2World& world, Record& record) : world(world), record(record) {}
+
+		bool GetCell(uint32_t xz, Rul2WorldCell& cell) override;
+		void SetCellsBufferIndex(uint32_t xz, int32_t idx) override;
+
+	private:
+		Rul2World& world;
+		Record& record;
+		std::unordered_map<uint32_t, uint32_t> readsByXZ;  // xz -> index in the reads of the record
+	};
+
+	// Replays the reads of a record, applying the changes of the cells buffer indexes made by the engine.
+	class ReplayWorld final : public Rul2World
+	{
+	public:
+		explicit ReplayWorld(const Record& record);
+
+		bool GetCell(uint32_t xz, Rul2WorldCell& cell) override;
+		void SetCellsBufferIndex(uint32_t xz, int32_t idx) override;
+
+		// The number of reads of cells that were not read in the game, so the replay deviates from the recorded invocation.
+		uint32_t UnrecordedReads() const { return unrecordedReads; }
+
+	private:
+		std::unordered_map<uint32_t, Read> reads;
+		uint32_t unrecordedReads = 0;
+	};
+
+	class Writer
+	{
+	public:
+		// Replaces the file. Throws if the file cannot be written.
+		void Open(const std::filesystem::path& traceFilePath, const Header& header);
+		bool IsOpen() const { return out.is_open(); }
+
+		// Throws if the file cannot be written. Each record is flushed, so that the trace survives a crash of the game.
+		void Write(const Record& record);
+
+	private:
+		std::ofstream out;
+	};
+
+	class Reader
+	{
+	public:
+		// Throws if the file cannot be read or is not a trace file of a supported version.
+		explicit Reader(const std::filesystem::path& traceFilePath);
+		const Header& GetHeader() const { return header; }
+
+		// Returns false at the end of the file. Throws if the file is truncated or corrupt.
+		bool Next(Record& record);
+
+	private:
+		std::ifstream in;
+		Header header;
+	};
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "RotFlip.h"
+#include <cstdint>
+
+// A cell in the cells buffer of the RUL2 engine (same layout as cSC4NetworkTool::tSolvedCell).
+struct Rul2Cell
+{
+	uint32_t id;
+	RotFlip rf;
+	uint32_t xz;  // z in the high 16 bits, x in the low 16 bits
+};
+static_assert(sizeof(Rul2Cell) == 0xc);
+
+// The state of a cell of the network world, as far as the RUL2 engine is concerned.
+struct Rul2WorldCell
+{
+	bool hasOccupant = false;
+	uint32_t id = 0;  // of the network occupant
+	RotFlip rf = R0F0;
+	bool isImmovable = false;
+	bool isNetworkLot = false;
+	int32_t idxInCellsBuffer = -1;  // or -1 if the cell is not in the cells buffer
+};
+
+// Access to the network world around the cells being solved.
+// In the game, this is backed by the world cache of the network tool. Other implementations allow running the engine without the game.
+class Rul2World
+{
+public:
+	virtual ~Rul2World() = default;
+
+	// Returns false if there is no cell info at `xz`, e.g. outside of the city.
+	virtual bool GetCell(uint32_t xz, Rul2WorldCell& cell) = 0;
+
+	// Records that the cell at `xz` has been appended to the cells buffer at index `idx`.
+	virtual void SetCellsBufferIndex(uint32_t xz, int32_t idx) = 0;
+};
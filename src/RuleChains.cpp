@@ -0,0 +1,94 @@
+#include "RuleChains.h"
+#include "Rul2Rules.h"
+#include "RuleSymmetry.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+	// The canonical key of the only tile pair in which a piece ID occurs, unless it occurs in several.
+	struct Occurrence
+	{
+		RuleSymmetry::Key key;
+		bool shared;
+	};
+
+	constexpr size_t maxChainLength = 64;  // longer chains of transient tile pairs must be cycles
+}
+
+RuleChains::Result RuleChains::Collapse(const std::vector<cSC4NetworkTileConflictRule>& rules)
+{
+	std::unordered_map<uint32_t, Occurrence> occurrences;
+	auto occur = [&occurrences](uint32_t id, const RuleSymmetry::Key& key) {
+		const auto [it, inserted] = occurrences.try_emplace(id, Occurrence{key, false});
+		if (!inserted && !(it->second.key == key)) {
+			it->second.shared = true;
+		}
+	};
+	for (const cSC4NetworkTileConflictRule& rule : rules) {
+		const RuleSymmetry::Key left = RuleSymmetry::Canonicalize(rule._1, rule._2).key;
+		occur(rule._1.id, left);
+		occur(rule._2.id, left);
+		if (rule._3.id != 0) {  // not a Prevent rule
+			const RuleSymmetry::Key right = RuleSymmetry::Canonicalize(rule._3, rule._4).key;
+			occur(rule._3.id, right);
+			occur(rule._4.id, right);
+		}
+	}
+
+	const std::vector<uint32_t> surrogateIdList = Rul2Rules::SurrogateTileIds();
+	const std::unordered_set<uint32_t> surrogateIds(surrogateIdList.begin(), surrogateIdList.end());
+	auto isTransient = [&occurrences, &surrogateIds](const Rul2Cell& a, const Rul2Cell& b) {
+		const RuleSymmetry::Key key = RuleSymmetry::Canonicalize({a.id, a.rf}, {b.id, b.rf}).key;
+		for (const uint32_t id : {a.id, b.id}) {
+			if (id == 0 || surrogateIds.count(id) != 0) {
+				return false;
+			}
+			const auto it = occurrences.find(id);
+			if (it == occurrences.end() || it->second.shared || !(it->second.key == key)) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	// The rules are composed by applying them as the solver does, which takes care of the symmetries.
+	Rul2Rules reference;
+	for (const cSC4NetworkTileConflictRule& rule : rules) {
+		reference.AddRule(rule);
+	}
+	reference.Build();
+
+	Result result;
+	result.rules = rules;
+	for (cSC4NetworkTileConflictRule& rule : result.rules) {
+		if (rule._3.id == 0 || rule._1.id == 0 || rule._2.id == 0 || surrogateIds.count(rule._1.id) != 0 || surrogateIds.count(rule._2.id) != 0) {
+			continue;
+		}
+		// towards the east, relative and absolute RotFlips coincide
+		Rul2Cell a = {rule._3.id, rule._3.rf, 0};
+		Rul2Cell b = {rule._4.id, rule._4.rf, 1};
+		size_t length = 1;
+		bool prevent = false;
+		while (length <= maxChainLength && isTransient(a, b)) {
+			const Rul2Rules::PatchResult patch = reference.PatchTilePair(a, b, 2);
+			if (patch == Rul2Rules::NoMatch) {
+				break;
+			}
+			length++;
+			if (patch == Rul2Rules::Prevent) {
+				prevent = true;
+				break;
+			}
+		}
+		if (length == 1 || length > maxChainLength) {
+			continue;
+		}
+		rule._3 = prevent ? Tile{0, R0F0} : Tile{a.id, a.rf};
+		rule._4 = prevent ? Tile{0, R0F0} : Tile{b.id, b.rf};
+		result.collapsedCount++;
+		result.longestChain = std::max(result.longestChain, length);
+	}
+	return result;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include <cstddef>
+#include <vector>
+
+// Composes chains of RUL2 override rules on the same tile pair (A|B = C|D, C|D = E|F) into a single rule (A|B = E|F),
+// so that Rul2Solver needs fewer matches and passes to converge.
+//
+// A rule is only collapsed if its outcome C|D is a transient tile pair: neither ID is 0 or a surrogate tile, and each ID
+// occurs in no other tile pair (on either side) of any rule, up to the 4 symmetries of RuleSymmetry. The tiles C and D
+// then match no rule but C|D = E|F, in any direction, and are never left in the world, so skipping them does not change the outcome,
+// except if C or D are built other than through RUL2 (e.g. by RUL1 or puzzle pieces), or if the solver ran out of matches before.
+// Rules with ID 0 or a surrogate tile on their left side are never collapsed, as the solver and the adjacency search
+// do not look up their outcome again. If the chain ends in a Prevent rule, the collapsed rule becomes a Prevent rule, too.
+namespace RuleChains
+{
+	struct Result
+	{
+		std::vector<cSC4NetworkTileConflictRule> rules;  // in the same order, with the collapsed rules replaced
+		size_t collapsedCount = 0;
+		size_t longestChain = 0;  // the most rules composed into one
+	};
+
+	// Equivalent rules are resolved as by Rul2Rules, so the first one wins.
+	Result Collapse(const std::vector<cSC4NetworkTileConflictRule>& rules);
+}
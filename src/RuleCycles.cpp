@@ -0,0 +1,104 @@
+#include "RuleCycles.h"
+#include "RuleSymmetry.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace
+{
+	struct KeyHash
+	{
+		size_t operator()(const RuleSymmetry::Key& key) const { return RuleSymmetry::Hash(key); }
+	};
+
+	constexpr uint32_t noNode = UINT32_MAX;
+
+	// the number of matches left from a tile pair, or one of these
+	constexpr uint32_t unvisited = 0;
+	constexpr uint32_t onPath = UINT32_MAX;
+	constexpr uint32_t endsInCycle = UINT32_MAX - 1;
+}
+
+RuleCycles::Result RuleCycles::Analyze(const std::vector<cSC4NetworkTileConflictRule>& rules, uint32_t minChainLength)
+{
+	// the tile pairs overridden by the rules (the nodes of the graph)
+	std::unordered_map<RuleSymmetry::Key, uint32_t, KeyHash> nodeByKey;
+	std::vector<uint32_t> ruleOfNode;
+	auto addNode = [&nodeByKey, &ruleOfNode](const Tile& a, const Tile& b, uint32_t rule) {
+		if (nodeByKey.emplace(RuleSymmetry::Canonicalize(a, b).key, static_cast<uint32_t>(ruleOfNode.size())).second) {
+			ruleOfNode.push_back(rule);  // otherwise an earlier equivalent rule wins
+		}
+	};
+	for (uint32_t i = 0; i < rules.size(); i++) {
+		const cSC4NetworkTileConflictRule& rule = rules[i];
+		if (rule._2.id != 0) {
+			addNode(rule._1, rule._2, i);
+		} else {
+			for (const auto rf : rotFlipValues) {
+				addNode(rule._1, {0, rf}, i);
+			}
+		}
+	}
+
+	// The canonical key does not depend on the symmetry under which a rule matches, so neither does the successor.
+	const uint32_t nodeCount = static_cast<uint32_t>(ruleOfNode.size());
+	std::vector<uint32_t> next(nodeCount, noNode);
+	std::vector<uint8_t> hasPredecessor(nodeCount, 0);
+	for (uint32_t node = 0; node < nodeCount; node++) {
+		const cSC4NetworkTileConflictRule& rule = rules[ruleOfNode[node]];
+		if (rule._3.id == 0) {
+			continue;  // Prevent
+		}
+		const auto it = nodeByKey.find(RuleSymmetry::Canonicalize(rule._3, rule._4).key);
+		if (it != nodeByKey.end()) {
+			next[node] = it->second;
+			hasPredecessor[it->second] = 1;
+		}
+	}
+
+	// Follow the successors from every node until reaching a node visited before, which is either the end of a known chain
+	// or a node on the current path, which closes a new cycle. Each node is visited once.
+	Result result;
+	std::vector<uint32_t> length(nodeCount, unvisited);
+	std::vector<uint32_t> path;
+	for (uint32_t start = 0; start < nodeCount; start++) {
+		path.clear();
+		uint32_t node = start;
+		while (node != noNode && length[node] == unvisited) {
+			length[node] = onPath;
+			path.push_back(node);
+			node = next[node];
+		}
+
+		uint32_t remaining = 0;
+		if (node != noNode && length[node] == onPath) {
+			const auto cycleBegin = std::find(path.begin(), path.end(), node);
+			std::vector<uint32_t>& cycle = result.cycles.emplace_back();
+			for (auto it = cycleBegin; it != path.end(); ++it) {
+				cycle.push_back(ruleOfNode[*it]);
+				length[*it] = endsInCycle;
+			}
+			path.erase(cycleBegin, path.end());
+			remaining = endsInCycle;
+		} else if (node != noNode) {
+			remaining = length[node];
+		}
+		for (auto it = path.rbegin(); it != path.rend(); ++it) {
+			remaining = remaining == endsInCycle ? endsInCycle : remaining + 1;
+			length[*it] = remaining;
+		}
+	}
+
+	for (uint32_t node = 0; node < nodeCount; node++) {
+		if (!hasPredecessor[node] && length[node] != endsInCycle && length[node] >= minChainLength) {
+			std::vector<uint32_t>& chain = result.chains.emplace_back();
+			for (uint32_t n = node; n != noNode; n = next[n]) {
+				chain.push_back(ruleOfNode[n]);
+			}
+		}
+	}
+	// the RotFlips of ID 0 lead to the same chain
+	std::sort(result.chains.begin(), result.chains.end());
+	result.chains.erase(std::unique(result.chains.begin(), result.chains.end()), result.chains.end());
+	std::stable_sort(result.chains.begin(), result.chains.end(), [](const auto& a, const auto& b) { return a.size() > b.size(); });
+	return result;
+}
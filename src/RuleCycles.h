@@ -0,0 +1,26 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include <cstdint>
+#include <vector>
+
+// Finds the RUL2 override rules that keep overriding the same tile pair, which makes Rul2Solver run into
+// its limits of maxRepetitions and countMatchesDown (a slow drag that ends in a red drag).
+//
+// Each tile pair (up to the 4 symmetries of RuleSymmetry) is overridden by at most one rule, the first of the equivalent ones,
+// so the rules form a graph in which every tile pair has at most one successor: the right side of its rule, unless it is a Prevent rule.
+// A cycle in this graph (A|B = C|D, C|D = A|B, or a rule that maps a tile pair to itself) repeats until the solver gives up.
+// Long chains terminate, but cost a match per step. Only the overrides of a single tile pair are considered,
+// not those that propagate to the neighboring cells or go through the surrogate tiles of Rul2Rules::TryAdjacencies.
+namespace RuleCycles
+{
+	struct Result
+	{
+		// the indices of the rules that override each other, in the order in which they match
+		std::vector<std::vector<uint32_t>> cycles;
+		// the chains of at least the minimum length that do not end in a cycle, starting from a tile pair that no rule leads to, longest first
+		std::vector<std::vector<uint32_t>> chains;
+	};
+
+	// Rules with ID 0 as second tile match that tile in any RotFlip, as in WildcardRuleIndex.
+	Result Analyze(const std::vector<cSC4NetworkTileConflictRule>& rules, uint32_t minChainLength);
+}
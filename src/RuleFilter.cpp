@@ -0,0 +1,140 @@
+#include "RuleFilter.h"
+#include "Prefetch.h"
+#include "RuleSymmetry.h"
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+	constexpr size_t minTileCapacity = 16;
+	constexpr size_t bitsPerRule = 12;  // about 1 % false positives for a blocked Bloom filter with 4 bits per key
+
+	constexpr uint32_t fmix32(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x85ebca6b;
+		x ^= x >> 13;
+		x *= 0xc2b2ae35;
+		x ^= x >> 16;
+		return x;
+	}
+
+	// 4 bits within one 64-bit block, derived from bits independent of the block index
+	constexpr uint64_t blockMask(uint32_t h)
+	{
+		const uint32_t g = fmix32(h ^ 0x5bd1e995);
+		return (uint64_t(1) << (g & 63)) | (uint64_t(1) << ((g >> 6) & 63)) | (uint64_t(1) << ((g >> 12) & 63)) | (uint64_t(1) << ((g >> 18) & 63));
+	}
+
+	constexpr size_t blockIndex(uint32_t h, size_t blockCount)
+	{
+		return static_cast<size_t>((static_cast<uint64_t>(h) * blockCount) >> 32);
+	}
+
+	constexpr uint32_t tileHash(uint32_t id, uint32_t shift)
+	{
+		return (id * 0x9e3779b1) >> shift;
+	}
+
+	constexpr uint16_t rfBit(RotFlip rf)
+	{
+		return static_cast<uint16_t>(1 << ((rf & 0x3) | (rf >> 5)));
+	}
+}
+
+void RuleFilter::Init(size_t ruleCount)
+{
+	tileKeys.assign(minTileCapacity, 0);
+	tileMasks.assign(minTileCapacity, 0);
+	tileCount = 0;
+	tileShift = 32 - std::countr_zero(minTileCapacity);
+	blocks.assign(std::max<size_t>(1, (ruleCount * bitsPerRule + 63) / 64), 0);
+}
+
+void RuleFilter::Add(const cSC4NetworkTileConflictRule& rule)
+{
+	// a lookup (a, b) finds the rule if it equals one of its 4 equivalent orientations (see RuleSymmetry)
+	const Tile& t1 = rule._1;
+	const Tile& t2 = rule._2;
+	const uint16_t first1 = rfBit(t1.rf) | rfBit(flipVertically(t1.rf));
+	const uint16_t second1 = rfBit(rotate180(t1.rf)) | rfBit(flipHorizontally(t1.rf));
+	const uint16_t first2 = rfBit(rotate180(t2.rf)) | rfBit(flipHorizontally(t2.rf));
+	const uint16_t second2 = rfBit(t2.rf) | rfBit(flipVertically(t2.rf));
+	AddMasks(t1.id, static_cast<uint16_t>(first1 | (second1 << 8)));
+	AddMasks(t2.id, static_cast<uint16_t>(first2 | (second2 << 8)));
+
+	const uint32_t h = RuleSymmetry::Hash(RuleSymmetry::Canonicalize(rule).key);
+	blocks[blockIndex(h, blocks.size())] |= blockMask(h);
+}
+
+bool RuleFilter::MayContainTiles(const Tile& a, const Tile& b) const
+{
+	return (Masks(a.id) & rfBit(a.rf)) != 0 && (Masks(b.id) & (rfBit(b.rf) << 8)) != 0;
+}
+
+bool RuleFilter::MayContainKey(uint32_t keyHash) const
+{
+	const uint64_t mask = blockMask(keyHash);
+	return (blocks[blockIndex(keyHash, blocks.size())] & mask) == mask;
+}
+
+void RuleFilter::PrefetchKey(uint32_t keyHash) const
+{
+	prefetch(&blocks[blockIndex(keyHash, blocks.size())]);
+}
+
+uint16_t RuleFilter::Masks(uint32_t id) const
+{
+	if (tileMasks.empty()) {
+		return 0;
+	}
+	const uint32_t mask = static_cast<uint32_t>(tileKeys.size()) - 1;
+	for (uint32_t i = tileHash(id, tileShift); tileMasks[i] != 0; i = (i + 1) & mask) {
+		if (tileKeys[i] == id) {
+			return tileMasks[i];
+		}
+	}
+	return 0;
+}
+
+void RuleFilter::AddMasks(uint32_t id, uint16_t masks)
+{
+	uint32_t mask = static_cast<uint32_t>(tileKeys.size()) - 1;
+	uint32_t i = tileHash(id, tileShift);
+	for (; tileMasks[i] != 0; i = (i + 1) & mask) {
+		if (tileKeys[i] == id) {
+			tileMasks[i] |= masks;
+			return;
+		}
+	}
+	if (2 * (tileCount + 1) > tileKeys.size()) {  // grow the table
+		std::vector<uint32_t> oldKeys = std::move(tileKeys);
+		std::vector<uint16_t> oldMasks = std::move(tileMasks);
+		tileKeys.assign(oldKeys.size() * 2, 0);
+		tileMasks.assign(oldKeys.size() * 2, 0);
+		tileShift--;
+		mask = static_cast<uint32_t>(tileKeys.size()) - 1;
+		for (size_t j = 0; j < oldKeys.size(); j++) {
+			if (oldMasks[j] != 0) {
+				uint32_t k = tileHash(oldKeys[j], tileShift);
+				while (tileMasks[k] != 0) {
+					k = (k + 1) & mask;
+				}
+				tileKeys[k] = oldKeys[j];
+				tileMasks[k] = oldMasks[j];
+			}
+		}
+		i = tileHash(id, tileShift);
+		while (tileMasks[i] != 0) {
+			i = (i + 1) & mask;
+		}
+	}
+	tileKeys[i] = id;
+	tileMasks[i] = masks;
+	tileCount++;
+}
+
+size_t RuleFilter::MemoryUsage() const
+{
+	return tileKeys.size() * (sizeof(uint32_t) + sizeof(uint16_t)) + blocks.size() * sizeof(uint64_t);
+}
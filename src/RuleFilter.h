@@ -0,0 +1,41 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A small filter in front of the RUL2 index that rejects most lookups of tile pairs without any override rule,
+// which is the common case, without touching the (much larger) index itself.
+//
+// The first stage records, for each piece ID, the RotFlips with which it appears as first or second tile of a rule,
+// taking into account the 4 equivalent orientations of a rule. The second stage is a blocked Bloom filter over
+// the hash of the canonical key (see RuleSymmetry), so equivalent tile pairs share the same bits. Both stages have no false negatives.
+class RuleFilter
+{
+public:
+	// Clears the filter and sizes it for the given number of rules.
+	void Init(size_t ruleCount);
+	void Add(const cSC4NetworkTileConflictRule& rule);
+
+	// First stage: checks whether the index might contain a rule equivalent to the tile pair (a, b), without any hashing.
+	bool MayContainTiles(const Tile& a, const Tile& b) const;
+
+	// Second stage: checks whether the index might contain a rule with the canonical key of the given hash (RuleSymmetry::Hash).
+	bool MayContainKey(uint32_t keyHash) const;
+	// Prefetches the block that MayContainKey reads.
+	void PrefetchKey(uint32_t keyHash) const;
+
+	size_t MemoryUsage() const;
+
+private:
+	uint16_t Masks(uint32_t id) const;  // RotFlips as first tile (low byte) and as second tile (high byte)
+	void AddMasks(uint32_t id, uint16_t masks);
+
+	// open-addressing hash table from piece ID to RotFlip masks
+	std::vector<uint32_t> tileKeys;
+	std::vector<uint16_t> tileMasks;  // 0 = empty slot
+	size_t tileCount = 0;
+	uint32_t tileShift = 32;
+
+	std::vector<uint64_t> blocks;
+};
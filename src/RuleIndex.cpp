@@ -0,0 +1,227 @@
+#include "RuleIndex.h"
+#include "Prefetch.h"
+#include <algorithm>
+#include <functional>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+namespace
+{
+	constexpr size_t minCapacity = 16;
+	// The table is built in bulk, so we can afford a high load factor with linear probing,
+	// as the control bytes filter out almost all of the mismatching slots.
+	constexpr size_t loadFactorNumerator = 4;
+	constexpr size_t loadFactorDenominator = 5;
+	constexpr size_t minShardSize = 1 << 16;  // rules per thread
+	constexpr size_t roundSize = 16 * RuleStagingBuffer::chunkSize;  // pending rules inserted before releasing their chunks
+
+	// Runs f(0), ..., f(n-1) on n threads, one of which is the calling thread.
+	template <typename F>
+	void runOnThreads(uint32_t n, F&& f)
+	{
+		std::vector<std::thread> threads;
+		for (uint32_t t = 1; t < n; t++) {
+			try {
+				threads.emplace_back(std::ref(f), t);
+			} catch (const std::system_error&) {
+				f(t);  // no more threads available
+			}
+		}
+		f(0);
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+	}
+
+	constexpr uint8_t ctrlTag(uint32_t mixedHash)
+	{
+		return static_cast<uint8_t>(0x80 | (mixedHash & 0x7f));
+	}
+
+	// maps the high bits of the hash to [0, capacity) without requiring a power-of-two capacity
+	constexpr size_t slotIndex(uint32_t mixedHash, size_t capacity)
+	{
+		return static_cast<size_t>((static_cast<uint64_t>(mixedHash) * capacity) >> 32);
+	}
+
+	RuleIndex::Slot toSlot(const cSC4NetworkTileConflictRule& rule)
+	{
+		const RuleSymmetry::CanonicalForm form = RuleSymmetry::Canonicalize(rule);
+		return {form.key.ids, form.key.rotFlips, {rule._3, rule._4, form.symmetry}};
+	}
+}
+
+// The home slot of a rule follows from its hash, and equivalent rules have the same hash and hence the same probe sequence.
+// So the table is partitioned into contiguous ranges of slots, one per thread, and each thread inserts the rules whose home slot
+// lies in its range, in their original order. A rule whose probe sequence runs past the end of the range is deferred
+// and inserted afterwards, still in order, so of several equivalent rules the first one is kept, as with sequential insertion.
+//
+// The build is meant for the 2 GB address space of the game without the 4GB patch, so its transient memory stays small:
+// the rules of the current table are inserted into the new one straight from it, rather than copied first,
+// and the pending rules are inserted in rounds, releasing the chunks of each round before the next one.
+// So apart from the pending rules and the two tables (the current one only until its rules are inserted),
+// the build needs 8 bytes per rule of a round.
+void RuleIndex::Build(RuleStagingBuffer& pendingRules, uint32_t threadCount)
+{
+	const size_t pendingCount = pendingRules.Size();
+	const size_t count = size + pendingCount;
+
+	// the rules of the current table take precedence over the pending rules
+	std::vector<uint8_t> storedCtrl = std::move(ownedCtrl);
+	std::vector<Slot> storedSlots = std::move(ownedSlots);
+	std::shared_ptr<const void> storedBacking = std::move(backing);
+	const uint8_t* const oldCtrl = ctrl;
+	const Slot* const oldSlots = slots;
+	const size_t oldCapacity = capacity;
+	capacity = CapacityFor(count);
+	ownedCtrl.assign(capacity, 0);
+	ownedSlots.assign(capacity, {});
+	ctrl = ownedCtrl.data();
+	slots = ownedSlots.data();
+	size = 0;
+	for (size_t i = 0; i < oldCapacity; i++) {
+		if (oldCtrl[i] != 0) {
+			Insert(oldSlots[i]);
+		}
+	}
+	storedCtrl = {};  // release the current table
+	storedSlots = {};
+	storedBacking = nullptr;
+
+	const uint32_t shardCount = static_cast<uint32_t>(std::clamp<size_t>(count / minShardSize, 1, std::max<uint32_t>(threadCount, 1)));
+	auto shardOfSlot = [this, shardCount](size_t i) { return static_cast<uint32_t>(static_cast<uint64_t>(i) * shardCount / capacity); };
+	auto shardBegin = [this, shardCount](uint32_t shard) { return static_cast<size_t>((static_cast<uint64_t>(shard) * capacity + shardCount - 1) / shardCount); };
+
+	std::vector<uint32_t> hashes;
+	std::vector<uint32_t> order;
+	std::vector<size_t> shardOffsets(shardCount + 1);
+	std::vector<std::vector<uint32_t>> deferred(shardCount);
+	std::vector<size_t> shardSizes(shardCount);
+	for (size_t roundBegin = 0; roundBegin < pendingCount; roundBegin += roundSize) {
+		const size_t roundCount = std::min(roundSize, pendingCount - roundBegin);
+		auto slotAt = [&pendingRules, roundBegin](size_t i) { return toSlot(pendingRules[roundBegin + i]); };
+
+		hashes.resize(roundCount);
+		runOnThreads(shardCount, [&](uint32_t shard) {
+			for (size_t i = roundCount * shard / shardCount; i < roundCount * (shard + 1) / shardCount; i++) {
+				const Slot slot = slotAt(i);
+				hashes[i] = RuleSymmetry::Hash({slot.ids, slot.rotFlips});
+			}
+		});
+
+		// stable counting sort of the rules by shard
+		std::fill(shardOffsets.begin(), shardOffsets.end(), 0);
+		for (const uint32_t h : hashes) {
+			shardOffsets[shardOfSlot(slotIndex(h, capacity)) + 1]++;
+		}
+		for (uint32_t shard = 0; shard < shardCount; shard++) {
+			shardOffsets[shard + 1] += shardOffsets[shard];
+		}
+		order.resize(roundCount);
+		{
+			std::vector<size_t> cursors(shardOffsets.begin(), shardOffsets.end() - 1);
+			for (size_t i = 0; i < roundCount; i++) {
+				order[cursors[shardOfSlot(slotIndex(hashes[i], capacity))]++] = static_cast<uint32_t>(i);
+			}
+		}
+
+		std::fill(shardSizes.begin(), shardSizes.end(), 0);
+		runOnThreads(shardCount, [&](uint32_t shard) {
+			const size_t end = shardBegin(shard + 1);
+			for (size_t j = shardOffsets[shard]; j < shardOffsets[shard + 1]; j++) {
+				const uint32_t h = hashes[order[j]];
+				const uint8_t tag = ctrlTag(h);
+				const Slot slot = slotAt(order[j]);
+				for (size_t i = slotIndex(h, capacity); ; ) {
+					if (ownedCtrl[i] == 0) {
+						ownedCtrl[i] = tag;
+						ownedSlots[i] = slot;
+						shardSizes[shard]++;
+						break;
+					} else if (ownedCtrl[i] == tag && ownedSlots[i].ids == slot.ids && ownedSlots[i].rotFlips == slot.rotFlips) {
+						break;
+					} else if (++i == end) {
+						deferred[shard].push_back(order[j]);
+						break;
+					}
+				}
+			}
+		});
+		for (uint32_t shard = 0; shard < shardCount; shard++) {
+			size += shardSizes[shard];
+			for (const uint32_t i : deferred[shard]) {
+				Insert(slotAt(i));
+			}
+			deferred[shard].clear();
+		}
+		pendingRules.ReleaseBefore(roundBegin + roundCount);
+	}
+	pendingRules = {};
+}
+
+void RuleIndex::Attach(const uint8_t* ctrl, const Slot* slots, size_t capacity, size_t size, std::shared_ptr<const void> backing)
+{
+	this->ownedCtrl = {};
+	this->ownedSlots = {};
+	this->backing = std::move(backing);
+	this->ctrl = ctrl;
+	this->slots = slots;
+	this->capacity = capacity;
+	this->size = size;
+}
+
+bool RuleIndex::Insert(const Slot& slot)
+{
+	const uint32_t h = RuleSymmetry::Hash({slot.ids, slot.rotFlips});
+	const uint8_t tag = ctrlTag(h);
+	for (size_t i = slotIndex(h, capacity); ; i = (i + 1 == capacity) ? 0 : i + 1) {
+		if (ownedCtrl[i] == 0) {
+			ownedCtrl[i] = tag;
+			ownedSlots[i] = slot;
+			size++;
+			return true;
+		} else if (ownedCtrl[i] == tag && ownedSlots[i].ids == slot.ids && ownedSlots[i].rotFlips == slot.rotFlips) {
+			return false;
+		}
+	}
+}
+
+size_t RuleIndex::CapacityFor(size_t count)
+{
+	return std::max(minCapacity, count * loadFactorDenominator / loadFactorNumerator + 1);
+}
+
+const RuleIndex::Slot* RuleIndex::Find(const RuleSymmetry::Key& key, uint32_t hash) const
+{
+	const uint8_t tag = ctrlTag(hash);
+	// The load factor guarantees an empty slot in a table we built, but an attached table may come from a corrupt cache file,
+	// so the probe sequence is bounded by the capacity regardless.
+	size_t i = capacity > 0 ? slotIndex(hash, capacity) : 0;
+	for (size_t probes = 0; probes < capacity; probes++, i = (i + 1 == capacity) ? 0 : i + 1) {
+		const uint8_t c = ctrl[i];
+		if (c == 0) {
+			return nullptr;
+		} else if (c == tag && slots[i].ids == key.ids && slots[i].rotFlips == key.rotFlips) {
+			return &slots[i];
+		}
+	}
+	return nullptr;
+}
+
+void RuleIndex::Prefetch(uint32_t hash) const
+{
+	if (capacity == 0) {
+		return;
+	}
+	const size_t i = slotIndex(hash, capacity);
+	prefetch(ctrl + i);
+	prefetch(slots + i);
+}
+
+cSC4NetworkTileConflictRule RuleIndex::Slot::Rule() const
+{
+	const RuleSymmetry::Key key = {ids, rotFlips};
+	const auto [t1, t2] = RuleSymmetry::Transform(output.symmetry, key.Tile1(), key.Tile2());
+	return {t1, t2, output._3, output._4};
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include "RuleStagingBuffer.h"
+#include "RuleSymmetry.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A flat open-addressing hash table of RUL2 override rules.
+// The rules are keyed by the canonical key of their first two tiles (see RuleSymmetry),
+// so a rule can be found from any of its 4 equivalent orientations by comparing keys.
+// All rules live in one contiguous array (no per-rule heap nodes), with a parallel array
+// of control bytes holding 7 bits of the hash, so most probes do not touch the rules at all.
+class RuleIndex
+{
+public:
+	struct Slot
+	{
+		uint64_t ids;  // of RuleSymmetry::Key
+		uint8_t rotFlips;  // of RuleSymmetry::Key
+		RuleSymmetry::RuleOutput output;
+
+		cSC4NetworkTileConflictRule Rule() const;
+	};
+	static_assert(sizeof(Slot) == 32);
+
+	// Inserts the pending rules into the table, rebuilding it with a suitable capacity, using up to `threadCount` threads.
+	// Like std::unordered_set::insert, a rule equivalent to a rule that is already contained is ignored.
+	// The pending rules are cleared afterwards.
+	void Build(RuleStagingBuffer& pendingRules, uint32_t threadCount = 1);
+
+	// Replaces the table by one that was built previously, e.g. from a memory-mapped cache file.
+	// The `backing` keeps the memory of `ctrl` and `slots` alive for as long as it is in use.
+	// The capacity must be at least CapacityFor(size), see RuleIndexCache.
+	void Attach(const uint8_t* ctrl, const Slot* slots, size_t capacity, size_t size, std::shared_ptr<const void> backing);
+
+	// The capacity of a table built from `count` rules, which leaves at least one slot in five empty.
+	static size_t CapacityFor(size_t count);
+
+	// Returns the slot of the stored rule with the given canonical key and its hash (RuleSymmetry::Hash), or nullptr.
+	const Slot* Find(const RuleSymmetry::Key& key, uint32_t hash) const;
+	// Prefetches the home slot of a key with the given hash, where Find starts probing (usually also where it ends).
+	void Prefetch(uint32_t hash) const;
+
+	template <typename F>
+	void ForEachRule(F&& f) const
+	{
+		ForEachRuleWithPosition([&f](size_t, const cSC4NetworkTileConflictRule& rule) { f(rule); });
+	}
+
+	// Like ForEachRule, also passing the position of each rule, i.e. its slot.
+	template <typename F>
+	void ForEachRuleWithPosition(F&& f) const
+	{
+		for (size_t i = 0; i < capacity; i++) {
+			if (ctrl[i] != 0) {
+				f(i, slots[i].Rule());
+			}
+		}
+	}
+
+	size_t Size() const { return size; }
+	size_t Capacity() const { return capacity; }
+	size_t MemoryUsage() const { return capacity * (sizeof(Slot) + sizeof(uint8_t)); }
+	bool IsAttached() const { return backing != nullptr; }
+
+	const uint8_t* CtrlData() const { return ctrl; }
+	const Slot* SlotData() const { return slots; }
+
+private:
+	bool Insert(const Slot& slot);
+
+	std::vector<uint8_t> ownedCtrl;  // 0 = empty slot, otherwise 0x80 | (7 bits of hash)
+	std::vector<Slot> ownedSlots;
+	std::shared_ptr<const void> backing;
+
+	// either point to the owned vectors or to the attached memory
+	const uint8_t* ctrl = nullptr;
+	const Slot* slots = nullptr;
+	size_t capacity = 0;
+	size_t size = 0;
+};
@@ -0,0 +1,306 @@
+#include "RuleIndexCache.h"
+#ifdef _WIN32
+#include <Windows.h>
+#include "wil/resource.h"
+#include "wil/result.h"
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#endif
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <optional>
+
+namespace
+{
+	constexpr char cacheMagic[8] = {'N', 'A', 'M', 'R', 'U', 'L', '2', 'I'};
+	constexpr uint32_t cacheVersion = 5;  // increment whenever the layout of the index changes
+
+	enum IndexLayout : uint32_t { Flat = 0, Compact = 1 };
+
+	constexpr size_t sectionCount = 4;
+	constexpr uint32_t sectionAlignment = 8;
+
+	struct Section
+	{
+		uint32_t offset;
+		uint32_t length;  // in bytes
+	};
+
+	// The arrays of the index follow the header as sections:
+	// Flat: control bytes, rules, (unused), wildcard rules (WildcardRuleIndex::Records)
+	// Compact: piece IDs, group offsets, entries, wildcard rules (WildcardRuleIndex::Records)
+	struct CacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t headerSize;
+		uint64_t fingerprint;
+		uint64_t ruleCount;
+		uint32_t layout;
+		uint32_t size;
+		uint32_t count;  // Flat: capacity, Compact: number of piece IDs
+		uint32_t fileSize;
+		Section sections[sectionCount];
+	};
+	static_assert(sizeof(CacheHeader) == 0x50);
+
+	struct MappedCache
+	{
+		CacheHeader header;
+		const uint8_t* data;
+		std::shared_ptr<const void> backing;
+	};
+
+	constexpr uint32_t alignUp(uint32_t offset, uint32_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	void save(const std::filesystem::path& cacheFilePath, const RuleIndexCache::Fingerprint& fingerprint, IndexLayout layout, size_t size, size_t count,
+			const std::array<std::pair<const void*, size_t>, sectionCount>& sectionData)
+	{
+		CacheHeader header = {};
+		std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+		header.version = cacheVersion;
+		header.headerSize = sizeof(CacheHeader);
+		header.fingerprint = fingerprint.hash;
+		header.ruleCount = fingerprint.ruleCount;
+		header.layout = layout;
+		header.size = static_cast<uint32_t>(size);
+		header.count = static_cast<uint32_t>(count);
+		uint32_t offset = sizeof(CacheHeader);
+		for (size_t i = 0; i < sectionCount; i++) {
+			offset = alignUp(offset, sectionAlignment);
+			header.sections[i] = {offset, static_cast<uint32_t>(sectionData[i].second)};
+			offset += header.sections[i].length;
+		}
+		header.fileSize = offset;
+
+		std::filesystem::path tmpFilePath = cacheFilePath;
+		tmpFilePath += ".tmp";
+		{
+			std::ofstream out(tmpFilePath, std::ios::binary | std::ios::trunc);
+			out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+			out.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+			uint32_t position = sizeof(CacheHeader);
+			for (size_t i = 0; i < sectionCount; i++) {
+				const char padding[sectionAlignment] = {};
+				out.write(padding, header.sections[i].offset - position);
+				out.write(static_cast<const char*>(sectionData[i].first), header.sections[i].length);
+				position = header.sections[i].offset + header.sections[i].length;
+			}
+		}
+		std::filesystem::rename(tmpFilePath, cacheFilePath);  // replaces an outdated cache file only once the new one is complete
+	}
+
+	struct MappedFile
+	{
+		const void* view;
+		uint64_t size;
+		std::shared_ptr<const void> backing;  // unmaps the view
+	};
+
+	// Maps the entire file read-only. Returns nullopt if the file does not exist or is too small.
+	std::optional<MappedFile> mapFile(const std::filesystem::path& cacheFilePath)
+	{
+#ifdef _WIN32
+		wil::unique_hfile file(CreateFileW(cacheFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+		if (!file) {
+			const DWORD lastError = GetLastError();
+			if (lastError == ERROR_FILE_NOT_FOUND || lastError == ERROR_PATH_NOT_FOUND) {
+				return std::nullopt;
+			}
+			THROW_WIN32(lastError);
+		}
+
+		LARGE_INTEGER fileSize;
+		THROW_IF_WIN32_BOOL_FALSE(GetFileSizeEx(file.get(), &fileSize));
+		if (static_cast<uint64_t>(fileSize.QuadPart) < sizeof(CacheHeader)) {
+			return std::nullopt;
+		}
+
+		wil::unique_handle mapping(CreateFileMappingW(file.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+		THROW_LAST_ERROR_IF(!mapping);
+		const void* const view = MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0);
+		THROW_LAST_ERROR_IF_NULL(view);
+		std::shared_ptr<const void> backing(view, [](const void* p) { UnmapViewOfFile(p); });  // the view remains valid after closing the handles
+		return MappedFile{view, static_cast<uint64_t>(fileSize.QuadPart), std::move(backing)};
+#else
+		// POSIX fallback for running the RUL2 engine outside of the game, e.g. in tools/rul2bench
+		const int fd = open(cacheFilePath.c_str(), O_RDONLY);
+		if (fd < 0) {
+			if (errno == ENOENT || errno == ENOTDIR) {
+				return std::nullopt;
+			}
+			throw std::system_error(errno, std::generic_category(), "Failed to open the RUL2 index cache file");
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			const int error = errno;
+			close(fd);
+			throw std::system_error(error, std::generic_category(), "Failed to read the size of the RUL2 index cache file");
+		}
+		const uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+		if (fileSize < sizeof(CacheHeader)) {
+			close(fd);
+			return std::nullopt;
+		}
+		void* const view = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		const int error = errno;
+		close(fd);  // the mapping remains valid after closing the file
+		if (view == MAP_FAILED) {
+			throw std::system_error(error, std::generic_category(), "Failed to map the RUL2 index cache file");
+		}
+		std::shared_ptr<const void> backing(view, [fileSize](const void* p) { munmap(const_cast<void*>(p), fileSize); });
+		return MappedFile{view, fileSize, std::move(backing)};
+#endif
+	}
+
+	std::optional<MappedCache> map(const std::filesystem::path& cacheFilePath, const RuleIndexCache::Fingerprint& fingerprint, IndexLayout layout)
+	{
+		std::optional<MappedFile> file = mapFile(cacheFilePath);
+		if (!file) {
+			return std::nullopt;
+		}
+
+		MappedCache cache = {{}, static_cast<const uint8_t*>(file->view), std::move(file->backing)};
+		std::memcpy(&cache.header, cache.data, sizeof(CacheHeader));
+		const CacheHeader& header = cache.header;
+		if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+			header.version != cacheVersion ||
+			header.headerSize != sizeof(CacheHeader) ||
+			header.fingerprint != fingerprint.hash ||
+			header.ruleCount != fingerprint.ruleCount ||
+			header.layout != layout ||
+			header.fileSize != file->size)
+		{
+			return std::nullopt;  // outdated
+		}
+		for (const Section& section : header.sections) {
+			if (section.offset % sectionAlignment != 0 || static_cast<uint64_t>(section.offset) + section.length > header.fileSize) {
+				return std::nullopt;  // corrupt
+			}
+		}
+		return cache;
+	}
+
+	// Checks that the groups of the compact index partition its entries, so that lookups stay within the entries.
+	bool hasValidGroupOffsets(const MappedCache& cache)
+	{
+		const Section& section = cache.header.sections[1];
+		const uint32_t* const offsets = reinterpret_cast<const uint32_t*>(cache.data + section.offset);
+		const size_t groupCount = section.length / sizeof(uint32_t) - 1;
+		if (offsets[0] != 0 || offsets[groupCount] != cache.header.size) {
+			return false;
+		}
+		for (size_t group = 0; group < groupCount; group++) {
+			if (offsets[group] > offsets[group + 1]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Returns false if the wildcard rules section is corrupt.
+	bool loadWildcardRules(const MappedCache& cache, WildcardRuleIndex& wildcardIndex)
+	{
+		const Section& section = cache.header.sections[3];
+		if (section.length % sizeof(WildcardRuleIndex::OrderedRule) != 0) {
+			return false;
+		}
+		std::vector<WildcardRuleIndex::OrderedRule> rules(section.length / sizeof(WildcardRuleIndex::OrderedRule));
+		std::memcpy(rules.data(), cache.data + section.offset, section.length);
+		wildcardIndex.Clear();
+		wildcardIndex.Add(rules);
+		return true;
+	}
+}
+
+void RuleIndexCache::Fingerprint::Add(const cSC4NetworkTileConflictRule& rule)
+{
+	constexpr uint64_t prime = 0x100000001b3;
+	for (const Tile* tile : {&rule._1, &rule._2, &rule._3, &rule._4}) {
+		for (uint32_t i = 0; i < 32; i += 8) {
+			hash = (hash ^ ((tile->id >> i) & 0xff)) * prime;
+		}
+		hash = (hash ^ tile->rf) * prime;
+	}
+	ruleCount++;
+}
+
+bool RuleIndexCache::Load(const std::filesystem::path& cacheFilePath, const Fingerprint& fingerprint, RuleIndex& index, WildcardRuleIndex& wildcardIndex)
+{
+	std::optional<MappedCache> cache = map(cacheFilePath, fingerprint, IndexLayout::Flat);
+	if (!cache) {
+		return false;
+	}
+	const CacheHeader& header = cache->header;
+	if (header.size >= header.count ||  // no empty slot, so lookups would not terminate
+		header.count < RuleIndex::CapacityFor(header.size) ||  // more rules than the load factor allows
+		header.sections[0].length != header.count ||
+		header.sections[1].length != static_cast<uint64_t>(header.count) * sizeof(RuleIndex::Slot) ||
+		!loadWildcardRules(*cache, wildcardIndex))
+	{
+		return false;
+	}
+	index.Attach(
+		cache->data + header.sections[0].offset,
+		reinterpret_cast<const RuleIndex::Slot*>(cache->data + header.sections[1].offset),
+		header.count,
+		header.size,
+		std::move(cache->backing));
+	return true;
+}
+
+bool RuleIndexCache::Load(const std::filesystem::path& cacheFilePath, const Fingerprint& fingerprint, CompactRuleIndex& index, WildcardRuleIndex& wildcardIndex)
+{
+	std::optional<MappedCache> cache = map(cacheFilePath, fingerprint, IndexLayout::Compact);
+	if (!cache) {
+		return false;
+	}
+	const CacheHeader& header = cache->header;
+	if (header.count > CompactRuleIndex::maxPieceIds ||
+		header.sections[0].length != static_cast<uint64_t>(header.count) * sizeof(uint32_t) ||
+		header.sections[1].length != (static_cast<uint64_t>(header.count) * 8 + 1) * sizeof(uint32_t) ||
+		header.sections[2].length != static_cast<uint64_t>(header.size) * sizeof(uint64_t) ||
+		!hasValidGroupOffsets(*cache) ||
+		!CompactRuleIndex::HasValidTiles(reinterpret_cast<const uint64_t*>(cache->data + header.sections[2].offset), header.size, header.count) ||
+		!loadWildcardRules(*cache, wildcardIndex))
+	{
+		return false;
+	}
+	index.Attach(
+		reinterpret_cast<const uint32_t*>(cache->data + header.sections[0].offset),
+		header.count,
+		reinterpret_cast<const uint32_t*>(cache->data + header.sections[1].offset),
+		reinterpret_cast<const uint64_t*>(cache->data + header.sections[2].offset),
+		header.size,
+		std::move(cache->backing));
+	return true;
+}
+
+void RuleIndexCache::Save(const std::filesystem::path& cacheFilePath, const Fingerprint& fingerprint, const RuleIndex& index, const WildcardRuleIndex& wildcardIndex)
+{
+	save(cacheFilePath, fingerprint, IndexLayout::Flat, index.Size(), index.Capacity(), {{
+		{index.CtrlData(), index.Capacity() * sizeof(uint8_t)},
+		{index.SlotData(), index.Capacity() * sizeof(RuleIndex::Slot)},
+		{nullptr, 0},
+		{wildcardIndex.Records().data(), wildcardIndex.Records().size() * sizeof(WildcardRuleIndex::OrderedRule)},
+	}});
+}
+
+void RuleIndexCache::Save(const std::filesystem::path& cacheFilePath, const Fingerprint& fingerprint, const CompactRuleIndex& index, const WildcardRuleIndex& wildcardIndex)
+{
+	save(cacheFilePath, fingerprint, IndexLayout::Compact, index.Size(), index.PieceIdCount(), {{
+		{index.PieceIdData(), index.PieceIdCount() * sizeof(uint32_t)},
+		{index.GroupOffsetData(), (index.GroupCount() + 1) * sizeof(uint32_t)},
+		{index.EntryData(), index.Size() * sizeof(uint64_t)},
+		{wildcardIndex.Records().data(), wildcardIndex.Records().size() * sizeof(WildcardRuleIndex::OrderedRule)},
+	}});
+}
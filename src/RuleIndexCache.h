@@ -0,0 +1,31 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include "RuleIndex.h"
+#include "CompactRuleIndex.h"
+#include "WildcardRuleIndex.h"
+#include <cstdint>
+#include <filesystem>
+
+// Persists the finished RUL2 index in a binary file, so that the next game start can memory-map it
+// instead of building the index again, provided the same RUL2 rules have been loaded.
+// The few rules of the WildcardRuleIndex are stored along with it and are added to the WildcardRuleIndex again.
+namespace RuleIndexCache
+{
+	// Identifies the stream of RUL2 rules loaded by the game (order-sensitive, FNV-1a).
+	struct Fingerprint
+	{
+		uint64_t hash = 0xcbf29ce484222325;
+		uint64_t ruleCount = 0;
+
+		void Add(const cSC4NetworkTileConflictRule& rule);
+	};
+
+	// Returns false if the file does not exist or does not match the fingerprint and the layout of the index.
+	// Throws if the file cannot be read.
+	bool Load(const std::filesystem::path& cacheFilePath, const Fingerprint& fingerprint, RuleIndex& index, WildcardRuleIndex& wildcardIndex);
+	bool Load(const std::filesystem::path& cacheFilePath, const Fingerprint& fingerprint, CompactRuleIndex& index, WildcardRuleIndex& wildcardIndex);
+
+	// Throws if the file cannot be written.
+	void Save(const std::filesystem::path& cacheFilePath, const Fingerprint& fingerprint, const RuleIndex& index, const WildcardRuleIndex& wildcardIndex);
+	void Save(const std::filesystem::path& cacheFilePath, const Fingerprint& fingerprint, const CompactRuleIndex& index, const WildcardRuleIndex& wildcardIndex);
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "RuleSymmetry.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+// A small set-associative cache of the most recent RUL2 index lookups, in front of RuleIndex or CompactRuleIndex.
+//
+// Network drags evaluate the same few tile pairs over and over, so a cache of 512 canonical keys (20 KB) mostly
+// stays in the CPU caches, unlike the index itself. Both found rules and misses (tile pairs that passed RuleFilter,
+// but have no rule) are cached. Each set holds its 4 entries from most to least recently inserted, and a new entry evicts the oldest.
+// The cache must be cleared whenever the index changes.
+class RuleLookupCache
+{
+public:
+	struct Entry
+	{
+		uint64_t ids;  // of RuleSymmetry::Key
+		uint32_t position;  // of the rule in the index, see RuleProfile
+		uint8_t tag;  // RuleSymmetry::Key::rotFlips | validFlag | foundFlag
+		RuleSymmetry::RuleOutput output;
+
+		bool IsFound() const { return (tag & foundFlag) != 0; }
+	};
+	static_assert(sizeof(Entry) == 40);
+
+	static constexpr uint32_t wayCount = 4;
+	static constexpr uint32_t setBits = 7;
+	static constexpr uint32_t setCount = 1 << setBits;
+
+	void Clear() { sets = {}; }
+
+	// Returns the cached lookup of the canonical key with the given hash (RuleSymmetry::Hash), or nullptr if not cached.
+	const Entry* Find(const RuleSymmetry::Key& key, uint32_t hash) const
+	{
+		const Set& set = sets[SetIndex(hash)];
+		for (const Entry& entry : set) {
+			if (entry.ids == key.ids && (entry.tag & ~foundFlag) == (key.rotFlips | validFlag)) {
+				return &entry;
+			}
+		}
+		return nullptr;
+	}
+
+	// Caches the result of a lookup that is not cached yet.
+	void Insert(const RuleSymmetry::Key& key, uint32_t hash, bool found, const RuleSymmetry::RuleOutput& output, uint32_t position)
+	{
+		Set& set = sets[SetIndex(hash)];
+		std::move_backward(set.begin(), set.end() - 1, set.end());
+		set[0] = {key.ids, position, static_cast<uint8_t>(key.rotFlips | validFlag | (found ? foundFlag : 0)), output};
+	}
+
+private:
+	using Set = std::array<Entry, wayCount>;
+
+	static constexpr uint8_t validFlag = 0x40;  // rotFlips only has 6 bits
+	static constexpr uint8_t foundFlag = 0x80;
+
+	// The low 7 bits of the hash are the tag of RuleIndex, and its high bits pick the slot, so we use the bits in between.
+	static constexpr uint32_t SetIndex(uint32_t hash) { return (hash >> 7) & (setCount - 1); }
+
+	std::array<Set, setCount> sets = {};
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Counts how often each RUL2 override rule is matched, for tuning the RUL2 files (see EnableRUL2RuleProfiling in NAM.ini).
+//
+// The counters form an array parallel to the index, addressed by the position of a rule in the index
+// (the slot of RuleIndex or the entry of CompactRuleIndex, followed by the rules of WildcardRuleIndex),
+// so counting a match is a single increment.
+// As the positions change whenever the index is rebuilt, so do the counters.
+class RuleProfile
+{
+public:
+	enum Kind : uint32_t
+	{
+		Direct,  // the rule matched two cells
+		Adjacency,  // the rule was one of the steps of a match through surrogate tiles (see Rul2Rules::TryAdjacencies)
+		Prevent,  // the rule is a Prevent rule and matched two cells
+	};
+
+	struct Counters
+	{
+		std::array<uint32_t, 3> hits = {};  // indexed by Kind
+
+		uint64_t Total() const { return uint64_t(hits[Direct]) + hits[Adjacency] + hits[Prevent]; }
+	};
+
+	// Takes effect with the next Reset.
+	void SetEnabled(bool enabled) { this->enabled = enabled; }
+	bool IsEnabled() const { return enabled; }
+
+	// Clears the counters for an index with the given number of positions (none if disabled).
+	void Reset(size_t positionCount) { counters.assign(enabled ? positionCount : 0, {}); }
+
+	void Count(uint32_t position, Kind kind) { counters[position].hits[kind]++; }
+	const Counters& At(size_t position) const { return counters[position]; }
+	size_t PositionCount() const { return counters.size(); }
+
+private:
+	bool enabled = false;
+	std::vector<Counters> counters;
+};
@@ -0,0 +1,56 @@
+#include "RuleReachability.h"
+#include "Rul2Rules.h"
+#include <unordered_map>
+#include <unordered_set>
+
+RuleReachability::Result RuleReachability::Analyze(const std::vector<cSC4NetworkTileConflictRule>& rules, const std::vector<uint32_t>& seedIds)
+{
+	// the rules waiting for each of the IDs on their left side
+	std::unordered_map<uint32_t, std::vector<uint32_t>> rulesByLeftId;
+	std::vector<uint8_t> unreachableLeftIds(rules.size());
+	for (uint32_t i = 0; i < rules.size(); i++) {
+		const cSC4NetworkTileConflictRule& rule = rules[i];
+		rulesByLeftId[rule._1.id].push_back(i);
+		unreachableLeftIds[i]++;
+		if (rule._2.id != rule._1.id) {
+			rulesByLeftId[rule._2.id].push_back(i);
+			unreachableLeftIds[i]++;
+		}
+	}
+
+	Result result;
+	result.reachableRules.assign(rules.size(), 0);
+	std::unordered_set<uint32_t> reachableIds;
+	std::vector<uint32_t> queue;
+	auto reach = [&reachableIds, &queue](uint32_t id) {
+		if (reachableIds.insert(id).second) {
+			queue.push_back(id);
+		}
+	};
+	reach(0);
+	for (const uint32_t id : Rul2Rules::SurrogateTileIds()) {
+		reach(id);
+	}
+	for (const uint32_t id : seedIds) {
+		reach(id);
+	}
+
+	while (!queue.empty()) {
+		const uint32_t id = queue.back();
+		queue.pop_back();
+		const auto it = rulesByLeftId.find(id);
+		if (it == rulesByLeftId.end()) {
+			continue;
+		}
+		for (const uint32_t i : it->second) {
+			if (--unreachableLeftIds[i] == 0) {
+				result.reachableRules[i] = 1;
+				result.reachableRuleCount++;
+				reach(rules[i]._3.id);  // 0 for Prevent rules, which is reachable anyway
+				reach(rules[i]._4.id);
+			}
+		}
+	}
+	result.reachableIdCount = reachableIds.size();
+	return result;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Finds the RUL2 override rules that can never match, as one of the two tiles on their left side can never be built.
+//
+// A piece ID is reachable if it is a seed (e.g. a tile that RUL1 or a puzzle piece places), ID 0 (immovable neighbors),
+// a surrogate tile of Rul2Rules::TryAdjacencies, or the result of a rule whose left side is reachable.
+// The reachable IDs are computed as the least fixpoint of this. RotFlips are ignored, which keeps more rules than necessary, but never too few.
+namespace RuleReachability
+{
+	struct Result
+	{
+		std::vector<uint8_t> reachableRules;  // whether the rule at the same index can match
+		size_t reachableRuleCount = 0;
+		size_t reachableIdCount = 0;
+	};
+
+	Result Analyze(const std::vector<cSC4NetworkTileConflictRule>& rules, const std::vector<uint32_t>& seedIds);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// An append-only buffer of RUL2 override rules, as collected while the game loads the RUL2 files.
+//
+// The rules are stored in fixed-size chunks, so appending millions of rules never moves the rules appended before
+// (unlike a growing std::vector, which would copy all of them every time its capacity doubles),
+// and the final number of rules need not be known up front. There is a single writer, and a build takes over
+// the whole buffer by moving it, so the buffer needs no locking.
+class RuleStagingBuffer
+{
+public:
+	RuleStagingBuffer() = default;
+	RuleStagingBuffer(RuleStagingBuffer&& other) noexcept : chunks(std::move(other.chunks)), size(std::exchange(other.size, 0)) {}
+
+	RuleStagingBuffer& operator=(RuleStagingBuffer&& other) noexcept
+	{
+		chunks = std::move(other.chunks);
+		other.chunks.clear();
+		size = std::exchange(other.size, 0);
+		return *this;
+	}
+
+	void Push(const cSC4NetworkTileConflictRule& rule)
+	{
+		if ((size & (chunkSize - 1)) == 0) {
+			chunks.push_back(std::make_unique_for_overwrite<cSC4NetworkTileConflictRule[]>(chunkSize));
+		}
+		chunks.back()[size & (chunkSize - 1)] = rule;
+		size++;
+	}
+
+	const cSC4NetworkTileConflictRule& operator[](size_t i) const { return chunks[i >> chunkBits][i & (chunkSize - 1)]; }
+	size_t Size() const { return size; }
+	bool Empty() const { return size == 0; }
+
+	// Releases the memory of the rules before `end`, a multiple of chunkSize (or the size), once they have been consumed.
+	// Those rules must not be accessed anymore, but the size stays the same.
+	void ReleaseBefore(size_t end)
+	{
+		for (size_t i = 0; i < (end + chunkSize - 1) >> chunkBits; i++) {
+			chunks[i].reset();
+		}
+	}
+
+	template <typename F>
+	void ForEach(F&& f) const
+	{
+		for (size_t i = 0; i < size; i++) {
+			f((*this)[i]);
+		}
+	}
+
+	static constexpr size_t chunkBits = 14;
+	static constexpr size_t chunkSize = size_t(1) << chunkBits;  // 512 KB per chunk
+
+private:
+	std::vector<std::unique_ptr<cSC4NetworkTileConflictRule[]>> chunks;
+	size_t size = 0;
+};
@@ -0,0 +1,215 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NAM_HAS_SSE2
+#endif
+
+// The 4 symmetries under which two RUL2 override rules are the same, considering the two tiles to the left of the equality sign:
+// the identity and a vertical flip (R2F1) of both tiles, and, with swapped tiles, a rotation by 180 degrees (R2F0)
+// and a horizontal flip (R0F1). They are numbered in the order in which the game tries them, each of them is its own inverse,
+// and composing two of them amounts to XOR of their numbers.
+//
+// Equivalent rules share the same canonical key: the smallest of the 4 orientations of the two tiles (comparing
+// ID, RotFlip, ID, RotFlip in turn), together with the symmetry that maps the canonical orientation to the rule.
+// All the RotFlip arithmetic is done by tables generated at compile time.
+namespace RuleSymmetry
+{
+	enum Symmetry : uint8_t { Identity = 0, FlipVertically = 1, SwapRotate180 = 2, SwapFlipHorizontally = 3 };
+
+	constexpr bool IsSwapping(Symmetry symmetry)
+	{
+		return (symmetry & 0x2) != 0;
+	}
+
+	// maps RotFlip to range 0..7 (rotation = bit 0 and 1, flip = shifted from bit 7 to 2), preserving the order
+	constexpr uint32_t PackRotFlip(RotFlip rf)
+	{
+		return (rf & 0x3) | (rf >> 5);
+	}
+
+	constexpr RotFlip UnpackRotFlip(uint32_t x)
+	{
+		return static_cast<RotFlip>((x & 0x3) | ((x & 0x4) << 5));
+	}
+	static_assert(UnpackRotFlip(PackRotFlip(R3F1)) == R3F1);
+	static_assert(UnpackRotFlip(PackRotFlip(R2F0)) == R2F0);
+
+	// the symmetries only ever XOR a RotFlip with a constant
+	inline constexpr std::array<uint8_t, 4> rotFlipMasks = {R0F0, flipVertically(R0F0), rotate180(R0F0), flipHorizontally(R0F0)};
+
+	// Applies the symmetry to a pair of tiles, e.g. the two tiles to the left or to the right of the equality sign.
+	constexpr std::pair<Tile, Tile> Transform(Symmetry symmetry, const Tile& a, const Tile& b)
+	{
+		const uint8_t mask = rotFlipMasks[symmetry];
+		const Tile ta = {a.id, static_cast<RotFlip>(a.rf ^ mask)};
+		const Tile tb = {b.id, static_cast<RotFlip>(b.rf ^ mask)};
+		return IsSwapping(symmetry) ? std::make_pair(tb, ta) : std::make_pair(ta, tb);
+	}
+
+	// The canonical orientation of the first two tiles of a rule, packed such that comparing keys is integer comparison.
+	struct Key
+	{
+		uint64_t ids;  // first ID in the high 32 bits
+		uint8_t rotFlips;  // packed RotFlip of the first tile in bits 3-5, of the second tile in bits 0-2
+
+		constexpr uint32_t Id1() const { return static_cast<uint32_t>(ids >> 32); }
+		constexpr uint32_t Id2() const { return static_cast<uint32_t>(ids); }
+		constexpr Tile Tile1() const { return {Id1(), UnpackRotFlip(rotFlips >> 3)}; }
+		constexpr Tile Tile2() const { return {Id2(), UnpackRotFlip(rotFlips & 0x7)}; }
+
+		constexpr bool operator==(const Key& other) const { return ids == other.ids && rotFlips == other.rotFlips; }
+	};
+
+	struct CanonicalForm
+	{
+		Key key;
+		Symmetry symmetry;  // maps the canonical orientation to the original tiles and back
+	};
+
+	// The right side of a rule as stored in an index, in the orientation of the rule, and the symmetry that
+	// maps the canonical orientation of the left side to the orientation of the rule.
+	struct RuleOutput
+	{
+		Tile _3;
+		Tile _4;
+		Symmetry symmetry;
+	};
+
+	namespace Detail
+	{
+		constexpr uint32_t packRotFlips(uint32_t rf1, uint32_t rf2)
+		{
+			return (rf1 << 3) | rf2;
+		}
+
+		constexpr uint32_t transformRotFlips(Symmetry symmetry, uint32_t rotFlips)
+		{
+			const uint32_t mask = PackRotFlip(static_cast<RotFlip>(rotFlipMasks[symmetry]));
+			const uint32_t rf1 = (rotFlips >> 3) ^ mask;
+			const uint32_t rf2 = (rotFlips & 0x7) ^ mask;
+			return IsSwapping(symmetry) ? packRotFlips(rf2, rf1) : packRotFlips(rf1, rf2);
+		}
+
+		enum IdOrder : uint32_t { Ascending = 0, Descending = 1, Equal = 2 };
+
+		// For the order of the two IDs and the packed RotFlips, the canonical packed RotFlips (bits 0-5)
+		// and the symmetry leading to them (bits 6-7). Only the symmetries that put the smaller ID first are candidates.
+		inline constexpr std::array<std::array<uint8_t, 64>, 3> canonicalLookup = [] {
+			std::array<std::array<uint8_t, 64>, 3> table = {};
+			for (uint32_t order = Ascending; order <= Equal; order++) {
+				for (uint32_t rotFlips = 0; rotFlips < 64; rotFlips++) {
+					uint32_t best = 64;
+					uint32_t bestSymmetry = Identity;
+					for (uint32_t symmetry = 0; symmetry < 4; symmetry++) {
+						const bool swapping = IsSwapping(static_cast<Symmetry>(symmetry));
+						if ((order == Ascending && swapping) || (order == Descending && !swapping)) {
+							continue;
+						}
+						const uint32_t candidate = transformRotFlips(static_cast<Symmetry>(symmetry), rotFlips);
+						if (candidate < best) {
+							best = candidate;
+							bestSymmetry = symmetry;
+						}
+					}
+					table[order][rotFlips] = static_cast<uint8_t>(best | (bestSymmetry << 6));
+				}
+			}
+			return table;
+		}();
+
+		// For rules with the same ID on both tiles, the non-trivial symmetry (if any) that leaves the packed RotFlips unchanged.
+		// A vertical flip changes every RotFlip, so this can only be one of the swapping symmetries.
+		inline constexpr std::array<uint8_t, 64> stabilizerLookup = [] {
+			std::array<uint8_t, 64> table = {};
+			for (uint32_t rotFlips = 0; rotFlips < 64; rotFlips++) {
+				for (uint32_t symmetry = 1; symmetry < 4; symmetry++) {
+					if (transformRotFlips(static_cast<Symmetry>(symmetry), rotFlips) == rotFlips) {
+						table[rotFlips] = static_cast<uint8_t>(symmetry);
+					}
+				}
+			}
+			return table;
+		}();
+		static_assert(stabilizerLookup[packRotFlips(PackRotFlip(R1F0), PackRotFlip(R3F0))] == SwapRotate180);
+		static_assert(stabilizerLookup[packRotFlips(PackRotFlip(R0F0), PackRotFlip(R0F1))] == SwapFlipHorizontally);
+		static_assert(stabilizerLookup[packRotFlips(PackRotFlip(R1F0), PackRotFlip(R1F0))] == Identity);
+	}
+
+	constexpr CanonicalForm Canonicalize(const Tile& a, const Tile& b)
+	{
+		const uint32_t order = a.id < b.id ? Detail::Ascending : a.id > b.id ? Detail::Descending : Detail::Equal;
+		const uint8_t c = Detail::canonicalLookup[order][Detail::packRotFlips(PackRotFlip(a.rf), PackRotFlip(b.rf))];
+		const Symmetry symmetry = static_cast<Symmetry>(c >> 6);
+		const uint64_t ids = IsSwapping(symmetry) ? (uint64_t(b.id) << 32) | a.id : (uint64_t(a.id) << 32) | b.id;
+		return {{ids, static_cast<uint8_t>(c & 0x3f)}, symmetry};
+	}
+
+	constexpr CanonicalForm Canonicalize(const cSC4NetworkTileConflictRule& rule)
+	{
+		return Canonicalize(rule._1, rule._2);
+	}
+
+	// Hash of a canonical key. Its bits are spread across all 32 bits (finalizer of MurmurHash3),
+	// so that its high bits can pick a slot and its low bits a tag.
+	constexpr uint32_t Hash(const Key& key)
+	{
+		constexpr uint32_t prime = 66403;  // most ID information lies in bits 7-23 (17 bits), so prime should have at least 32-17 = 15 bits so as to shift much of the information around
+		uint32_t x = ((prime + key.Id1()) * prime + key.Id2()) * prime + key.rotFlips;
+		x ^= x >> 16;
+		x *= 0x85ebca6b;
+		x ^= x >> 13;
+		x *= 0xc2b2ae35;
+		x ^= x >> 16;
+		return x;
+	}
+
+	// Hash of 4 canonical keys at once, the same as Hash for each of them, for lookups done in batches.
+	// With SSE2 (always available on the game's i386 target), the 4 hashes are computed in the lanes of one vector.
+	inline void Hash4(const std::array<Key, 4>& keys, std::array<uint32_t, 4>& hashes)
+	{
+#ifdef NAM_HAS_SSE2
+		// SSE2 lacks a 32-bit multiplication, so it is composed of two 32x32->64 multiplications of the even and odd lanes
+		auto multiply = [](__m128i x, uint32_t factor) {
+			const __m128i f = _mm_set1_epi32(static_cast<int>(factor));
+			const __m128i even = _mm_mul_epu32(x, f);
+			const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(x, 32), f);
+			return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+		};
+		auto lanes = [&keys](auto field) {
+			return _mm_setr_epi32(static_cast<int>(field(keys[0])), static_cast<int>(field(keys[1])), static_cast<int>(field(keys[2])), static_cast<int>(field(keys[3])));
+		};
+		constexpr uint32_t prime = 66403;  // as in Hash
+		__m128i x = _mm_add_epi32(lanes([](const Key& key) { return key.Id1(); }), _mm_set1_epi32(prime));
+		x = _mm_add_epi32(multiply(x, prime), lanes([](const Key& key) { return key.Id2(); }));
+		x = _mm_add_epi32(multiply(x, prime), lanes([](const Key& key) { return uint32_t(key.rotFlips); }));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+		x = multiply(x, 0x85ebca6b);
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 13));
+		x = multiply(x, 0xc2b2ae35);
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(hashes.data()), x);
+#else
+		for (size_t i = 0; i < keys.size(); i++) {
+			hashes[i] = Hash(keys[i]);
+		}
+#endif
+	}
+
+	// The symmetry under which a stored rule applies to the looked-up tiles `lookup`, i.e. that maps the rule to the lookup.
+	// If the left side of the rule is symmetric itself, two symmetries qualify, and the game uses the first one it tries.
+	constexpr Symmetry Resolve(const CanonicalForm& lookup, Symmetry stored)
+	{
+		const uint32_t symmetry = lookup.symmetry ^ stored;
+		const uint32_t stabilizer = lookup.key.Id1() == lookup.key.Id2() ? Detail::stabilizerLookup[lookup.key.rotFlips] : Identity;
+		return static_cast<Symmetry>(std::min(symmetry, symmetry ^ stabilizer));
+	}
+
+	static_assert(Canonicalize({5, R1F0}, {5, R3F0}).symmetry == Identity);
+	static_assert(Canonicalize({7, R1F0}, {5, R1F0}).key.ids == ((uint64_t(5) << 32) | 7));
+	static_assert(Transform(SwapRotate180, {7, R1F0}, {5, R1F0}).first.rf == R3F0);
+}
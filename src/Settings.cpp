@@ -1,6 +1,7 @@
 #include "Settings.h"
 #include "Logger.h"
 #include "mini/ini.h"
+#include <charconv>
 
 Settings::Settings() :
 	enableDiagonalStreets(true),
@@ -8,6 +9,15 @@ Settings::Settings() :
 	enableTunnels(true),
 	reduceFerryBridgeHeightPatch(true),
 	enableRUL2EnginePatch(true),
+	enableRUL2IndexCache(true),
+	enableCompactRUL2Index(false),
+	enableIncrementalRUL2Evaluation(false),
+	enableRUL2SolutionCache(false),
+	enableRUL2DragTrace(false),
+	enableRUL2RuleProfiling(false),
+	enableRUL2CycleDetection(false),
+	rul2TimeBudgetMillis(0),
+	keepRUL2OverridesOnTimeout(false),
 	enableNetworkSlopePatch(true),
 	enableFlexPuzzlePiecePatch(true),
 	enableCommuteLoopPatch(true),
@@ -23,12 +33,34 @@ void Settings::Load(std::filesystem::path settingsFilePath)
 			auto readBoolProp = [&ini](const std::string propName, bool &propValue) {
 				propValue ^= ini.get("NAM").get(propName) == (propValue ? "false" : "true");  // toggle if opposite of default
 			};
+			auto readUIntProp = [&ini, &logger](const std::string propName, uint32_t &propValue) {
+				const std::string value = ini.get("NAM").get(propName);
+				if (value.empty()) {
+					return;  // keep the default
+				}
+				uint32_t parsedValue;
+				const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), parsedValue);
+				if (ec == std::errc() && ptr == value.data() + value.size()) {
+					propValue = parsedValue;
+				} else {
+					logger.WriteLineFormatted(LogLevel::Error, "Invalid value of %s in the settings file: %s", propName.c_str(), value.c_str());
+				}
+			};
 			readBoolProp("EnableKeyboardShortcuts", enableKeyboardShortcuts);
 			readBoolProp("EnableDiagonalStreets", enableDiagonalStreets);
 			readBoolProp("DisableAutoconnect", disableAutoconnect);
 			readBoolProp("EnableTunnels", enableTunnels);
 			readBoolProp("ReduceFerryBridgeHeight", reduceFerryBridgeHeightPatch);
 			readBoolProp("EnableRUL2EnginePatch", enableRUL2EnginePatch);
+			readBoolProp("EnableRUL2IndexCache", enableRUL2IndexCache);
+			readBoolProp("EnableCompactRUL2Index", enableCompactRUL2Index);
+			readBoolProp("EnableIncrementalRUL2Evaluation", enableIncrementalRUL2Evaluation);
+			readBoolProp("EnableRUL2SolutionCache", enableRUL2SolutionCache);
+			readBoolProp("EnableRUL2DragTrace", enableRUL2DragTrace);
+			readBoolProp("EnableRUL2RuleProfiling", enableRUL2RuleProfiling);
+			readBoolProp("EnableRUL2CycleDetection", enableRUL2CycleDetection);
+			readUIntProp("RUL2TimeBudget", rul2TimeBudgetMillis);
+			readBoolProp("KeepRUL2OverridesOnTimeout", keepRUL2OverridesOnTimeout);
 			readBoolProp("EnableNetworkSlopePatch", enableNetworkSlopePatch);
 			readBoolProp("EnableFlexPuzzlePiecePatch", enableFlexPuzzlePiecePatch);
 			readBoolProp("EnableCommuteLoopPatch", enableCommuteLoopPatch);
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <filesystem>
 
 class Settings final
@@ -12,6 +13,15 @@ public:
 	bool enableTunnels;
 	bool reduceFerryBridgeHeightPatch;
 	bool enableRUL2EnginePatch;
+	bool enableRUL2IndexCache;
+	bool enableCompactRUL2Index;
+	bool enableIncrementalRUL2Evaluation;
+	bool enableRUL2SolutionCache;
+	bool enableRUL2DragTrace;
+	bool enableRUL2RuleProfiling;
+	bool enableRUL2CycleDetection;
+	uint32_t rul2TimeBudgetMillis;  // 0 = unlimited
+	bool keepRUL2OverridesOnTimeout;
 	bool enableNetworkSlopePatch;
 	bool enableFlexPuzzlePiecePatch;
 	bool enableCommuteLoopPatch;
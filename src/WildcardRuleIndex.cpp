@@ -0,0 +1,74 @@
+#include "WildcardRuleIndex.h"
+#include "RuleSymmetry.h"
+#include <algorithm>
+#include <unordered_set>
+
+namespace
+{
+	constexpr uint64_t tileKey(const Tile& tile)
+	{
+		return (uint64_t(tile.id) << 8) | tile.rf;
+	}
+}
+
+void WildcardRuleIndex::Add(const std::vector<OrderedRule>& newRules)
+{
+	std::unordered_set<uint64_t> addedKeys;
+	const size_t oldEntryCount = entries.size();
+	for (const OrderedRule& ordered : newRules) {
+		const cSC4NetworkTileConflictRule& rule = ordered.rule;
+		if (rule._2.id != 0) {
+			const RuleSymmetry::Key key = RuleSymmetry::Canonicalize(rule._1, rule._2).key;
+			const auto it = std::lower_bound(indexedRules.begin(), indexedRules.end(), key);
+			if (it == indexedRules.end() || it->ids != key.ids || it->rotFlips != key.rotFlips) {
+				indexedRules.insert(it, {key.ids, key.rotFlips, ordered.ordinal});
+				records.push_back(ordered);
+			}
+			continue;
+		}
+		Tile t3, t4;
+		uint32_t position, ordinal;
+		if (addedKeys.count(tileKey(rule._1)) != 0 || Find(rule._1, t3, t4, position, ordinal)) {
+			continue;  // equivalent to an earlier rule, which wins
+		}
+		for (const auto symmetry : {RuleSymmetry::Identity, RuleSymmetry::FlipVertically}) {
+			const Tile first = RuleSymmetry::Transform(symmetry, rule._1, rule._2).first;
+			const auto [o3, o4] = RuleSymmetry::Transform(symmetry, rule._3, rule._4);
+			entries.push_back({tileKey(first), o3, o4, static_cast<uint32_t>(rules.size()), ordered.ordinal});
+			addedKeys.insert(tileKey(first));
+		}
+		rules.push_back(rule);
+		records.push_back(ordered);
+	}
+	// the keys are distinct, as the vertical flip changes every RotFlip
+	std::sort(entries.begin() + oldEntryCount, entries.end(), [](const Entry& p, const Entry& q) { return p.key < q.key; });
+	std::inplace_merge(entries.begin(), entries.begin() + oldEntryCount, entries.end(), [](const Entry& p, const Entry& q) { return p.key < q.key; });
+}
+
+void WildcardRuleIndex::Clear()
+{
+	rules.clear();
+	entries.clear();
+	indexedRules.clear();
+	records.clear();
+}
+
+bool WildcardRuleIndex::Find(const Tile& first, Tile& t3, Tile& t4, uint32_t& position, uint32_t& ordinal) const
+{
+	const uint64_t key = tileKey(first);
+	const auto it = std::lower_bound(entries.begin(), entries.end(), key, [](const Entry& entry, uint64_t k) { return entry.key < k; });
+	if (it == entries.end() || it->key != key) {
+		return false;
+	}
+	t3 = it->_3;
+	t4 = it->_4;
+	position = it->rule;
+	ordinal = it->ordinal;
+	return true;
+}
+
+bool WildcardRuleIndex::FindIndexedRule(const RuleSymmetry::Key& key, uint32_t ordinal) const
+{
+	const auto it = std::lower_bound(indexedRules.begin(), indexedRules.end(), key);
+	return it != indexedRules.end() && it->ids == key.ids && it->rotFlips == key.rotFlips && it->ordinal < ordinal;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include "RuleSymmetry.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The RUL2 override rules with ID 0 as second tile (e.g. next to bridges), which match the tiles next to immovable
+// occupants and network lots, as the solver looks those up with ID 0 in any RotFlip.
+//
+// The rules are keyed by their first tile only (relative to the direction of the lookup, like all RUL2 tiles).
+// Of the 4 symmetries of RuleSymmetry, only the identity and the vertical flip keep ID 0 as second tile,
+// so each rule is stored in these two orientations, sorted by the first tile, and the swapped orientations
+// are handled by the caller. There are only a few of these rules, which keeps them out of the main index.
+//
+// A rule of the main index with ID 0 as first tile can be equivalent to a wildcard rule for one RotFlip of ID 0,
+// in which case the rule added first wins, as for any two equivalent rules. So the index also keeps the canonical keys
+// of these rules, and each rule comes with its ordinal in the stream of rules loaded by the game.
+class WildcardRuleIndex
+{
+public:
+	struct OrderedRule
+	{
+		cSC4NetworkTileConflictRule rule;
+		uint32_t ordinal;  // the number of rules loaded before it
+	};
+	static_assert(sizeof(OrderedRule) == 36);
+
+	// Adds rules with ID 0 as second tile, keeping the first of several equivalent rules (including the rules added before),
+	// and notes the rules with ID 0 as first tile only, which go into the main index as well. The ordinals must increase.
+	void Add(const std::vector<OrderedRule>& newRules);
+	void Clear();
+
+	// Looks up the rule for the first tile next to a tile with ID 0, storing its output in the orientation of the lookup.
+	// The position is the index of the rule in the order in which the rules were added.
+	bool Find(const Tile& first, Tile& t3, Tile& t4, uint32_t& position, uint32_t& ordinal) const;
+
+	// Whether a rule of the main index with the given canonical key was loaded before the rule with the given ordinal.
+	bool HasEarlierIndexedRule(const RuleSymmetry::Key& key, uint32_t ordinal) const
+	{
+		return !indexedRules.empty() && FindIndexedRule(key, ordinal);
+	}
+
+	template <typename F>
+	void ForEachRule(F&& f) const
+	{
+		for (const cSC4NetworkTileConflictRule& rule : rules) {
+			f(rule);
+		}
+	}
+
+	template <typename F>
+	void ForEachRuleWithPosition(F&& f) const
+	{
+		for (size_t i = 0; i < rules.size(); i++) {
+			f(i, rules[i]);
+		}
+	}
+
+	// the rules kept by Add, as passed to it, e.g. for RuleIndexCache
+	const std::vector<OrderedRule>& Records() const { return records; }
+	size_t Size() const { return rules.size(); }
+	size_t MemoryUsage() const
+	{
+		return rules.capacity() * sizeof(cSC4NetworkTileConflictRule) + entries.capacity() * sizeof(Entry) +
+			records.capacity() * sizeof(OrderedRule) + indexedRules.capacity() * sizeof(IndexedRule);
+	}
+
+private:
+	struct Entry
+	{
+		uint64_t key;  // the first tile
+		Tile _3;
+		Tile _4;
+		uint32_t rule;
+		uint32_t ordinal;
+	};
+
+	// a rule of the main index with ID 0 as first tile
+	struct IndexedRule
+	{
+		uint64_t ids;  // of RuleSymmetry::Key
+		uint8_t rotFlips;  // of RuleSymmetry::Key
+		uint32_t ordinal;
+
+		bool operator<(const RuleSymmetry::Key& key) const { return ids < key.ids || (ids == key.ids && rotFlips < key.rotFlips); }
+	};
+
+	bool FindIndexedRule(const RuleSymmetry::Key& key, uint32_t ordinal) const;
+
+	std::vector<cSC4NetworkTileConflictRule> rules;  // with ID 0 as second tile, as added
+	std::vector<Entry> entries;  // sorted by key
+	std::vector<IndexedRule> indexedRules;  // sorted by key
+	std::vector<OrderedRule> records;
+};
@@ -0,0 +1,198 @@
+#include "Dbpf.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace
+{
+	constexpr char dbpfMagic[4] = {'D', 'B', 'P', 'F'};
+
+	// the directory of compressed entries
+	constexpr uint32_t dirType = 0xe86b1eef;
+	constexpr uint32_t dirGroup = 0xe86b1eef;
+	constexpr uint32_t dirInstance = 0x286b1f03;
+
+	struct IndexEntry
+	{
+		uint32_t type;
+		uint32_t group;
+		uint32_t instance;
+		uint32_t offset;
+		uint32_t size;
+	};
+	static_assert(sizeof(IndexEntry) == 20);
+
+	struct DirEntry
+	{
+		uint32_t type;
+		uint32_t group;
+		uint32_t instance;
+		uint32_t decompressedSize;
+	};
+	static_assert(sizeof(DirEntry) == 16);
+
+	uint32_t readUint32(const std::vector<uint8_t>& file, size_t offset)
+	{
+		if (offset + 4 > file.size()) {
+			throw std::runtime_error("Corrupt DBPF file.");
+		}
+		uint32_t value;
+		std::memcpy(&value, file.data() + offset, sizeof(value));
+		return value;
+	}
+
+	template <typename T>
+	std::vector<T> readTable(const std::vector<uint8_t>& file, uint64_t offset, uint64_t size)
+	{
+		if (offset + size > file.size()) {
+			throw std::runtime_error("Corrupt DBPF file.");
+		}
+		std::vector<T> table(size / sizeof(T));
+		std::memcpy(table.data(), file.data() + offset, table.size() * sizeof(T));
+		return table;
+	}
+}
+
+bool Dbpf::IsDbpfFile(const std::filesystem::path& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		throw std::runtime_error("Failed to open " + path.string());
+	}
+	char magic[4] = {};
+	in.read(magic, sizeof(magic));
+	return in && std::memcmp(magic, dbpfMagic, sizeof(dbpfMagic)) == 0;
+}
+
+std::vector<Dbpf::Entry> Dbpf::ReadEntries(const std::filesystem::path& path, uint32_t type, uint32_t group, uint32_t instance)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		throw std::runtime_error("Failed to open " + path.string());
+	}
+	const std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (file.size() < 0x60 || std::memcmp(file.data(), dbpfMagic, sizeof(dbpfMagic)) != 0) {
+		throw std::runtime_error("Not a DBPF file: " + path.string());
+	}
+	const uint32_t majorVersion = readUint32(file, 0x04);
+	const uint32_t indexMajorVersion = readUint32(file, 0x20);
+	if (majorVersion != 1 || indexMajorVersion != 7) {
+		throw std::runtime_error("Unsupported DBPF version: " + path.string());
+	}
+	const uint32_t indexCount = readUint32(file, 0x24);
+	const uint32_t indexOffset = readUint32(file, 0x28);
+	const uint32_t indexSize = readUint32(file, 0x2c);
+	if (static_cast<uint64_t>(indexCount) * sizeof(IndexEntry) > indexSize) {
+		throw std::runtime_error("Corrupt DBPF index: " + path.string());
+	}
+	const std::vector<IndexEntry> index = readTable<IndexEntry>(file, indexOffset, static_cast<uint64_t>(indexCount) * sizeof(IndexEntry));
+
+	std::vector<DirEntry> dir;
+	for (const IndexEntry& entry : index) {
+		if (entry.type == dirType && entry.group == dirGroup && entry.instance == dirInstance) {
+			dir = readTable<DirEntry>(file, entry.offset, entry.size);
+		}
+	}
+	auto isCompressed = [&dir](const IndexEntry& entry) {
+		for (const DirEntry& d : dir) {
+			if (d.type == entry.type && d.group == entry.group && d.instance == entry.instance) {
+				return true;
+			}
+		}
+		return false;
+	};
+
+	std::vector<Entry> entries;
+	for (const IndexEntry& entry : index) {
+		if (entry.type != type || entry.group != group || entry.instance != instance) {
+			continue;
+		}
+		if (static_cast<uint64_t>(entry.offset) + entry.size > file.size()) {
+			throw std::runtime_error("Corrupt DBPF entry: " + path.string());
+		}
+		const uint8_t* data = file.data() + entry.offset;
+		entries.push_back({entry.type, entry.group, entry.instance,
+				isCompressed(entry) ? DecompressQfs(data, entry.size) : std::vector<uint8_t>(data, data + entry.size)});
+	}
+	return entries;
+}
+
+// The header consists of the compressed size (4 bytes), the magic 0x10FB and the decompressed size (3 bytes, big endian),
+// followed by control codes, each of which copies some literal bytes from the input and then some bytes from the output.
+std::vector<uint8_t> Dbpf::DecompressQfs(const uint8_t* data, size_t size)
+{
+	if (size < 9 || data[4] != 0x10 || data[5] != 0xfb) {
+		throw std::runtime_error("Corrupt QFS data.");
+	}
+	const size_t decompressedSize = (data[6] << 16) | (data[7] << 8) | data[8];
+	std::vector<uint8_t> out;
+	out.reserve(decompressedSize);
+
+	size_t pos = 9;
+	auto need = [&](size_t n) {
+		if (pos + n > size) {
+			throw std::runtime_error("Truncated QFS data.");
+		}
+	};
+	while (pos < size) {
+		need(1);
+		const uint8_t b0 = data[pos];
+		size_t plain = 0;
+		size_t copy = 0;
+		size_t offset = 0;
+		bool last = false;
+		if (b0 < 0x80) {
+			need(2);
+			const uint8_t b1 = data[pos + 1];
+			pos += 2;
+			plain = b0 & 0x03;
+			copy = ((b0 & 0x1c) >> 2) + 3;
+			offset = ((b0 & 0x60) << 3) + b1 + 1;
+		} else if (b0 < 0xc0) {
+			need(3);
+			const uint8_t b1 = data[pos + 1];
+			const uint8_t b2 = data[pos + 2];
+			pos += 3;
+			plain = (b1 >> 6) & 0x03;
+			copy = (b0 & 0x3f) + 4;
+			offset = ((b1 & 0x3f) << 8) + b2 + 1;
+		} else if (b0 < 0xe0) {
+			need(4);
+			const uint8_t b1 = data[pos + 1];
+			const uint8_t b2 = data[pos + 2];
+			const uint8_t b3 = data[pos + 3];
+			pos += 4;
+			plain = b0 & 0x03;
+			copy = ((b0 & 0x0c) << 6) + b3 + 5;
+			offset = ((b0 & 0x10) << 12) + (b1 << 8) + b2 + 1;
+		} else if (b0 < 0xfc) {
+			pos += 1;
+			plain = ((b0 & 0x1f) << 2) + 4;
+		} else {
+			pos += 1;
+			plain = b0 & 0x03;
+			last = true;
+		}
+
+		need(plain);
+		out.insert(out.end(), data + pos, data + pos + plain);
+		pos += plain;
+		if (copy > 0) {
+			if (offset > out.size()) {
+				throw std::runtime_error("Corrupt QFS data.");
+			}
+			const size_t from = out.size() - offset;
+			for (size_t i = 0; i < copy; i++) {
+				out.push_back(out[from + i]);  // the ranges may overlap
+			}
+		}
+		if (last) {
+			break;
+		}
+	}
+	if (out.size() != decompressedSize) {
+		throw std::runtime_error("Corrupt QFS data.");
+	}
+	return out;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Minimal reader of the DBPF files of SimCity 4 (version 1.0 with index version 7.0), as needed by the RUL2 tools.
+namespace Dbpf
+{
+	constexpr uint32_t rul2Type = 0x0a5bcf4b;
+	constexpr uint32_t rul2Group = 0xaa5bcf57;
+	constexpr uint32_t rul2Instance = 0x10000000;
+
+	struct Entry
+	{
+		uint32_t type;
+		uint32_t group;
+		uint32_t instance;
+		std::vector<uint8_t> data;  // decompressed
+	};
+
+	// Whether the file starts with the DBPF magic. Throws if the file cannot be read.
+	bool IsDbpfFile(const std::filesystem::path& path);
+
+	// Reads the entries with the given type, group and instance, in the order of the index.
+	// Throws if the file cannot be read or is corrupt.
+	std::vector<Entry> ReadEntries(const std::filesystem::path& path, uint32_t type, uint32_t group, uint32_t instance);
+
+	// Decompresses QFS (RefPack) data as stored in DBPF files, starting with the 4-byte compressed size.
+	// Throws if the data is corrupt.
+	std::vector<uint8_t> DecompressQfs(const uint8_t* data, size_t size);
+}
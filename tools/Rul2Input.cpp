@@ -0,0 +1,43 @@
+#include "Rul2Input.h"
+#include "Dbpf.h"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+std::string Rul2Input::ReadFile(const std::filesystem::path& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		throw std::runtime_error("Failed to open " + path.string());
+	}
+	return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+uint32_t Rul2Input::ReadRules(const std::vector<std::filesystem::path>& inputs, uint32_t threadCount, std::vector<SourceRule>& rules)
+{
+	uint32_t errorCount = 0;
+	for (uint32_t file = 0; file < inputs.size(); file++) {
+		std::vector<std::string> texts;
+		if (Dbpf::IsDbpfFile(inputs[file])) {
+			for (const Dbpf::Entry& entry : Dbpf::ReadEntries(inputs[file], Dbpf::rul2Type, Dbpf::rul2Group, Dbpf::rul2Instance)) {
+				texts.emplace_back(entry.data.begin(), entry.data.end());
+			}
+		} else {
+			texts.push_back(ReadFile(inputs[file]));
+		}
+		for (const std::string& text : texts) {
+			std::vector<Rul2Text::ParsedRule> parsedRules;
+			std::vector<Rul2Text::ParseError> errors;
+			Rul2Text::ParseParallel(text, threadCount, parsedRules, errors);
+			for (const Rul2Text::ParseError& error : errors) {
+				std::fprintf(stderr, "%s:%u: %s\n", inputs[file].string().c_str(), error.line, error.message.c_str());
+			}
+			errorCount += static_cast<uint32_t>(errors.size());
+			for (const Rul2Text::ParsedRule& rule : parsedRules) {
+				rules.push_back({rule, file});
+			}
+		}
+	}
+	return errorCount;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "Rul2Text.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Reads the input files of the RUL2 tools, which are RUL2 text files or DBPF files containing RUL2 entries.
+namespace Rul2Input
+{
+	struct SourceRule
+	{
+		Rul2Text::ParsedRule parsed;
+		uint32_t file;  // index into the input files
+	};
+
+	// Reads a file into a string. Throws if the file cannot be read.
+	std::string ReadFile(const std::filesystem::path& path);
+
+	// Parses the rules of the input files in the given order (the order in which the game would load them) with the given number of threads,
+	// appending them to `rules`. Prints the invalid lines with their file and line number, and returns their number.
+	// Throws if a file cannot be read or is corrupt.
+	uint32_t ReadRules(const std::vector<std::filesystem::path>& inputs, uint32_t threadCount, std::vector<SourceRule>& rules);
+}
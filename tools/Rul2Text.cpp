@@ -0,0 +1,157 @@
+#include "Rul2Text.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+	class LineParser
+	{
+	public:
+		explicit LineParser(std::string_view line) : rest(line) {}
+
+		// Parses a decimal or hexadecimal (0x) number, followed by `separator` unless it is the last number.
+		bool Number(uint32_t& value, char separator)
+		{
+			SkipSpaces();
+			int base = 10;
+			if (rest.size() >= 2 && rest[0] == '0' && (rest[1] == 'x' || rest[1] == 'X')) {
+				rest.remove_prefix(2);
+				base = 16;
+			}
+			const auto [ptr, ec] = std::from_chars(rest.data(), rest.data() + rest.size(), value, base);
+			if (ec != std::errc() || ptr == rest.data()) {
+				return false;
+			}
+			rest.remove_prefix(ptr - rest.data());
+			SkipSpaces();
+			if (separator == '\0') {
+				return rest.empty();
+			} else if (rest.empty() || rest[0] != separator) {
+				return false;
+			}
+			rest.remove_prefix(1);
+			return true;
+		}
+
+		bool Tile(::Tile& tile, char separator, std::string& error)
+		{
+			uint32_t rotation;
+			uint32_t flip;
+			if (!Number(tile.id, ',') || !Number(rotation, ',') || !Number(flip, separator)) {
+				error = "expected a tile of the form ID,rotation,flip";
+				return false;
+			} else if (rotation > 3 || flip > 1) {
+				error = "rotation must be 0-3 and flip must be 0 or 1";
+				return false;
+			}
+			tile.rf = static_cast<RotFlip>(rotation | (flip << 7));
+			return true;
+		}
+
+		bool Prefix(uint8_t& prefix)
+		{
+			uint32_t value;
+			if (!Number(value, ',') || value > 0xff) {
+				return false;
+			}
+			prefix = static_cast<uint8_t>(value);
+			return true;
+		}
+
+	private:
+		void SkipSpaces()
+		{
+			while (!rest.empty() && (rest[0] == ' ' || rest[0] == '\t')) {
+				rest.remove_prefix(1);
+			}
+		}
+
+		std::string_view rest;
+	};
+
+	std::string_view trim(std::string_view s)
+	{
+		const size_t begin = s.find_first_not_of(" \t\r");
+		if (begin == std::string_view::npos) {
+			return {};
+		}
+		return s.substr(begin, s.find_last_not_of(" \t\r") + 1 - begin);
+	}
+}
+
+void Rul2Text::Parse(std::string_view text, uint32_t firstLine, std::vector<ParsedRule>& rules, std::vector<ParseError>& errors)
+{
+	uint32_t lineNumber = firstLine;
+	while (!text.empty()) {
+		const size_t end = text.find('\n');
+		std::string_view line = text.substr(0, end);
+		text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+		line = trim(line.substr(0, line.find(';')));
+		if (!line.empty()) {
+			ParsedRule parsed = {{}, 0, 0, lineNumber};
+			std::string error;
+			LineParser parser(line);
+			if (!parser.Prefix(parsed.leftPrefix) ||
+				!parser.Tile(parsed.rule._1, ',', error) ||
+				!parser.Tile(parsed.rule._2, '=', error) ||
+				!parser.Prefix(parsed.rightPrefix) ||
+				!parser.Tile(parsed.rule._3, ',', error) ||
+				!parser.Tile(parsed.rule._4, '\0', error))
+			{
+				errors.push_back({lineNumber, error.empty() ? "expected a rule of the form 1,tile1,tile2=2,tile3,tile4" : error});
+			} else {
+				rules.push_back(parsed);
+			}
+		}
+		lineNumber++;
+	}
+}
+
+void Rul2Text::ParseParallel(std::string_view text, uint32_t threadCount, std::vector<ParsedRule>& rules, std::vector<ParseError>& errors)
+{
+	threadCount = std::max<uint32_t>(1, std::min<uint32_t>(threadCount, static_cast<uint32_t>(text.size() / (1 << 16)) + 1));
+
+	// split into chunks of whole lines
+	std::vector<std::string_view> chunks;
+	std::vector<uint32_t> firstLines;
+	uint32_t lineNumber = 1;
+	while (!text.empty()) {
+		size_t end = std::min(text.size(), text.size() / (threadCount - chunks.size()) + 1);
+		end = text.find('\n', end - 1);
+		end = end == std::string_view::npos ? text.size() : end + 1;
+		const std::string_view chunk = text.substr(0, end);
+		chunks.push_back(chunk);
+		firstLines.push_back(lineNumber);
+		lineNumber += static_cast<uint32_t>(std::count(chunk.begin(), chunk.end(), '\n'));
+		text.remove_prefix(end);
+	}
+
+	std::vector<std::vector<ParsedRule>> chunkRules(chunks.size());
+	std::vector<std::vector<ParseError>> chunkErrors(chunks.size());
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		threads.emplace_back([&, i]() { Parse(chunks[i], firstLines[i], chunkRules[i], chunkErrors[i]); });
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	for (size_t i = 0; i < chunks.size(); i++) {
+		rules.insert(rules.end(), chunkRules[i].begin(), chunkRules[i].end());
+		errors.insert(errors.end(), chunkErrors[i].begin(), chunkErrors[i].end());
+	}
+}
+
+std::string Rul2Text::Format(const ParsedRule& parsed)
+{
+	const cSC4NetworkTileConflictRule& r = parsed.rule;
+	auto rot = [](const Tile& t) { return t.rf & 3; };
+	auto flip = [](const Tile& t) { return t.rf >> 7; };
+	char buffer[128];
+	std::snprintf(buffer, sizeof(buffer), "%u,0x%08X,%u,%u,0x%08X,%u,%u=%u,0x%08X,%u,%u,0x%08X,%u,%u",
+			parsed.leftPrefix, r._1.id, rot(r._1), flip(r._1), r._2.id, rot(r._2), flip(r._2),
+			parsed.rightPrefix, r._3.id, rot(r._3), flip(r._3), r._4.id, rot(r._4), flip(r._4));
+	return buffer;
+}
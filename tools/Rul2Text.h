@@ -0,0 +1,37 @@
+#pragma once
+#include "cSC4NetworkTileConflictRule.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Parser and printer of the RUL2 text format, in which each override rule is a line of the form
+//
+//   1,0x5D540000,1,0,0x5D540000,1,0=2,0x5D540100,1,0,0x5D540000,1,0
+//
+// where each tile consists of the ID, the rotation (0-3) and the flip (0 or 1). The numbers in front of the tiles are kept as they are.
+// Comments start with a semicolon.
+namespace Rul2Text
+{
+	struct ParsedRule
+	{
+		cSC4NetworkTileConflictRule rule;
+		uint8_t leftPrefix;
+		uint8_t rightPrefix;
+		uint32_t line;  // 1-based
+	};
+
+	struct ParseError
+	{
+		uint32_t line;  // 1-based
+		std::string message;
+	};
+
+	// Parses the lines of the text, numbering them from `firstLine`.
+	void Parse(std::string_view text, uint32_t firstLine, std::vector<ParsedRule>& rules, std::vector<ParseError>& errors);
+
+	// Parses the text with the given number of threads, splitting it into chunks of whole lines. The rules are returned in order of the text.
+	void ParseParallel(std::string_view text, uint32_t threadCount, std::vector<ParsedRule>& rules, std::vector<ParseError>& errors);
+
+	std::string Format(const ParsedRule& rule);
+}
@@ -0,0 +1,529 @@
+// Benchmark of the RUL2 engine outside of the game, using synthetic rules and a synthetic network world.
+//
+// Build and run on Linux (from the repository root):
+//
+//   make bench && ./build/rul2bench [fillerRuleCount] [dragCount] [traceFolder]
+//
+// If a trace folder is given, the full evaluation of the drags with the solution cache and the flat index is recorded in a trace file
+// in this folder, together with the cache file of the index, for testing tools/rul2replay.
+// The rules consist of override rules for parallel networks, which are actually exercised by the generated drags,
+// and random filler rules, which mimic the size of the RUL2 files of the NAM.
+#include "Rul2Rules.h"
+#include "Rul2Solver.h"
+#include "Rul2World.h"
+#include "Rul2Trace.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr uint32_t gridSize = 256;
+	constexpr uint32_t networkCount = 32;
+	constexpr uint32_t fillerIdCount = 30000;
+
+	constexpr uint32_t makeXZ(uint32_t x, uint32_t z) { return (z << 16) | x; }
+
+	// straight piece of network k in N-S direction at R0F0
+	constexpr uint32_t straightId(uint32_t k) { return 0x50000000 + k * 0x100; }
+	// straight piece of network k next to a parallel network j
+	constexpr uint32_t parallelId(uint32_t k, uint32_t j) { return 0x60000000 + (k * networkCount + j) * 0x10; }
+	constexpr uint32_t fillerId(uint32_t i) { return 0x70000000 + i * 0x10; }
+
+	// A dense grid of cells, outside of which there are no cell infos.
+	class GridWorld final : public Rul2World
+	{
+	public:
+		GridWorld() : cells(gridSize * gridSize) {}
+
+		void Place(uint32_t xz, uint32_t id, RotFlip rf)
+		{
+			Rul2WorldCell& cell = At(xz);
+			cell.hasOccupant = true;
+			cell.id = id;
+			cell.rf = rf;
+		}
+
+		// Marks the dragged cells as part of the cells buffer, as the network tool does before solving them.
+		void BeginDrag(const std::vector<Rul2Cell>& dragged)
+		{
+			for (uint32_t i = 0; i < dragged.size(); i++) {
+				SetCellsBufferIndex(dragged[i].xz, i);
+			}
+		}
+
+		void EndDrag()
+		{
+			for (const uint32_t xz : touched) {
+				At(xz).idxInCellsBuffer = -1;
+			}
+			touched.clear();
+		}
+
+		bool GetCell(uint32_t xz, Rul2WorldCell& cell) override
+		{
+			if ((xz & 0xffff) >= gridSize || (xz >> 16) >= gridSize) {
+				return false;
+			}
+			cell = At(xz);
+			return true;
+		}
+
+		void SetCellsBufferIndex(uint32_t xz, int32_t idx) override
+		{
+			At(xz).idxInCellsBuffer = idx;
+			touched.push_back(xz);
+		}
+
+	private:
+		Rul2WorldCell& At(uint32_t xz) { return cells[(xz >> 16) * gridSize + (xz & 0xffff)]; }
+
+		std::vector<Rul2WorldCell> cells;
+		std::vector<uint32_t> touched;
+	};
+
+	void addRules(Rul2Rules& rules, uint32_t fillerRuleCount, std::mt19937& rng)
+	{
+		for (uint32_t k = 0; k < networkCount; k++) {
+			for (uint32_t j = 0; j < networkCount; j++) {
+				// network k west of a parallel network j (relative to direction east, so the rotations are absolute)
+				rules.AddRule({{straightId(k), R0F0}, {straightId(j), R0F0}, {parallelId(k, j), R0F0}, {straightId(j), R0F0}});
+				// the parallel piece propagates southwards along network k (relative to direction south)
+				rules.AddRule({{parallelId(k, j), R3F0}, {straightId(k), R3F0}, {parallelId(k, j), R3F0}, {parallelId(k, j), R3F0}});
+			}
+		}
+		std::uniform_int_distribution<uint32_t> idDist(0, fillerIdCount - 1);
+		std::uniform_int_distribution<uint32_t> rfDist(0, 7);
+		auto randomTile = [&]() { return Tile{fillerId(idDist(rng)), rotFlipValues[rfDist(rng)]}; };
+		for (uint32_t i = 0; i < fillerRuleCount; i++) {
+			rules.AddRule({randomTile(), randomTile(), randomTile(), randomTile()});
+		}
+	}
+
+	struct Drag
+	{
+		uint32_t network;
+		uint32_t x;
+		uint32_t z;
+		uint32_t length;
+		bool northwards;  // otherwise the drag starts at (x, z) and extends southwards, else it starts at (x, z + length - 1)
+	};
+
+	// Existing N-S networks in every fourth column, covering the northern half of the grid, so that the overrides of drags across the middle need to propagate.
+	void buildWorld(GridWorld& world, std::mt19937& rng)
+	{
+		std::uniform_int_distribution<uint32_t> networkDist(0, networkCount - 1);
+		for (uint32_t x = 3; x < gridSize; x += 4) {
+			const uint32_t network = networkDist(rng);
+			for (uint32_t z = 0; z < gridSize / 2; z++) {
+				world.Place(makeXZ(x, z), straightId(network), R0F0);
+			}
+		}
+	}
+
+	std::vector<Drag> generateDrags(uint32_t dragCount, std::mt19937& rng, uint32_t minLength = 8, uint32_t maxLength = 64, bool northwards = false)
+	{
+		std::uniform_int_distribution<uint32_t> networkDist(0, networkCount - 1);
+		std::uniform_int_distribution<uint32_t> columnDist(0, gridSize / 4 - 2);
+		std::uniform_int_distribution<uint32_t> lengthDist(minLength, std::min(maxLength, gridSize / 2));
+		std::vector<Drag> drags;
+		for (uint32_t i = 0; i < dragCount; i++) {
+			const uint32_t length = lengthDist(rng);
+			std::uniform_int_distribution<uint32_t> zDist(gridSize / 2 - length, gridSize / 2 - 1);
+			drags.push_back({networkDist(rng), columnDist(rng) * 4 + 2, zDist(rng), length, northwards});
+		}
+		return drags;
+	}
+
+	std::vector<Rul2Cell> dragCells(const Drag& drag, uint32_t length)
+	{
+		std::vector<Rul2Cell> cells;
+		for (uint32_t i = 0; i < length; i++) {
+			cells.push_back({straightId(drag.network), R0F0, makeXZ(drag.x, drag.northwards ? drag.z + drag.length - 1 - i : drag.z + i)});
+		}
+		return cells;
+	}
+
+	struct Timings
+	{
+		std::vector<double> micros;
+
+		void Add(Clock::duration d) { micros.push_back(std::chrono::duration<double, std::micro>(d).count()); }
+
+		void Print(const char* label)
+		{
+			std::sort(micros.begin(), micros.end());
+			double sum = 0;
+			for (const double t : micros) {
+				sum += t;
+			}
+			auto percentile = [this](double p) { return micros[std::min(micros.size() - 1, static_cast<size_t>(p * micros.size()))]; };
+			std::printf("%-28s n=%-7zu mean=%8.2f us  p50=%8.2f us  p99=%8.2f us\n", label, micros.size(), sum / micros.size(), percentile(0.5), percentile(0.99));
+		}
+	};
+
+	std::string cacheHitRate(const Rul2Rules::LookupStatistics& stats)
+	{
+		const uint64_t probes = stats.lookups - stats.rejectedTile - stats.rejectedPair;
+		char buffer[96];
+		std::snprintf(buffer, sizeof(buffer), "%.1f%% of %llu index lookups answered by the lookup cache",
+				probes > 0 ? 100.0 * stats.cacheHits / probes : 0.0, static_cast<unsigned long long>(probes));
+		return buffer;
+	}
+
+	void benchLookups(Rul2Rules& rules, std::mt19937& rng)
+	{
+		// half of the queried pairs match a rule, the other half are random pairs
+		std::vector<std::pair<Rul2Cell, Rul2Cell>> pairs;
+		rules.ForEachRule([&pairs](const cSC4NetworkTileConflictRule& rule) {
+			if (pairs.size() < (1 << 20)) {
+				pairs.push_back({{rule._1.id, rule._1.rf, 0}, {rule._2.id, rule._2.rf, 0}});
+			}
+		});
+		std::shuffle(pairs.begin(), pairs.end(), rng);
+		pairs.resize(std::min<size_t>(pairs.size(), 1 << 18));
+		std::uniform_int_distribution<uint32_t> idDist(0, fillerIdCount - 1);
+		std::uniform_int_distribution<uint32_t> rfDist(0, 7);
+		const size_t hitCount = pairs.size();
+		for (size_t i = 0; i < hitCount; i++) {
+			pairs.push_back({{fillerId(idDist(rng)), rotFlipValues[rfDist(rng)], 0}, {fillerId(idDist(rng)), rotFlipValues[rfDist(rng)], 0}});
+		}
+		std::shuffle(pairs.begin(), pairs.end(), rng);
+
+		constexpr uint32_t rounds = 8;
+		auto run = [&rules, &pairs](const char* name, auto&& lookup) {
+			uint32_t matched = 0;
+			rules.Statistics() = {};
+			const auto start = Clock::now();
+			for (uint32_t round = 0; round < rounds; round++) {
+				matched += lookup();
+			}
+			const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			const double lookups = static_cast<double>(rounds) * pairs.size();
+			std::printf("%s: %.0f lookups in %.3f s = %.2f M lookups/s (%.1f%% matched, %s)\n", name, lookups, seconds, lookups / seconds / 1e6, 100.0 * matched / lookups,
+					cacheHitRate(rules.Statistics()).c_str());
+		};
+		run("PatchTilePair", [&rules, &pairs] {
+			uint32_t matched = 0;
+			for (const auto& [first, second] : pairs) {
+				Rul2Cell a = first;
+				Rul2Cell b = second;
+				matched += rules.PatchTilePair(a, b, 2) != Rul2Rules::NoMatch;
+			}
+			return matched;
+		});
+		// the same lookups, prepared 4 at a time (Rul2Solver does not, see Rul2Rules::PrepareTilePairs)
+		run("PatchPreparedTilePair (batches of 4)", [&rules, &pairs] {
+			constexpr size_t batchSize = Rul2Rules::maxPreparedLookups;
+			uint32_t matched = 0;
+			std::array<Rul2Cell, batchSize> a, b;
+			std::array<Rul2Rules::TilePair, batchSize> batch;
+			std::array<Rul2Rules::PreparedLookup, batchSize> lookups;
+			for (size_t i = 0; i < pairs.size(); i += batchSize) {
+				const size_t count = std::min(batchSize, pairs.size() - i);
+				for (size_t k = 0; k < count; k++) {
+					a[k] = pairs[i + k].first;
+					b[k] = pairs[i + k].second;
+					batch[k] = {&a[k], &b[k], 2};
+				}
+				rules.PrepareTilePairs(batch.data(), count, lookups.data());
+				for (size_t k = 0; k < count; k++) {
+					matched += rules.PatchPreparedTilePair(lookups[k], a[k], b[k], 2) != Rul2Rules::NoMatch;
+				}
+			}
+			return matched;
+		});
+	}
+
+	// Solves every drag frame by frame, as the game does while the user extends the drag by one cell per frame.
+	// the rules of the index as bytes, in a canonical order
+	std::vector<std::array<uint8_t, sizeof(cSC4NetworkTileConflictRule)>> sortedRules(const Rul2Rules& rules)
+	{
+		std::vector<std::array<uint8_t, sizeof(cSC4NetworkTileConflictRule)>> result;
+		rules.ForEachRule([&result](const cSC4NetworkTileConflictRule& rule) {
+			std::array<uint8_t, sizeof(cSC4NetworkTileConflictRule)> bytes = {};
+			const Tile tiles[] = {rule._1, rule._2, rule._3, rule._4};
+			for (size_t i = 0; i < 4; i++) {  // without the padding of the tiles
+				std::memcpy(bytes.data() + 5 * i, &tiles[i].id, sizeof(tiles[i].id));
+				bytes[5 * i + 4] = tiles[i].rf;
+			}
+			result.push_back(bytes);
+		});
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	// If repeatFrames is set, every frame is solved twice, as the game does when the same drag is evaluated again, and only the second time is timed.
+	void benchDrags(Rul2Rules& rules, GridWorld& world, const std::vector<Drag>& drags, bool incremental, std::vector<std::vector<Rul2Cell>>& results,
+			Rul2Trace::Writer* traceWriter, bool solutionCache = false, bool repeatFrames = false)
+	{
+		rules.Statistics() = {};
+		Rul2Solver solver(rules);
+		solver.SetIncremental(incremental);
+		solver.SetSolutionCache(solutionCache);
+		Timings frames;
+		Timings finals;
+		uint32_t failures = 0;
+		std::vector<Rul2Cell> cells;
+		results.clear();
+		for (const Drag& drag : drags) {
+			solver.ForgetLastFrame();
+			for (uint32_t length = 1; length <= drag.length; length++) {
+				if (repeatFrames) {
+					cells = dragCells(drag, length);
+					world.BeginDrag(cells);
+					solver.Solve(world, cells);
+					world.EndDrag();
+				}
+				cells = dragCells(drag, length);
+				world.BeginDrag(cells);
+				Rul2Trace::Record record;
+				record.forgotLastFrame = length == 1;
+				record.input = cells;
+				Rul2Trace::RecordingWorld recordingWorld(world, record);
+				const auto start = Clock::now();
+				const Rul2Solver::Outcome outcome = traceWriter ? solver.Solve(recordingWorld, cells) : solver.Solve(world, cells);
+				const auto duration = Clock::now() - start;
+				world.EndDrag();
+				if (traceWriter) {
+					record.outcome = outcome;
+					record.durationMicros = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+					record.output = cells;
+					traceWriter->Write(record);
+				}
+				frames.Add(duration);
+				if (length == drag.length) {
+					finals.Add(duration);
+				}
+				failures += outcome != Rul2Solver::Solved;
+			}
+			results.push_back(cells);
+		}
+		std::printf("%s evaluation%s%s (%u unsolved frames, %s", incremental ? "Incremental" : "Full", repeatFrames ? " of repeated frames" : "",
+				solutionCache ? " with the solution cache" : "", failures, cacheHitRate(rules.Statistics()).c_str());
+		if (solutionCache) {
+			const Rul2Solver::SolutionCacheStatistics& cacheStats = solver.CacheStatistics();
+			std::printf(", %llu solution cache hits, %llu misses", static_cast<unsigned long long>(cacheStats.hits), static_cast<unsigned long long>(cacheStats.misses));
+		}
+		std::printf("):\n");
+		frames.Print("  per drag frame");
+		finals.Print("  final frame of drag");
+	}
+
+	// The evaluation loop of the game's AdjustTileSubsets as the DLL ran it before Rul2Solver (without the solution cache,
+	// the incremental evaluation and the Prevent pre-pass): after any match, all the cells are examined again from the start.
+	// This is the baseline for the worklist of Rul2Solver, which must give the same results.
+	Rul2Solver::Outcome solveWithRestarts(Rul2Rules& rules, Rul2World& world, std::vector<Rul2Cell>& cells)
+	{
+		constexpr int32_t kNextX[] = {-1, 0, 1, 0};
+		constexpr int32_t kNextZ[] = {0, -1, 0, 1};
+		int32_t countMatchesDown = std::max<int32_t>(cells.size() * 8, Rul2Solver::maxRepetitions);
+		bool foundMatch = false;
+		int32_t countPatchesCurrentCell = 0;
+		for (size_t idx = 0; idx < cells.size(); ) {
+			bool matched = false;
+			for (uint32_t dir = 0; dir < 4 && countPatchesCurrentCell <= Rul2Solver::maxRepetitions; dir++) {
+				const uint32_t xz = cells[idx].xz;
+				const uint32_t nextCellXZ = (kNextZ[dir] + (xz >> 16)) * 0x10000 + (kNextX[dir] + (xz & 0xffff));
+				Rul2WorldCell cell2Info;
+				if (!world.GetCell(nextCellXZ, cell2Info)) {
+					continue;
+				}
+				Rul2Cell temp;
+				Rul2Cell* cell2;
+				bool isCell2StackLocal = cell2Info.idxInCellsBuffer < 0;
+				if (isCell2StackLocal) {
+					if (!cell2Info.hasOccupant) {
+						continue;
+					}
+					temp = {cell2Info.id, cell2Info.rf, nextCellXZ};
+					cell2 = &temp;
+				} else {
+					cell2 = &cells[cell2Info.idxInCellsBuffer];
+				}
+				if (cell2Info.isImmovable || cell2Info.isNetworkLot) {
+					temp = *cell2;
+					temp.id = 0;
+					cell2 = &temp;
+					isCell2StackLocal = true;
+				}
+				Rul2Rules::PatchResult patchResult = rules.PatchTilePair(cells[idx], *cell2, dir);
+				if (patchResult == Rul2Rules::NoMatch) {
+					patchResult = rules.TryAdjacencies(cells[idx], *cell2, dir);
+					if (patchResult != Rul2Rules::Matched) {
+						if (isCell2StackLocal) {
+							patchResult = rules.TryAdjacencies(*cell2, cells[idx], (dir - 2) & 3);
+						}
+						if (patchResult != Rul2Rules::Matched) {
+							continue;
+						}
+					}
+				}
+				if (patchResult == Rul2Rules::Prevent) {
+					return Rul2Solver::Prevented;
+				}
+				if (--countMatchesDown < 0) {
+					return Rul2Solver::TooManyMatches;
+				}
+				foundMatch = true;
+				if (isCell2StackLocal) {
+					if (cells.size() >= Rul2Solver::maxCellsBufferSize) {
+						return Rul2Solver::TooManyCells;
+					}
+					world.SetCellsBufferIndex(nextCellXZ, static_cast<int32_t>(cells.size()));
+					cells.push_back(*cell2);
+				}
+				countPatchesCurrentCell++;
+				matched = true;
+				break;  // examine the same cell again
+			}
+			if (matched) {
+				continue;
+			}
+			idx++;
+			countPatchesCurrentCell = 0;
+			if (idx == cells.size() && foundMatch) {
+				idx = 0;
+				foundMatch = false;
+			}
+		}
+		return Rul2Solver::Solved;
+	}
+
+	// Solves every drag frame by frame like benchDrags (full evaluation), but with solveWithRestarts.
+	void benchRestarts(Rul2Rules& rules, GridWorld& world, const std::vector<Drag>& drags, std::vector<std::vector<Rul2Cell>>& results)
+	{
+		Timings frames;
+		Timings finals;
+		uint32_t failures = 0;
+		std::vector<Rul2Cell> cells;
+		results.clear();
+		for (const Drag& drag : drags) {
+			for (uint32_t length = 1; length <= drag.length; length++) {
+				cells = dragCells(drag, length);
+				world.BeginDrag(cells);
+				const auto start = Clock::now();
+				const Rul2Solver::Outcome outcome = solveWithRestarts(rules, world, cells);
+				const auto duration = Clock::now() - start;
+				world.EndDrag();
+				frames.Add(duration);
+				if (length == drag.length) {
+					finals.Add(duration);
+				}
+				failures += outcome != Rul2Solver::Solved;
+			}
+			results.push_back(cells);
+		}
+		std::printf("Full evaluation restarting after every match, as before the worklist (%u unsolved frames):\n", failures);
+		frames.Print("  per drag frame");
+		finals.Print("  final frame of drag");
+	}
+
+	uint32_t countMismatches(const std::vector<std::vector<Rul2Cell>>& results, const std::vector<std::vector<Rul2Cell>>& expected)
+	{
+		uint32_t mismatches = 0;
+		for (size_t i = 0; i < expected.size(); i++) {
+			mismatches += !std::equal(results[i].begin(), results[i].end(), expected[i].begin(), expected[i].end(),
+					[](const Rul2Cell& a, const Rul2Cell& b) { return a.id == b.id && a.rf == b.rf && a.xz == b.xz; });
+		}
+		return mismatches;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const uint32_t fillerRuleCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500000;
+	const uint32_t dragCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 500;
+	const std::filesystem::path traceFolderPath = argc > 3 ? argv[3] : "";
+	std::mt19937 rng(4711);  // independent of the seed of the rules
+
+	for (const bool compact : {false, true}) {
+		Rul2Rules rules;
+		rules.SetUseCompactIndex(compact);
+		std::mt19937 ruleRng(12345);
+		addRules(rules, fillerRuleCount, ruleRng);
+
+		auto start = Clock::now();
+		rules.Build();
+		const double buildSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+		std::printf("== %s index: %zu rules, %zu KB, filter %zu KB, %zu surrogate candidates, built in %.3f s\n",
+				rules.UsesCompactIndex() ? "Compact" : "Flat", rules.Size(), rules.IndexMemoryUsage() / 1024, rules.Filter().MemoryUsage() / 1024,
+				rules.SurrogateCandidateCount(), buildSeconds);
+
+		if (!compact) {
+			Rul2Rules parallelRules;
+			ruleRng.seed(12345);
+			addRules(parallelRules, fillerRuleCount, ruleRng);
+			Rul2Rules::PendingRules pendingRules = parallelRules.TakePendingRules();
+			const uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+			start = Clock::now();
+			parallelRules.Build(pendingRules, threadCount);
+			const double parallelSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+			std::printf("Parallel build with %u threads in %.3f s (%s)\n", threadCount, parallelSeconds,
+					sortedRules(parallelRules) == sortedRules(rules) ? "same rules" : "DIFFERENT rules");
+		}
+
+		const std::filesystem::path cacheFilePath = std::filesystem::temp_directory_path() / "rul2bench.cache";
+		rules.SaveCache(cacheFilePath);
+		Rul2Rules cachedRules;
+		cachedRules.SetUseCompactIndex(compact);
+		ruleRng.seed(12345);
+		addRules(cachedRules, fillerRuleCount, ruleRng);  // the same rules, so that the fingerprint matches
+		start = Clock::now();
+		const bool loaded = cachedRules.LoadCache(cacheFilePath);
+		std::printf("Cache: %s in %.3f s\n", loaded ? "loaded" : "NOT loaded", std::chrono::duration<double>(Clock::now() - start).count());
+		std::filesystem::remove(cacheFilePath);
+		Rul2Trace::Writer traceWriter;
+		if (!traceFolderPath.empty() && !compact) {
+			rules.SaveCache(traceFolderPath / "NAM-RUL2.cache");
+			traceWriter.Open(traceFolderPath / "NAM-RUL2-trace.bin", {false, compact, true, rules.Fingerprint()});
+		}
+
+		benchLookups(rules, rng);
+
+		GridWorld world;
+		std::mt19937 worldRng(777);
+		buildWorld(world, worldRng);
+		const std::vector<Drag> drags = generateDrags(dragCount, worldRng);
+		std::vector<std::vector<Rul2Cell>> fullResults;
+		std::vector<std::vector<Rul2Cell>> incrementalResults;
+		benchDrags(rules, world, drags, false, fullResults, nullptr);
+		benchDrags(rules, world, drags, true, incrementalResults, nullptr);
+		std::vector<std::vector<Rul2Cell>> cachedResults;
+		benchDrags(rules, world, drags, false, cachedResults, traceWriter.IsOpen() ? &traceWriter : nullptr, true);
+		std::vector<std::vector<Rul2Cell>> repeatedResults;
+		benchDrags(rules, world, drags, false, repeatedResults, nullptr, true, true);
+		std::vector<std::vector<Rul2Cell>> restartResults;
+		benchRestarts(rules, world, drags, restartResults);
+		uint32_t overridden = 0;
+		for (size_t i = 0; i < drags.size(); i++) {
+			overridden += std::count_if(fullResults[i].begin(), fullResults[i].end(), [](const Rul2Cell& cell) { return (cell.id & 0xf0000000) == 0x60000000; });
+		}
+		std::printf("Overridden cells after the full evaluation: %u\n", overridden);
+		std::printf("Drags whose incremental result differs from the full evaluation: %u of %zu\n", countMismatches(incrementalResults, fullResults), drags.size());
+		std::printf("Drags whose result with the solution cache differs from the full evaluation: %u of %zu (first evaluation), %u (repeated)\n",
+				countMismatches(cachedResults, fullResults), drags.size(), countMismatches(repeatedResults, fullResults));
+		std::printf("Drags whose result with restarts differs from the full evaluation: %u of %zu\n\n", countMismatches(restartResults, fullResults), drags.size());
+
+		// Long drags across the whole northern half. The overrides propagate southwards, so if the drag extends northwards,
+		// restarting after every match examines all the cells once per propagated override.
+		for (const bool northwards : {false, true}) {
+			const std::vector<Drag> longDrags = generateDrags(std::max(dragCount / 10, 1u), worldRng, gridSize / 2 - 16, gridSize / 2, northwards);
+			std::printf("Long drags of %u to %u cells, extending %s:\n", gridSize / 2 - 16, gridSize / 2, northwards ? "northwards" : "southwards");
+			benchDrags(rules, world, longDrags, false, fullResults, nullptr);
+			benchRestarts(rules, world, longDrags, restartResults);
+			std::printf("Long drags whose result with restarts differs from the full evaluation: %u of %zu\n\n", countMismatches(restartResults, fullResults), longDrags.size());
+		}
+	}
+	return 0;
+}
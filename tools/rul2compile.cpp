@@ -0,0 +1,441 @@
+// Compiles RUL2 files into a single deduplicated RUL2 file that can be shipped in place of the original files.
+//
+// Build and run on Linux (from the repository root):
+//
+//   make bench && ./build/rul2compile -o NAM.rul2 [-c NAM-RUL2.cache [--compact]] [-r conflicts.txt] [-j threads] [-s seeds.txt] [--collapse] input...
+//
+// The inputs are RUL2 text files or DBPF files containing RUL2 entries, read in the order in which the game would load them.
+// As in the game, the first of several equivalent rules wins (equivalent under the 4 symmetries of RuleEquivalence).
+// The later ones are dropped as duplicates if they have the same outcome, or reported as conflicts otherwise.
+// The rules are written in canonical orientation, except for rules whose two tiles are symmetric to themselves,
+// as the orientation of the outcome matters for those.
+//
+// With -c, the tool also writes the cache file of the RUL2 index for the compiled rules (see RuleIndexCache),
+// which the DLL uses if the compiled file is the only RUL2 file loaded by the game.
+//
+// With -s, the tool also drops the rules that can never match (see RuleReachability), given the seeds file,
+// which lists the piece IDs that the game builds other than through RUL2 (e.g. through RUL1 and puzzle pieces),
+// one ID per line (optionally followed by a comma and anything else, which is ignored), with comments starting with a semicolon.
+// Pruned rules are listed in the -r report.
+//
+// With --collapse, the chains of rules overriding the same tile pair are composed into single rules (see RuleChains),
+// which are listed in the -r report, too. Use rul2equiv to check the compiled file against the input files.
+#include "Rul2Input.h"
+#include "Rul2Text.h"
+#include "Rul2Rules.h"
+#include "RuleEquivalence.h"
+#include "RuleChains.h"
+#include "RuleReachability.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	using Rul2Input::SourceRule;
+
+	// the 4 symmetries of a rule, in the order in which PatchTilePair checks them
+	cSC4NetworkTileConflictRule transform(const cSC4NetworkTileConflictRule& r, uint32_t symmetry)
+	{
+		switch (symmetry) {
+			case 0: return r;
+			case 1: return {{r._1.id, flipVertically(r._1.rf)}, {r._2.id, flipVertically(r._2.rf)}, {r._3.id, flipVertically(r._3.rf)}, {r._4.id, flipVertically(r._4.rf)}};
+			case 2: return {{r._2.id, rotate180(r._2.rf)}, {r._1.id, rotate180(r._1.rf)}, {r._4.id, rotate180(r._4.rf)}, {r._3.id, rotate180(r._3.rf)}};
+			default: return {{r._2.id, flipHorizontally(r._2.rf)}, {r._1.id, flipHorizontally(r._1.rf)}, {r._4.id, flipHorizontally(r._4.rf)}, {r._3.id, flipHorizontally(r._3.rf)}};
+		}
+	}
+
+	constexpr bool isSameTile(const Tile& a, const Tile& b)
+	{
+		return a.id == b.id && a.rf == b.rf;
+	}
+
+	constexpr bool isSameLeftSide(const cSC4NetworkTileConflictRule& p, const cSC4NetworkTileConflictRule& q)
+	{
+		return isSameTile(p._1, q._1) && isSameTile(p._2, q._2);
+	}
+
+	constexpr bool isLessLeftSide(const cSC4NetworkTileConflictRule& p, const cSC4NetworkTileConflictRule& q)
+	{
+		if (p._1.id != q._1.id) return p._1.id < q._1.id;
+		if (p._1.rf != q._1.rf) return p._1.rf < q._1.rf;
+		if (p._2.id != q._2.id) return p._2.id < q._2.id;
+		return p._2.rf < q._2.rf;
+	}
+
+	bool isSymmetric(const cSC4NetworkTileConflictRule& rule)
+	{
+		for (uint32_t symmetry = 1; symmetry < 4; symmetry++) {
+			if (isSameLeftSide(transform(rule, symmetry), rule)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Rotating a rule to another orientation does not change its effect, unless its left side is symmetric.
+	cSC4NetworkTileConflictRule canonicalOrientation(const cSC4NetworkTileConflictRule& rule)
+	{
+		if (rule._2.id == 0 || isSymmetric(rule)) {
+			return rule;
+		}
+		cSC4NetworkTileConflictRule best = rule;
+		for (uint32_t symmetry = 1; symmetry < 4; symmetry++) {
+			const cSC4NetworkTileConflictRule candidate = transform(rule, symmetry);
+			if (isLessLeftSide(candidate, best)) {
+				best = candidate;
+			}
+		}
+		return best;
+	}
+
+	// Whether the later rule q has the same effect as the earlier equivalent rule p.
+	bool isSameOutcome(const SourceRule& p, const SourceRule& q, const cSC4NetworkTileConflictRule& qRule)
+	{
+		if (p.parsed.rightPrefix != q.parsed.rightPrefix) {
+			return false;
+		}
+		for (uint32_t symmetry = 0; symmetry < 4; symmetry++) {
+			const cSC4NetworkTileConflictRule t = transform(qRule, symmetry);
+			if (isSameLeftSide(t, p.parsed.rule) && isSameTile(t._3, p.parsed.rule._3) && isSameTile(t._4, p.parsed.rule._4)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// The rules as matched by the DLL, with the rules with ID 0 as second tile expanded to all its RotFlips
+	struct RuntimeRule
+	{
+		cSC4NetworkTileConflictRule rule;
+		uint32_t source;  // index into the source rules
+	};
+
+	enum Verdict : uint8_t { New, Duplicate, Conflict };
+
+	struct Shadowing
+	{
+		uint32_t runtimeRule;
+		uint32_t shadowingSource;  // the earlier source rule that wins
+	};
+
+	// Reads the piece IDs of a seeds file, see -s.
+	std::vector<uint32_t> readSeeds(const std::filesystem::path& path, uint32_t& errorCount)
+	{
+		const std::string text = Rul2Input::ReadFile(path);
+		std::vector<uint32_t> ids;
+		uint32_t lineNumber = 0;
+		for (size_t begin = 0; begin < text.size(); ) {
+			size_t end = text.find('\n', begin);
+			end = end == std::string::npos ? text.size() : end;
+			std::string_view line = std::string_view(text).substr(begin, end - begin);
+			begin = end + 1;
+			lineNumber++;
+
+			line = line.substr(0, line.find(';'));
+			line = line.substr(0, line.find(','));
+			const size_t first = line.find_first_not_of(" \t\r");
+			if (first == std::string_view::npos) {
+				continue;
+			}
+			line = line.substr(first, line.find_last_not_of(" \t\r") + 1 - first);
+			const bool hex = line.size() > 2 && line[0] == '0' && (line[1] == 'x' || line[1] == 'X');
+			const std::string_view digits = hex ? line.substr(2) : line;
+			uint32_t id;
+			const auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), id, hex ? 16 : 10);
+			if (ec != std::errc() || ptr != digits.data() + digits.size()) {
+				std::fprintf(stderr, "%s:%u: expected a piece ID\n", path.string().c_str(), lineNumber);
+				errorCount++;
+				continue;
+			}
+			ids.push_back(id);
+		}
+		return ids;
+	}
+
+	// the memory of the RUL2 index and its filter, as loaded by the DLL
+	size_t indexMemoryUsage(const std::vector<cSC4NetworkTileConflictRule>& rules, bool compact)
+	{
+		Rul2Rules index;
+		index.SetUseCompactIndex(compact);
+		for (const cSC4NetworkTileConflictRule& rule : rules) {
+			index.AddRule(rule);
+		}
+		index.Build();
+		return index.IndexMemoryUsage() + index.Filter().MemoryUsage();
+	}
+
+	void usage(const char* program)
+	{
+		std::fprintf(stderr, "Usage: %s -o output.rul2 [-c NAM-RUL2.cache [--compact]] [-r conflicts.txt] [-j threads] [-s seeds.txt] [--collapse] input...\n", program);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::filesystem::path outputPath;
+	std::filesystem::path cachePath;
+	std::filesystem::path reportPath;
+	std::filesystem::path seedsPath;
+	bool compact = false;
+	bool collapse = false;
+	uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::filesystem::path> inputs;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (arg == "-o" && hasValue) {
+			outputPath = argv[++i];
+		} else if (arg == "-c" && hasValue) {
+			cachePath = argv[++i];
+		} else if (arg == "-r" && hasValue) {
+			reportPath = argv[++i];
+		} else if (arg == "-s" && hasValue) {
+			seedsPath = argv[++i];
+		} else if (arg == "-j" && hasValue) {
+			threadCount = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--compact") {
+			compact = true;
+		} else if (arg == "--collapse") {
+			collapse = true;
+		} else if (!arg.empty() && arg[0] == '-') {
+			usage(argv[0]);
+			return 2;
+		} else {
+			inputs.push_back(arg);
+		}
+	}
+	if (outputPath.empty() || inputs.empty()) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<SourceRule> sources;
+	uint32_t errorCount = 0;
+	try {
+		errorCount += Rul2Input::ReadRules(inputs, threadCount, sources);
+	} catch (const std::exception& e) {
+		std::fprintf(stderr, "%s\n", e.what());
+		return 2;
+	}
+	const auto parsed = std::chrono::steady_clock::now();
+
+	// expand the rules with ID 0 as second tile, as they match that tile in any RotFlip
+	std::vector<RuntimeRule> runtimeRules;
+	runtimeRules.reserve(sources.size());
+	for (uint32_t i = 0; i < sources.size(); i++) {
+		const cSC4NetworkTileConflictRule& rule = sources[i].parsed.rule;
+		if (rule._2.id != 0) {
+			runtimeRules.push_back({rule, i});
+		} else {
+			for (const auto rf : rotFlipValues) {
+				cSC4NetworkTileConflictRule tmpRule = rule;
+				tmpRule._2.rf = rf;
+				runtimeRules.push_back({tmpRule, i});
+			}
+		}
+	}
+
+	// Equivalent rules have the same hash, so each shard can find the first of the equivalent rules on its own.
+	const uint32_t shardCount = threadCount;
+	std::vector<uint32_t> shardOf(runtimeRules.size());
+	{
+		std::vector<std::thread> threads;
+		for (uint32_t t = 0; t < threadCount; t++) {
+			threads.emplace_back([&, t]() {
+				const RuleEquivalenceHash hash;
+				for (size_t i = t; i < runtimeRules.size(); i += threadCount) {
+					shardOf[i] = hash(runtimeRules[i].rule) % shardCount;
+				}
+			});
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+	}
+	std::vector<Verdict> verdicts(runtimeRules.size(), New);
+	std::vector<std::vector<Shadowing>> shardShadowings(shardCount);
+	{
+		std::vector<std::thread> threads;
+		for (uint32_t shard = 0; shard < shardCount; shard++) {
+			threads.emplace_back([&, shard]() {
+				std::unordered_map<cSC4NetworkTileConflictRule, uint32_t, RuleEquivalenceHash, RuleEquivalence> firstRules;  // -> runtime rule
+				for (uint32_t i = 0; i < runtimeRules.size(); i++) {
+					if (shardOf[i] != shard) {
+						continue;
+					}
+					const RuntimeRule& r = runtimeRules[i];
+					const auto [it, inserted] = firstRules.emplace(r.rule, i);
+					if (!inserted) {
+						const RuntimeRule& first = runtimeRules[it->second];
+						verdicts[i] = isSameOutcome(sources[first.source], sources[r.source], r.rule) ? Duplicate : Conflict;
+						shardShadowings[shard].push_back({i, first.source});
+					}
+				}
+			});
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+	}
+
+	// A source rule is dropped if all of its runtime rules are shadowed by earlier rules.
+	std::vector<uint8_t> keep(sources.size(), 0);
+	for (uint32_t i = 0; i < runtimeRules.size(); i++) {
+		keep[runtimeRules[i].source] |= verdicts[i] == New;
+	}
+	std::vector<Shadowing> conflicts;
+	for (const auto& shadowings : shardShadowings) {
+		for (const Shadowing& s : shadowings) {
+			if (verdicts[s.runtimeRule] == Conflict) {
+				conflicts.push_back(s);
+			}
+		}
+	}
+	std::sort(conflicts.begin(), conflicts.end(), [](const Shadowing& a, const Shadowing& b) { return a.runtimeRule < b.runtimeRule; });
+
+	// drop the remaining rules that can never match
+	std::vector<uint8_t> pruned(sources.size(), 0);
+	uint32_t prunedCount = 0;
+	size_t reachableIdCount = 0;
+	size_t memoryBefore = 0;
+	if (!seedsPath.empty()) {
+		std::vector<uint32_t> seeds;
+		try {
+			seeds = readSeeds(seedsPath, errorCount);
+		} catch (const std::exception& e) {
+			std::fprintf(stderr, "%s\n", e.what());
+			return 2;
+		}
+		std::vector<uint32_t> keptSources;
+		std::vector<cSC4NetworkTileConflictRule> keptRules;
+		for (uint32_t i = 0; i < sources.size(); i++) {
+			if (keep[i]) {
+				keptSources.push_back(i);
+				keptRules.push_back(sources[i].parsed.rule);
+			}
+		}
+		const RuleReachability::Result reachability = RuleReachability::Analyze(keptRules, seeds);
+		for (uint32_t j = 0; j < keptRules.size(); j++) {
+			if (!reachability.reachableRules[j]) {
+				keep[keptSources[j]] = 0;
+				pruned[keptSources[j]] = 1;
+				prunedCount++;
+			}
+		}
+		reachableIdCount = reachability.reachableIdCount;
+		memoryBefore = indexMemoryUsage(keptRules, compact);
+	}
+
+	// compose the chains of overrides of the same tile pair
+	std::unordered_map<uint32_t, cSC4NetworkTileConflictRule> collapsedRules;  // source -> collapsed rule
+	size_t longestChain = 0;
+	if (collapse) {
+		std::vector<uint32_t> keptSources;
+		std::vector<cSC4NetworkTileConflictRule> keptRules;
+		for (uint32_t i = 0; i < sources.size(); i++) {
+			if (keep[i]) {
+				keptSources.push_back(i);
+				keptRules.push_back(sources[i].parsed.rule);
+			}
+		}
+		const RuleChains::Result chains = RuleChains::Collapse(keptRules);
+		for (uint32_t j = 0; j < keptRules.size(); j++) {
+			if (std::memcmp(&chains.rules[j], &keptRules[j], sizeof(cSC4NetworkTileConflictRule)) != 0) {
+				collapsedRules.emplace(keptSources[j], chains.rules[j]);
+			}
+		}
+		longestChain = chains.longestChain;
+	}
+
+	uint32_t keptCount = 0;
+	try {
+		std::ofstream out(outputPath, std::ios::binary | std::ios::trunc);
+		out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+		out << ";RUL2 compiled by rul2compile from " << inputs.size() << " input file(s)\n";
+		Rul2Rules rules;
+		rules.SetUseCompactIndex(compact);
+		for (uint32_t i = 0; i < sources.size(); i++) {
+			if (keep[i]) {
+				Rul2Text::ParsedRule parsed = sources[i].parsed;
+				const auto collapsed = collapsedRules.find(i);
+				parsed.rule = canonicalOrientation(collapsed != collapsedRules.end() ? collapsed->second : parsed.rule);
+				out << Rul2Text::Format(parsed) << '\n';
+				rules.AddRule(parsed.rule);
+				keptCount++;
+			}
+		}
+		if (!cachePath.empty() || !seedsPath.empty()) {
+			rules.Build();
+		}
+		if (!cachePath.empty()) {
+			rules.SaveCache(cachePath);
+		}
+		if (!seedsPath.empty()) {
+			const size_t memoryAfter = rules.IndexMemoryUsage() + rules.Filter().MemoryUsage();
+			std::printf("%u unreachable rules pruned (%zu reachable piece IDs), index memory %zu KB instead of %zu KB\n",
+					prunedCount, reachableIdCount, memoryAfter / 1024, memoryBefore / 1024);
+		}
+		if (collapse) {
+			std::printf("%zu rules collapsed with the rules following them (up to %zu rules in a chain)\n", collapsedRules.size(), longestChain);
+		}
+
+		if (!reportPath.empty()) {
+			std::ofstream report(reportPath, std::ios::binary | std::ios::trunc);
+			report.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+			uint32_t lastSource = UINT32_MAX;
+			for (const Shadowing& s : conflicts) {
+				const SourceRule& later = sources[runtimeRules[s.runtimeRule].source];
+				if (runtimeRules[s.runtimeRule].source == lastSource) {
+					continue;  // report each expanded rule once
+				}
+				lastSource = runtimeRules[s.runtimeRule].source;
+				const SourceRule& earlier = sources[s.shadowingSource];
+				report << inputs[later.file].string() << ':' << later.parsed.line << ": " << Rul2Text::Format(later.parsed) << '\n'
+					<< "  overridden by " << inputs[earlier.file].string() << ':' << earlier.parsed.line << ": " << Rul2Text::Format(earlier.parsed) << '\n';
+			}
+			for (uint32_t i = 0; i < sources.size(); i++) {
+				if (pruned[i]) {
+					report << inputs[sources[i].file].string() << ':' << sources[i].parsed.line << ": " << Rul2Text::Format(sources[i].parsed) << '\n'
+						<< "  unreachable\n";
+				}
+			}
+			for (uint32_t i = 0; i < sources.size(); i++) {
+				const auto collapsed = collapsedRules.find(i);
+				if (collapsed != collapsedRules.end()) {
+					Rul2Text::ParsedRule parsed = sources[i].parsed;
+					parsed.rule = collapsed->second;
+					report << inputs[sources[i].file].string() << ':' << sources[i].parsed.line << ": " << Rul2Text::Format(sources[i].parsed) << '\n'
+						<< "  collapsed to " << Rul2Text::Format(parsed) << '\n';
+				}
+			}
+		}
+	} catch (const std::exception& e) {
+		std::fprintf(stderr, "Failed to write the output: %s\n", e.what());
+		return 2;
+	}
+	const auto finished = std::chrono::steady_clock::now();
+
+	uint32_t duplicateCount = 0;
+	uint32_t conflictCount = 0;
+	for (uint32_t i = 0; i < sources.size(); i++) {
+		if (!keep[i] && !pruned[i]) {
+			// classify the dropped rule by its first runtime rule
+			const auto it = std::lower_bound(runtimeRules.begin(), runtimeRules.end(), i, [](const RuntimeRule& r, uint32_t source) { return r.source < source; });
+			(verdicts[it - runtimeRules.begin()] == Duplicate ? duplicateCount : conflictCount)++;
+		}
+	}
+	auto seconds = [](auto d) { return std::chrono::duration<double>(d).count(); };
+	std::printf("%zu rules read (%u errors), %u written, %u duplicates and %u conflicting rules dropped\n",
+			sources.size(), errorCount, keptCount, duplicateCount, conflictCount);
+	std::printf("parsed in %.3f s, compiled in %.3f s with %u threads\n", seconds(parsed - start), seconds(finished - parsed), threadCount);
+	return errorCount == 0 ? 0 : 1;
+}
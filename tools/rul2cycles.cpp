@@ -0,0 +1,85 @@
+// Finds RUL2 override rules that keep overriding the same tile pair, either in a cycle (A|B = C|D, C|D = A|B)
+// or in a long chain, which slow down the evaluation of network drags or make them fail (see RuleCycles).
+//
+// Build and run on Linux (from the repository root):
+//
+//   make bench && ./build/rul2cycles [--min-chain length] input...
+//
+// The inputs are RUL2 text files or DBPF files containing RUL2 entries, read in the order in which the game would load them,
+// as the first of several equivalent rules wins. Chains of fewer than 4 rules are not reported, unless requested by --min-chain.
+// The exit code is 1 if any cycle is found.
+#include "Rul2Input.h"
+#include "Rul2Text.h"
+#include "RuleCycles.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	using Rul2Input::SourceRule;
+
+	void printRules(const char* kind, const std::vector<uint32_t>& ruleIndices, const std::vector<SourceRule>& sources, const std::vector<std::filesystem::path>& inputs)
+	{
+		std::printf("%s of %zu rules:\n", kind, ruleIndices.size());
+		for (const uint32_t i : ruleIndices) {
+			const SourceRule& source = sources[i];
+			std::printf("  %s:%u: %s\n", inputs[source.file].string().c_str(), source.parsed.line, Rul2Text::Format(source.parsed).c_str());
+		}
+	}
+
+	void usage(const char* program)
+	{
+		std::fprintf(stderr, "Usage: %s [--min-chain length] input...\n", program);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t minChainLength = 4;
+	std::vector<std::filesystem::path> inputs;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (arg == "--min-chain" && hasValue) {
+			minChainLength = std::max(2, std::atoi(argv[++i]));
+		} else if (!arg.empty() && arg[0] == '-') {
+			usage(argv[0]);
+			return 2;
+		} else {
+			inputs.push_back(arg);
+		}
+	}
+	if (inputs.empty()) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	const uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<SourceRule> sources;
+	try {
+		Rul2Input::ReadRules(inputs, threadCount, sources);
+	} catch (const std::exception& e) {
+		std::fprintf(stderr, "%s\n", e.what());
+		return 2;
+	}
+
+	std::vector<cSC4NetworkTileConflictRule> rules;
+	rules.reserve(sources.size());
+	for (const SourceRule& source : sources) {
+		rules.push_back(source.parsed.rule);
+	}
+	const RuleCycles::Result result = RuleCycles::Analyze(rules, minChainLength);
+	for (const std::vector<uint32_t>& cycle : result.cycles) {
+		printRules("cycle", cycle, sources, inputs);
+	}
+	for (const std::vector<uint32_t>& chain : result.chains) {
+		printRules("chain", chain, sources, inputs);
+	}
+	std::printf("%zu rules read, %zu cycles and %zu chains of at least %u rules found\n",
+			sources.size(), result.cycles.size(), result.chains.size(), minChainLength);
+	return result.cycles.empty() ? 0 : 1;
+}
@@ -0,0 +1,315 @@
+// Checks that a RUL2 file evaluates network drags the same way as the RUL2 files it was compiled from,
+// e.g. the output of rul2compile with --collapse (see RuleChains), using randomized tests:
+//
+// - tile pair tests place the two tiles of a random rule (in a random symmetry and direction) next to each other,
+// - drag tests solve random straight drags across tiles that mostly form the left sides of rules, with random neighbors.
+//
+// Build and run on Linux (from the repository root):
+//
+//   make bench && ./build/rul2equiv [-n tests] [--seed seed] candidate reference...
+//
+// The inputs are RUL2 text files or DBPF files containing RUL2 entries. The reference files are read in the order
+// in which the game would load them. Drags that only the candidate solves, as the reference runs out of matches, are counted,
+// but are no failure. The exit code is 1 if any test fails, and 2 if an input cannot be read or contains invalid lines.
+// Rules pruned by rul2compile -s are expected to fail.
+#include "Rul2Input.h"
+#include "Rul2Rules.h"
+#include "Rul2Solver.h"
+#include "Rul2Text.h"
+#include "Rul2World.h"
+#include "RuleSymmetry.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	constexpr uint32_t makeXZ(uint32_t x, uint32_t z) { return (z << 16) | x; }
+
+	constexpr uint64_t tileKey(const Tile& tile) { return (uint64_t(tile.id) << 8) | tile.rf; }
+
+	// The cells of the world that are occupied by a network, within a square of the given size. The other cells are empty.
+	class SparseWorld final : public Rul2World
+	{
+	public:
+		static constexpr uint32_t size = 64;
+
+		void Clear() { cells.clear(); }
+
+		void Place(uint32_t xz, const Rul2WorldCell& cell) { cells[xz] = cell; }
+
+		bool GetCell(uint32_t xz, Rul2WorldCell& cell) override
+		{
+			if ((xz & 0xffff) >= size || (xz >> 16) >= size) {
+				return false;
+			}
+			const auto it = cells.find(xz);
+			cell = it != cells.end() ? it->second : Rul2WorldCell{};
+			return true;
+		}
+
+		void SetCellsBufferIndex(uint32_t xz, int32_t idx) override { cells[xz].idxInCellsBuffer = idx; }
+
+	private:
+		std::unordered_map<uint32_t, Rul2WorldCell> cells;
+	};
+
+	// A test case: the world around the dragged cells (without the cells buffer indices) and the dragged cells.
+	struct TestCase
+	{
+		std::vector<std::pair<uint32_t, Rul2WorldCell>> neighbors;
+		std::vector<Rul2Cell> dragged;
+	};
+
+	struct Solution
+	{
+		Rul2Solver::Outcome outcome;
+		std::vector<Rul2Cell> cells;  // sorted by xz
+	};
+
+	class RuleSet
+	{
+	public:
+		std::vector<Rul2Text::ParsedRule> parsed;
+		Rul2Rules rules;
+
+		Solution Solve(const TestCase& test)
+		{
+			world.Clear();
+			for (const auto& [xz, cell] : test.neighbors) {
+				world.Place(xz, cell);
+			}
+			std::vector<Rul2Cell> cells = test.dragged;
+			for (uint32_t i = 0; i < cells.size(); i++) {
+				world.SetCellsBufferIndex(cells[i].xz, i);
+			}
+			Solution solution = {solver.Solve(world, cells), std::move(cells)};
+			std::stable_sort(solution.cells.begin(), solution.cells.end(), [](const Rul2Cell& a, const Rul2Cell& b) { return a.xz < b.xz; });
+			return solution;
+		}
+
+	private:
+		Rul2Solver solver{rules};
+		SparseWorld world;
+	};
+
+	// Returns the number of invalid lines, which are printed.
+	uint32_t load(RuleSet& set, const std::vector<std::filesystem::path>& inputs)
+	{
+		const uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<Rul2Input::SourceRule> sources;
+		const uint32_t errorCount = Rul2Input::ReadRules(inputs, threadCount, sources);
+		for (const Rul2Input::SourceRule& source : sources) {
+			set.parsed.push_back(source.parsed);
+		}
+		for (const Rul2Text::ParsedRule& rule : set.parsed) {
+			set.rules.AddRule(rule.rule);
+		}
+		set.rules.Build();
+		return errorCount;
+	}
+
+	bool isSameSolution(const Solution& a, const Solution& b)
+	{
+		return a.outcome == b.outcome && (a.outcome != Rul2Solver::Solved || std::equal(a.cells.begin(), a.cells.end(), b.cells.begin(), b.cells.end(),
+				[](const Rul2Cell& p, const Rul2Cell& q) { return p.xz == q.xz && p.id == q.id && p.rf == q.rf; }));
+	}
+
+	std::string format(const Solution& solution)
+	{
+		constexpr const char* outcomeNames[] = {"solved", "prevented", "too many matches", "too many cells", "time budget exceeded"};
+		std::string s = outcomeNames[solution.outcome];
+		char buffer[64];
+		for (const Rul2Cell& cell : solution.cells) {
+			std::snprintf(buffer, sizeof(buffer), " (%u,%u):0x%08X,%u", cell.xz & 0xffff, cell.xz >> 16, cell.id, cell.rf & 0xff);
+			s += buffer;
+		}
+		return s;
+	}
+
+	// Generates the test cases from the left sides of the reference rules in all their symmetries.
+	class TestGenerator
+	{
+	public:
+		TestGenerator(const std::vector<Rul2Text::ParsedRule>& rules, uint32_t seed) : rules(rules), rng(seed)
+		{
+			for (const Rul2Text::ParsedRule& rule : rules) {
+				for (const auto symmetry : {RuleSymmetry::Identity, RuleSymmetry::FlipVertically, RuleSymmetry::SwapRotate180, RuleSymmetry::SwapFlipHorizontally}) {
+					const auto [a, b] = RuleSymmetry::Transform(symmetry, rule.rule._1, rule.rule._2);
+					if (b.id != 0) {
+						secondTiles[tileKey(a)].push_back(b);
+					}
+				}
+			}
+		}
+
+		TestCase TilePair()
+		{
+			const cSC4NetworkTileConflictRule& rule = RandomRule();
+			const auto [a, b] = RuleSymmetry::Transform(static_cast<RuleSymmetry::Symmetry>(rng() % 4), rule._1, rule._2);
+			const uint32_t dir = rng() % 4;
+			const uint32_t xz1 = makeXZ(SparseWorld::size / 2, SparseWorld::size / 2);
+			const uint32_t xz2 = neighborXZ(xz1, dir);
+			TestCase test;
+			test.dragged.push_back({a.id, relativeToAbsolute(a.rf, dir), xz1});
+			if (b.id == 0) {  // the rule matches immovable neighbors
+				Rul2WorldCell cell = {true, RandomTile().id, rotFlipValues[rng() % 8], true};
+				test.neighbors.emplace_back(xz2, cell);
+			} else if (rng() % 2 == 0) {
+				test.dragged.push_back({b.id, relativeToAbsolute(b.rf, dir), xz2});
+			} else {
+				test.neighbors.emplace_back(xz2, Rul2WorldCell{true, b.id, relativeToAbsolute(b.rf, dir)});
+			}
+			return test;
+		}
+
+		// A drag towards the east, so that the relative and absolute RotFlips of the tiles along the drag coincide.
+		TestCase Drag()
+		{
+			const uint32_t length = 2 + rng() % 15;
+			const uint32_t x0 = (SparseWorld::size - length) / 2;
+			const uint32_t z = SparseWorld::size / 2;
+			TestCase test;
+			Tile tile = RandomRule()._1;
+			for (uint32_t i = 0; i < length; i++) {
+				test.dragged.push_back({tile.id, tile.rf, makeXZ(x0 + i, z)});
+				tile = NextTile(tile);
+			}
+			for (const Rul2Cell& cell : test.dragged) {
+				if (rng() % 3 != 0) {
+					continue;
+				}
+				const uint32_t dir = rng() % 2 == 0 ? 1 : 3;  // north or south
+				const Tile next = NextTile({cell.id, absoluteToRelative(cell.rf, dir)});
+				test.neighbors.emplace_back(neighborXZ(cell.xz, dir), Rul2WorldCell{true, next.id, relativeToAbsolute(next.rf, dir), rng() % 8 == 0});
+			}
+			return test;
+		}
+
+	private:
+		static constexpr uint32_t neighborXZ(uint32_t xz, uint32_t dir)
+		{
+			constexpr int32_t nextX[] = {-1, 0, 1, 0};
+			constexpr int32_t nextZ[] = {0, -1, 0, 1};
+			return ((xz >> 16) + nextZ[dir]) * 0x10000 + ((xz & 0xffff) + nextX[dir]);
+		}
+
+		const cSC4NetworkTileConflictRule& RandomRule() { return rules[rng() % rules.size()].rule; }
+
+		Tile RandomTile()
+		{
+			const cSC4NetworkTileConflictRule& rule = RandomRule();
+			return rule._2.id == 0 || rng() % 2 == 0 ? rule._1 : rule._2;
+		}
+
+		// mostly a tile that forms the left side of a rule with the given tile to its west
+		Tile NextTile(const Tile& tile)
+		{
+			const auto it = secondTiles.find(tileKey(tile));
+			if (it == secondTiles.end() || rng() % 8 == 0) {
+				return RandomTile();
+			}
+			return it->second[rng() % it->second.size()];
+		}
+
+		const std::vector<Rul2Text::ParsedRule>& rules;
+		std::mt19937 rng;
+		std::unordered_map<uint64_t, std::vector<Tile>> secondTiles;  // first tile -> second tiles of the rules
+	};
+
+	struct TestStatistics
+	{
+		uint32_t passed = 0;
+		uint32_t failed = 0;
+		uint32_t onlyCandidateSolved = 0;
+		uint64_t referenceLookups = 0;
+		uint64_t candidateLookups = 0;
+	};
+
+	void usage(const char* program)
+	{
+		std::fprintf(stderr, "Usage: %s [-n tests] [--seed seed] candidate reference...\n", program);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t testCount = 100000;
+	uint32_t seed = 4711;
+	std::vector<std::filesystem::path> inputs;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (arg == "-n" && hasValue) {
+			testCount = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "--seed" && hasValue) {
+			seed = std::strtoul(argv[++i], nullptr, 10);
+		} else if (!arg.empty() && arg[0] == '-') {
+			usage(argv[0]);
+			return 2;
+		} else {
+			inputs.push_back(arg);
+		}
+	}
+	if (inputs.size() < 2) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	RuleSet candidate;
+	RuleSet reference;
+	uint32_t errorCount = 0;
+	try {
+		errorCount += load(candidate, {inputs[0]});
+		errorCount += load(reference, std::vector<std::filesystem::path>(inputs.begin() + 1, inputs.end()));
+	} catch (const std::exception& e) {
+		std::fprintf(stderr, "%s\n", e.what());
+		return 2;
+	}
+	if (errorCount != 0) {
+		std::fprintf(stderr, "%u invalid lines, which would not be compared.\n", errorCount);
+		return 2;
+	}
+	if (reference.parsed.empty()) {
+		std::fprintf(stderr, "The reference files contain no rules.\n");
+		return 2;
+	}
+	std::printf("%zu candidate rules, %zu reference rules\n", candidate.parsed.size(), reference.parsed.size());
+
+	TestGenerator generator(reference.parsed, seed);
+	uint32_t reportedFailures = 0;
+	bool failed = false;
+	for (const bool drags : {false, true}) {
+		TestStatistics stats;
+		for (uint32_t i = 0; i < testCount; i++) {
+			const TestCase test = drags ? generator.Drag() : generator.TilePair();
+			const uint64_t referenceLookups = reference.rules.Statistics().lookups;
+			const uint64_t candidateLookups = candidate.rules.Statistics().lookups;
+			const Solution expected = reference.Solve(test);
+			const Solution actual = candidate.Solve(test);
+			stats.referenceLookups += reference.rules.Statistics().lookups - referenceLookups;
+			stats.candidateLookups += candidate.rules.Statistics().lookups - candidateLookups;
+			if (isSameSolution(expected, actual)) {
+				stats.passed++;
+			} else if (expected.outcome == Rul2Solver::TooManyMatches && actual.outcome == Rul2Solver::Solved) {
+				stats.onlyCandidateSolved++;
+			} else {
+				stats.failed++;
+				if (reportedFailures++ < 10) {
+					std::printf("%s test %u differs:\n  dragged:  %s\n  expected: %s\n  actual:   %s\n", drags ? "drag" : "tile pair", i,
+							format({Rul2Solver::Solved, test.dragged}).c_str(), format(expected).c_str(), format(actual).c_str());
+				}
+			}
+		}
+		std::printf("%s tests: %u passed, %u failed, %u solved by the candidate only; lookups per test: %.1f (reference), %.1f (candidate)\n",
+				drags ? "Drag" : "Tile pair", stats.passed, stats.failed, stats.onlyCandidateSolved,
+				static_cast<double>(stats.referenceLookups) / std::max(testCount, 1u), static_cast<double>(stats.candidateLookups) / std::max(testCount, 1u));
+		failed |= stats.failed > 0;
+	}
+	return failed ? 1 : 0;
+}
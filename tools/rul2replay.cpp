@@ -0,0 +1,211 @@
+// Replays the RUL2 evaluations of network drags recorded in the game (see EnableRUL2DragTrace in NAM.ini),
+// reporting the latencies and checking that the engine still produces the recorded results.
+//
+// Build and run on Linux (from the repository root):
+//
+//   make bench && ./build/rul2replay [--profile profile.csv [--top N]] [--budget ms] [--solution-cache off] NAM-RUL2.cache NAM-RUL2-trace.bin [more trace files of the same rules]
+//
+// The cache file must be the one written by the game alongside the trace (see EnableRUL2IndexCache), as it contains the RUL2 index.
+// With --profile, the tool counts the matches of each rule over all the traces and writes the N most matched rules (default 1000)
+// and the never matched rules as CSV, like EnableRUL2RuleProfiling does in the game.
+// With --budget, the evaluations are cut short after the given time, like RUL2TimeBudget does in the game (default: no limit),
+// to see how many frames a budget would affect on this machine.
+// The solution cache is used if it was used in the game (see EnableRUL2SolutionCache). With --solution-cache off, a trace recorded
+// with the cache is replayed without it, to compare the latencies: the world cells read by the cache include all those the evaluation
+// could read. (The reverse is not possible, as the trace then lacks the world cells read by the cache.)
+#include "Rul2Rules.h"
+#include "Rul2Solver.h"
+#include "Rul2Trace.h"
+#include "Rul2Instrumentation.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct Latencies
+	{
+		std::vector<double> micros;
+
+		void Print(const char* label)
+		{
+			if (micros.empty()) {
+				return;
+			}
+			std::sort(micros.begin(), micros.end());
+			double sum = 0;
+			for (const double t : micros) {
+				sum += t;
+			}
+			auto percentile = [this](double p) { return micros[std::min(micros.size() - 1, static_cast<size_t>(p * micros.size()))]; };
+			std::printf("%-24s n=%-7zu mean=%9.2f us  p50=%9.2f us  p90=%9.2f us  p99=%9.2f us  max=%9.2f us\n",
+					label, micros.size(), sum / micros.size(), percentile(0.5), percentile(0.9), percentile(0.99), micros.back());
+		}
+	};
+
+	constexpr bool isSameCell(const Rul2Cell& a, const Rul2Cell& b)
+	{
+		return a.xz == b.xz && a.id == b.id && a.rf == b.rf;
+	}
+
+	// A new drag starts when the network tool changes or when the drag starts at a different cell.
+	bool startsDrag(const Rul2Trace::Record& record, const Rul2Trace::Record* previous)
+	{
+		return previous == nullptr || record.forgotLastFrame || record.input.empty() || previous->input.empty() || record.input[0].xz != previous->input[0].xz;
+	}
+
+	// Returns the number of mismatching records. The rules are reused from the previous trace if possible, so that the profile accumulates.
+	uint32_t replay(const char* cacheFilePath, const char* traceFilePath, std::unique_ptr<Rul2Rules>& pRules, bool profiling, std::chrono::milliseconds timeBudget, bool solutionCache)
+	{
+		Rul2Trace::Reader reader(traceFilePath);
+		const Rul2Trace::Header& header = reader.GetHeader();
+
+		if (pRules == nullptr || pRules->UsesCompactIndex() != header.compactIndex ||
+			pRules->Fingerprint().hash != header.fingerprint.hash || pRules->Fingerprint().ruleCount != header.fingerprint.ruleCount)
+		{
+			pRules = std::make_unique<Rul2Rules>();
+			pRules->SetUseCompactIndex(header.compactIndex);
+			pRules->SetRuleProfiling(profiling);
+			if (!pRules->LoadCache(cacheFilePath, header.fingerprint)) {
+				std::fprintf(stderr, "%s: the cache file does not contain the RUL2 index of the traced rules.\n", traceFilePath);
+				pRules = nullptr;
+				return 1;
+			}
+		}
+		Rul2Rules& rules = *pRules;
+		Rul2Solver solver(rules);
+		solver.SetIncremental(header.incremental);
+		solver.SetTimeBudget(timeBudget);
+		solver.SetSolutionCache(header.solutionCache && solutionCache);
+		std::printf("%s: %zu rules (%s index), %s evaluation, %s\n", traceFilePath, rules.Size(), header.compactIndex ? "compact" : "flat",
+				header.incremental ? "incremental" : "full", solver.HasSolutionCache() ? "solution cache" : header.solutionCache ? "solution cache disabled" : "no solution cache");
+
+		Latencies frames;
+		Latencies recordedFrames;
+		Latencies drags;
+		double dragMicros = 0;
+		uint32_t dragCount = 0;
+		uint32_t mismatches = 0;
+		uint32_t unsolved = 0;
+		uint32_t timedOut = 0;
+		Rul2Trace::Record records[2];
+		Rul2Trace::Record* previous = nullptr;
+		std::vector<Rul2Cell> cells;
+		for (uint32_t i = 0; reader.Next(records[i & 1]); i++) {
+			const Rul2Trace::Record& record = records[i & 1];
+			if (record.forgotLastFrame) {
+				solver.ForgetLastFrame();
+			}
+			if (startsDrag(record, previous)) {
+				if (dragCount > 0) {
+					drags.micros.push_back(dragMicros);
+				}
+				dragCount++;
+				dragMicros = 0;
+			}
+
+			Rul2Trace::ReplayWorld world(record);
+			cells = record.input;
+			const auto start = Clock::now();
+			const Rul2Solver::Outcome outcome = solver.Solve(world, cells);
+			const double micros = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+			frames.micros.push_back(micros);
+			recordedFrames.micros.push_back(record.durationMicros);
+			dragMicros += micros;
+			unsolved += outcome != Rul2Solver::Solved;
+			timedOut += outcome == Rul2Solver::TimeBudgetExceeded;
+
+			if (outcome != record.outcome || world.UnrecordedReads() > 0 ||
+				!std::equal(cells.begin(), cells.end(), record.output.begin(), record.output.end(), isSameCell))
+			{
+				if (mismatches < 10) {
+					std::printf("  record %u: outcome %d (recorded %d), %zu cells (recorded %zu), %u unrecorded reads\n",
+							i, outcome, record.outcome, cells.size(), record.output.size(), world.UnrecordedReads());
+				}
+				mismatches++;
+			}
+			previous = &records[i & 1];
+		}
+		if (dragCount > 0) {
+			drags.micros.push_back(dragMicros);
+		}
+
+		frames.Print("replayed per frame");
+		recordedFrames.Print("recorded per frame");
+		drags.Print("replayed per drag");
+		std::printf("%zu frames in %u drags, %u unsolved (Prevent or red drag), %u mismatching the recorded result\n", frames.micros.size(), dragCount, unsolved, mismatches);
+		if (solver.HasSolutionCache()) {
+			const Rul2Solver::SolutionCacheStatistics& cacheStats = solver.CacheStatistics();
+			const uint64_t total = cacheStats.hits + cacheStats.misses;
+			std::printf("Solution cache: %llu hits, %llu misses (%.1f%% hits), %zu KB\n", static_cast<unsigned long long>(cacheStats.hits),
+					static_cast<unsigned long long>(cacheStats.misses), total > 0 ? 100.0 * cacheStats.hits / total : 0.0, solver.SolutionCacheMemoryUsage() / 1024);
+		}
+		if (timeBudget.count() > 0) {
+			std::printf("%u frames exceeded the time budget of %lld ms\n", timedOut, static_cast<long long>(timeBudget.count()));
+		}
+#ifdef NAM_RUL2_INSTRUMENTATION
+		for (const std::string& line : Rul2Instrumentation::FormatReport()) {
+			std::printf("%s\n", line.c_str());
+		}
+		Rul2Instrumentation::report = {};
+#endif
+		std::printf("\n");
+		return mismatches;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const char* profileFilePath = nullptr;
+	size_t topCount = 1000;
+	std::chrono::milliseconds timeBudget{0};
+	bool solutionCache = true;
+	int first = 1;
+	for (; first + 1 < argc && argv[first][0] == '-'; first += 2) {
+		if (std::strcmp(argv[first], "--profile") == 0) {
+			profileFilePath = argv[first + 1];
+		} else if (std::strcmp(argv[first], "--top") == 0) {
+			topCount = std::strtoul(argv[first + 1], nullptr, 10);
+		} else if (std::strcmp(argv[first], "--budget") == 0) {
+			timeBudget = std::chrono::milliseconds(std::strtoul(argv[first + 1], nullptr, 10));
+		} else if (std::strcmp(argv[first], "--solution-cache") == 0) {
+			solutionCache = std::strcmp(argv[first + 1], "off") != 0;
+		} else {
+			break;
+		}
+	}
+	if (argc - first < 2) {
+		std::fprintf(stderr, "Usage: %s [--profile <profile.csv> [--top N]] [--budget <ms>] [--solution-cache off] <NAM-RUL2.cache> <NAM-RUL2-trace.bin>...\n", argv[0]);
+		return 2;
+	}
+	uint32_t mismatches = 0;
+	std::unique_ptr<Rul2Rules> rules;
+	for (int i = first + 1; i < argc; i++) {
+		try {
+			mismatches += replay(argv[first], argv[i], rules, profileFilePath != nullptr, timeBudget, solutionCache);
+		} catch (const std::exception& e) {
+			std::fprintf(stderr, "%s: %s\n", argv[i], e.what());
+			return 2;
+		}
+	}
+	if (profileFilePath != nullptr && rules != nullptr) {
+		std::ofstream out(profileFilePath, std::ios::binary);
+		rules->WriteRuleProfile(out, topCount);
+		out.close();
+		if (!out) {
+			std::fprintf(stderr, "Failed to write %s\n", profileFilePath);
+			return 2;
+		}
+		std::printf("Wrote the rule profile to %s\n", profileFilePath);
+	}
+	return mismatches == 0 ? 0 : 1;
+}
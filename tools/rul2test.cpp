@@ -0,0 +1,1229 @@
+// Tests of the RUL2 engine outside of the game, comparing it with the implementation of the DLL before the canonical index
+// (the hash set of RuleEquivalence, PatchTilePair2, tryAdjacencies and the evaluation loop restarting after every match) on random rules and drags,
+// and checking the behaviour changes since then.
+//
+// Build and run on Linux (from the repository root):
+//
+//   make test
+//
+// Every failed check is printed with its line. The exit code is 1 if any check fails.
+#include "Rul2Rules.h"
+#include "Rul2Solver.h"
+#include "Rul2World.h"
+#include "RuleEquivalence.h"
+#include "RuleFilter.h"
+#include "RuleIndex.h"
+#include "RuleIndexCache.h"
+#include "RuleSymmetry.h"
+#include "CompactRuleIndex.h"
+#include "WildcardRuleIndex.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+	uint32_t checkCount = 0;
+	uint32_t failureCount = 0;
+
+	void check(bool condition, const char* expression, int line)
+	{
+		checkCount++;
+		if (!condition) {
+			failureCount++;
+			if (failureCount <= 50) {
+				std::printf("  FAILED (line %d): %s\n", line, expression);
+			}
+		}
+	}
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+	constexpr uint32_t makeXZ(uint32_t x, uint32_t z) { return (z << 16) | x; }
+
+	constexpr bool isSameTile(const Tile& a, const Tile& b) { return a.id == b.id && a.rf == b.rf; }
+
+	constexpr bool isSameCell(const Rul2Cell& a, const Rul2Cell& b) { return a.id == b.id && a.rf == b.rf && a.xz == b.xz; }
+
+	bool isSameCells(const std::vector<Rul2Cell>& a, const std::vector<Rul2Cell>& b)
+	{
+		return std::equal(a.begin(), a.end(), b.begin(), b.end(), isSameCell);
+	}
+
+	bool isSameRule(const cSC4NetworkTileConflictRule& p, const cSC4NetworkTileConflictRule& q)
+	{
+		return isSameTile(p._1, q._1) && isSameTile(p._2, q._2) && isSameTile(p._3, q._3) && isSameTile(p._4, q._4);
+	}
+
+	// The RuleEquivalence, PatchTilePair2 and tryAdjacencies of the DLL before the canonical index, kept as the reference.
+	namespace Baseline
+	{
+		constexpr std::array<std::array<std::size_t, 8>, 8> rfHashLookup = {{
+			{ 0,  1,  2,  3,  4,  5,  6,  7},
+			{ 8,  9,  3, 11,  7, 13, 14, 15},
+			{16, 17,  0,  8,  6, 21, 22, 14},
+			{17, 25,  1,  9,  5, 29, 21, 13},
+			{22, 21,  6, 14,  0, 17, 16,  8},
+			{14, 13,  7, 15,  3,  9,  8, 11},
+			{ 6,  5,  4,  7,  2,  1,  0,  3},
+			{21, 29,  5, 13,  1, 25, 17,  9}
+		}};
+
+		constexpr std::array<std::array<bool, 8>, 8> swappedLookup = {{
+			{false, false, false, false, false, false, false, false},
+			{false, false, true , false, true , false, false, false},
+			{false, false, true , true , true , false, false, true },
+			{true , false, true , true , true , false, true , true },
+			{false, false, true , true , true , false, false, true },
+			{false, false, true , false, true , false, false, false},
+			{false, false, false, false, false, false, false, false},
+			{true , false, true , true , true , false, true , true }
+		}};
+
+		constexpr std::array<uint32_t, 32> equivClassSize = {
+			4, 4, 2, 4, 2, 4, 4, 4, 4, 4, 0, 2, 0, 4, 4, 2, 2, 4, 0, 0, 0, 4, 2, 0, 0, 2, 0, 0, 0, 2, 0, 0
+		};
+
+		constexpr uint8_t rotFlipOrdinal(RotFlip rf)
+		{
+			return ((rf & 3) ^ ((rf << 1) & (rf >> 6))) | (rf >> 5);
+		}
+
+		constexpr std::size_t rfHash(const cSC4NetworkTileConflictRule& rule)
+		{
+			return rfHashLookup[rotFlipOrdinal(rule._1.rf)][rotFlipOrdinal(rule._2.rf)];
+		}
+
+		constexpr bool swapped(const cSC4NetworkTileConflictRule& rule)
+		{
+			return swappedLookup[rotFlipOrdinal(rule._1.rf)][rotFlipOrdinal(rule._2.rf)];
+		}
+
+		constexpr bool isWeird(std::size_t rfh)
+		{
+			return equivClassSize[rfh] != 4;
+		}
+
+		struct Hash
+		{
+			std::size_t operator()(const cSC4NetworkTileConflictRule& rule) const noexcept
+			{
+				const std::size_t rfh = rfHash(rule);
+				const uint32_t a = rule._1.id;
+				const uint32_t b = rule._2.id;
+				constexpr std::size_t prime = 66403;
+				if (swapped(rule) || (isWeird(rfh) && b < a)) {
+					return ((prime + std::hash<std::uint32_t>{}(b)) * prime + std::hash<std::uint32_t>{}(a)) * prime + rfh;
+				} else {
+					return ((prime + std::hash<std::uint32_t>{}(a)) * prime + std::hash<std::uint32_t>{}(b)) * prime + rfh;
+				}
+			}
+		};
+
+		struct Equivalence
+		{
+			bool operator()(const cSC4NetworkTileConflictRule& p, const cSC4NetworkTileConflictRule& q) const noexcept
+			{
+				const std::size_t rfh = rfHash(p);
+				if (rfh != rfHash(q)) {
+					return false;
+				} else if (isWeird(rfh)) {
+					return (p._1.id == q._1.id && p._2.id == q._2.id) || (p._1.id == q._2.id && p._2.id == q._1.id);
+				} else if (swapped(p) == swapped(q)) {
+					return p._1.id == q._1.id && p._2.id == q._2.id;
+				} else {
+					return p._1.id == q._2.id && p._2.id == q._1.id;
+				}
+			}
+		};
+
+		const std::vector<Tile> orthogonalSurrogateTiles = {
+			{0x00004B00, R1F0},  // Road
+			{0x57000000, R1F0},  // Dirtroad
+			{0x05004B00, R1F0},  // Street
+			{0x5D540000, R1F0},  // Rail
+			{0x08031500, R1F0},  // Lightrail
+			{0x09004B00, R1F0},  // Onewayroad
+			{0x04006100, R1F0},  // Avenue
+			{0x0D031500, R1F0},  // Monorail
+			{0x02001500, R0F0},  // Highway
+			{0x0A001500, R0F0},  // Groundhighway
+		};
+
+		const std::vector<std::pair<Tile, Tile>> diagonalSurrogateTiles = {  // diagonals in west-south direction on first tile, north-east on second tile
+			{{0x00000A00, R1F0}, {0x00000A00, R3F0}},  // Road
+			{{0x57000200, R1F0}, {0x57000200, R3F0}},  // Dirtroad
+			{{0x5F500200, R1F0}, {0x5F500200, R3F0}},  // Street
+			{{0x5D540100, R1F0}, {0x5D540100, R3F0}},  // Rail
+			{{0x08001A00, R1F0}, {0x08001A00, R3F0}},  // Lightrail
+			{{0x09000A00, R1F0}, {0x09000A00, R3F0}},  // Onewayroad
+			{{0x04000200, R2F0}, {0x04003800, R0F0}},  // Avenue~SW | Avenue~SharedDiagLeft
+			{{0x04003800, R0F0}, {0x04000200, R0F0}},  // Avenue~SharedDiagLeft | Avenue~NE
+			{{0x0D001A00, R1F0}, {0x0D001A00, R3F0}},  // Monorail
+			{{0x02002200, R1F0}, {0x02002100, R1F0}},  // Highway~SW | Highway~SharedDiagLeft
+			{{0x02002100, R1F0}, {0x02002200, R3F0}},  // Highway~SharedDiagLeft | Highway~NE
+			{{0x0A002200, R1F0}, {0x0A002100, R1F0}},  // Groundhighway~SW | Groundhighway~SharedDiagLeft
+			{{0x0A002100, R1F0}, {0x0A002200, R3F0}},  // Groundhighway~SharedDiagLeft | Groundhighway~NE
+		};
+
+		class Rules
+		{
+		public:
+			void Add(const cSC4NetworkTileConflictRule& rule)
+			{
+				if (rule._2.id != 0) {
+					set.insert(rule);
+				} else {
+					for (const auto rf : rotFlipValues) {
+						cSC4NetworkTileConflictRule tmpRule = rule;
+						tmpRule._2.rf = rf;
+						set.insert(tmpRule);
+					}
+				}
+			}
+
+			Rul2Rules::PatchResult PatchTilePair(Rul2Cell& cell1, Rul2Cell& cell2, int8_t dir) const
+			{
+				const cSC4NetworkTileConflictRule dummy = {{cell1.id, absoluteToRelative(cell1.rf, dir)}, {cell2.id, absoluteToRelative(cell2.rf, dir)}, {}, {}};
+				const auto pRule = set.find(dummy);
+				if (pRule == set.end()) {
+					return Rul2Rules::NoMatch;
+				} else if (pRule->_3.id == 0) {
+					return Rul2Rules::Prevent;
+				}
+				const cSC4NetworkTileConflictRule& rule = *pRule;
+				const Tile& a = dummy._1;
+				const Tile& b = dummy._2;
+				if (a.id == rule._1.id && a.rf == rule._1.rf && (b.rf == rule._2.rf || b.id == 0)) {
+					cell1.id = rule._3.id; cell1.rf = relativeToAbsolute(rule._3.rf, dir);
+					cell2.id = rule._4.id; cell2.rf = relativeToAbsolute(rule._4.rf, dir);
+				} else if (a.id == rule._1.id && a.rf == flipVertically(rule._1.rf) && (b.rf == flipVertically(rule._2.rf) || b.id == 0)) {
+					cell1.id = rule._3.id; cell1.rf = relativeToAbsolute(flipVertically(rule._3.rf), dir);
+					cell2.id = rule._4.id; cell2.rf = relativeToAbsolute(flipVertically(rule._4.rf), dir);
+				} else if (a.id == rule._2.id && a.rf == rotate180(rule._2.rf) && (b.rf == rotate180(rule._1.rf) || b.id == 0)) {
+					cell1.id = rule._4.id; cell1.rf = relativeToAbsolute(rotate180(rule._4.rf), dir);
+					cell2.id = rule._3.id; cell2.rf = relativeToAbsolute(rotate180(rule._3.rf), dir);
+				} else if (a.id == rule._2.id && a.rf == flipHorizontally(rule._2.rf) && (b.rf == flipHorizontally(rule._1.rf) || b.id == 0)) {
+					cell1.id = rule._4.id; cell1.rf = relativeToAbsolute(flipHorizontally(rule._4.rf), dir);
+					cell2.id = rule._3.id; cell2.rf = relativeToAbsolute(flipHorizontally(rule._3.rf), dir);
+				} else {
+					return Rul2Rules::NoMatch;
+				}
+				return Rul2Rules::Matched;
+			}
+
+			// tryAdjacencies, trying every surrogate tile with PatchTilePair2 rather than only those of the surrogate index
+			Rul2Rules::PatchResult TryAdjacencies(Rul2Cell& cell1, Rul2Cell& cell2, int8_t dir) const
+			{
+				for (auto&& surrogate : orthogonalSurrogateTiles) {
+					for (auto&& opposite : {false, true}) {
+						Rul2Cell a = cell1;
+						Rul2Cell b = {surrogate.id, relativeToAbsolute(surrogate.rf, opposite ? dir+2 : dir), 0xffffffff};
+						Rul2Cell c = cell2;
+
+						Rul2Rules::PatchResult result = PatchTilePair(a, b, dir);
+						if (result != Rul2Rules::Matched ||
+							a.id != cell1.id || a.rf != cell1.rf ||  // a must remain unchanged for a proper adjacency
+							a.id == b.id) {  // a must not be an orthogonal override network
+							continue;  // next surrogate tile
+						}
+						Rul2Cell bBackup = b;
+
+						result = PatchTilePair(b, c, dir);
+						if (result != Rul2Rules::Matched ||
+							b.id != bBackup.id || b.rf != bBackup.rf ||  //  b must remain unchanged (in 2nd override) for a proper adjacency
+							b.id == c.id ||  // c must not be an orthogonal override network
+							(c.id == cell2.id && c.rf == cell2.rf)) {  // c must change (in 2nd override) for a proper adjacency
+							continue;  // next surrogate tile
+						}
+
+						cell1 = a;
+						cell2 = c;
+						return Rul2Rules::Matched;
+					}
+				}
+
+				for (auto&& surrogatePair : diagonalSurrogateTiles) {
+					for (auto&& southBound : {true, false}) {
+						Rul2Cell a = cell1;
+						Rul2Cell b = {surrogatePair.first.id, relativeToAbsolute(surrogatePair.first.rf, southBound ? dir : dir+1), 0xffffffff};
+						Rul2Cell c = {surrogatePair.second.id, relativeToAbsolute(surrogatePair.second.rf, southBound ? dir : dir+1), 0xffffffff};
+						Rul2Cell d = cell2;
+
+						Rul2Rules::PatchResult result = PatchTilePair(a, b, dir);
+						if (result != Rul2Rules::Matched ||
+							a.id != cell1.id || a.rf != cell1.rf ||  // a must remain unchanged for a proper adjacency
+							a.id == b.id) {  // a must not be a straight diagonal override network
+							continue;
+						}
+						Rul2Cell bBackup = b;
+
+						// Assuming dir == 2, then c is south of b if southBound (dir+1) or north of b if northBound (dir-1).
+						result = PatchTilePair(b, c, (dir + (southBound ? 1 : -1)) & 3);
+						if (result != Rul2Rules::Matched ||
+							b.id != bBackup.id || b.rf != bBackup.rf ||  // b must remain unchanged (in 2nd override) for a proper adjacency
+							(c.id == cell1.id && c.rf == cell1.rf)) {  // otherwise we haven't gone anywhere
+							continue;
+						}
+						Rul2Cell cBackup = c;
+
+						result = PatchTilePair(c, d, dir);
+						if (result != Rul2Rules::Matched ||
+							c.id != cBackup.id || c.rf != cBackup.rf ||  // c must remain unchanged (in 3rd override) for a proper adjacency
+							c.id == d.id || b.id == d.id ||  // d must not be a pure diagonal
+							(d.id == cell2.id && d.rf == cell2.rf)) {  // d must change (in 3rd override) for a proper adjacency
+							continue;
+						}
+
+						cell1 = a;
+						cell2 = d;
+						return Rul2Rules::Matched;
+					}
+				}
+
+				return Rul2Rules::NoMatch;
+			}
+
+			// the first of every set of equivalent rules added, as stored
+			const cSC4NetworkTileConflictRule* Find(const cSC4NetworkTileConflictRule& rule) const
+			{
+				const auto it = set.find(rule);
+				return it != set.end() ? &*it : nullptr;
+			}
+
+			size_t Size() const { return set.size(); }
+
+		private:
+			std::unordered_set<cSC4NetworkTileConflictRule, Hash, Equivalence> set;
+		};
+	}
+
+	// The network world around the dragged cells: occupied cells in a square, the others are empty.
+	class TestWorld final : public Rul2World
+	{
+	public:
+		static constexpr uint32_t defaultSize = 24;
+
+		explicit TestWorld(uint32_t size = defaultSize) : size(size) {}
+
+		void Place(uint32_t xz, const Rul2WorldCell& cell) { cells[xz] = cell; }
+
+		// Marks the dragged cells as part of the cells buffer, as the network tool does before solving them.
+		void BeginDrag(const std::vector<Rul2Cell>& dragged)
+		{
+			for (uint32_t i = 0; i < dragged.size(); i++) {
+				SetCellsBufferIndex(dragged[i].xz, i);
+			}
+		}
+
+		void EndDrag()
+		{
+			for (const uint32_t xz : touched) {
+				cells[xz].idxInCellsBuffer = -1;
+			}
+			touched.clear();
+		}
+
+		bool GetCell(uint32_t xz, Rul2WorldCell& cell) override
+		{
+			if ((xz & 0xffff) >= size || (xz >> 16) >= size) {
+				return false;
+			}
+			const auto it = cells.find(xz);
+			cell = it != cells.end() ? it->second : Rul2WorldCell{};
+			return true;
+		}
+
+		void SetCellsBufferIndex(uint32_t xz, int32_t idx) override
+		{
+			cells[xz].idxInCellsBuffer = idx;
+			touched.push_back(xz);
+		}
+
+	private:
+		uint32_t size;
+		std::unordered_map<uint32_t, Rul2WorldCell> cells;
+		std::vector<uint32_t> touched;
+	};
+
+	// The evaluation loop of AdjustTileSubsets2 before Rul2Solver (as in rul2bench): after any match, all the cells are examined again.
+	// The rules are either Rul2Rules or the Baseline::Rules.
+	template <typename Rules>
+	Rul2Solver::Outcome solveWithRestarts(Rules& rules, Rul2World& world, std::vector<Rul2Cell>& cells)
+	{
+		constexpr int32_t kNextX[] = {-1, 0, 1, 0};
+		constexpr int32_t kNextZ[] = {0, -1, 0, 1};
+		int32_t countMatchesDown = std::max<int32_t>(cells.size() * 8, Rul2Solver::maxRepetitions);
+		bool foundMatch = false;
+		int32_t countPatchesCurrentCell = 0;
+		for (size_t idx = 0; idx < cells.size(); ) {
+			bool matched = false;
+			for (uint32_t dir = 0; dir < 4 && countPatchesCurrentCell <= Rul2Solver::maxRepetitions; dir++) {
+				const uint32_t xz = cells[idx].xz;
+				const uint32_t nextCellXZ = (kNextZ[dir] + (xz >> 16)) * 0x10000 + (kNextX[dir] + (xz & 0xffff));
+				Rul2WorldCell cell2Info;
+				if (!world.GetCell(nextCellXZ, cell2Info)) {
+					continue;
+				}
+				Rul2Cell temp;
+				Rul2Cell* cell2;
+				bool isCell2StackLocal = cell2Info.idxInCellsBuffer < 0;
+				if (isCell2StackLocal) {
+					if (!cell2Info.hasOccupant) {
+						continue;
+					}
+					temp = {cell2Info.id, cell2Info.rf, nextCellXZ};
+					cell2 = &temp;
+				} else {
+					cell2 = &cells[cell2Info.idxInCellsBuffer];
+				}
+				if (cell2Info.isImmovable || cell2Info.isNetworkLot) {
+					temp = *cell2;
+					temp.id = 0;
+					cell2 = &temp;
+					isCell2StackLocal = true;
+				}
+				Rul2Rules::PatchResult patchResult = rules.PatchTilePair(cells[idx], *cell2, dir);
+				if (patchResult == Rul2Rules::NoMatch) {
+					patchResult = rules.TryAdjacencies(cells[idx], *cell2, dir);
+					if (patchResult != Rul2Rules::Matched) {
+						if (isCell2StackLocal) {
+							patchResult = rules.TryAdjacencies(*cell2, cells[idx], (dir - 2) & 3);
+						}
+						if (patchResult != Rul2Rules::Matched) {
+							continue;
+						}
+					}
+				}
+				if (patchResult == Rul2Rules::Prevent) {
+					return Rul2Solver::Prevented;
+				}
+				if (--countMatchesDown < 0) {
+					return Rul2Solver::TooManyMatches;
+				}
+				foundMatch = true;
+				if (isCell2StackLocal) {
+					if (cells.size() >= Rul2Solver::maxCellsBufferSize) {
+						return Rul2Solver::TooManyCells;
+					}
+					world.SetCellsBufferIndex(nextCellXZ, static_cast<int32_t>(cells.size()));
+					cells.push_back(*cell2);
+				}
+				countPatchesCurrentCell++;
+				matched = true;
+				break;
+			}
+			if (matched) {
+				continue;
+			}
+			idx++;
+			countPatchesCurrentCell = 0;
+			if (idx == cells.size() && foundMatch) {
+				idx = 0;
+				foundMatch = false;
+			}
+		}
+		return Rul2Solver::Solved;
+	}
+
+	// Random rules over a few piece IDs, so that many of them are equivalent, including rules with ID 0 and Prevent rules.
+	class RuleGenerator
+	{
+	public:
+		explicit RuleGenerator(uint32_t seed) : rng(seed) {}
+
+		Tile RandomTile(uint32_t idCount)
+		{
+			return {1 + static_cast<uint32_t>(rng() % idCount), rotFlipValues[rng() % 8]};
+		}
+
+		cSC4NetworkTileConflictRule RandomRule(uint32_t idCount)
+		{
+			cSC4NetworkTileConflictRule rule = {RandomTile(idCount), RandomTile(idCount), RandomTile(idCount), RandomTile(idCount)};
+			switch (rng() % 16) {
+				case 0: rule._2.id = 0; break;  // wildcard rule
+				case 1: rule._1.id = 0; break;
+				case 2: rule._3.id = 0; break;  // Prevent
+				case 3: rule._1.id = 0; rule._2.id = 0; break;
+				default: break;
+			}
+			return rule;
+		}
+
+		std::vector<cSC4NetworkTileConflictRule> RandomRules(size_t count, uint32_t idCount)
+		{
+			std::vector<cSC4NetworkTileConflictRule> rules;
+			for (size_t i = 0; i < count; i++) {
+				rules.push_back(RandomRule(idCount));
+			}
+			return rules;
+		}
+
+		// Rules chaining the IDs 1 to `idCount` through the given surrogate tiles of TryAdjacencies: overrides of a tile next to
+		// a surrogate tile, of two surrogate tiles and of a surrogate tile next to a tile, mostly keeping the first tile as adjacencies do.
+		std::vector<cSC4NetworkTileConflictRule> AdjacencyRules(size_t count, uint32_t idCount, const std::vector<uint32_t>& surrogateIds)
+		{
+			auto surrogateTile = [this, &surrogateIds]() { return Tile{surrogateIds[rng() % surrogateIds.size()], rotFlipValues[rng() % 8]}; };
+			std::vector<cSC4NetworkTileConflictRule> rules;
+			for (size_t i = 0; i < count; i++) {
+				cSC4NetworkTileConflictRule rule;
+				switch (rng() % 3) {
+					case 0: rule = {RandomTile(idCount), surrogateTile(), {}, surrogateTile()}; break;
+					case 1: rule = {surrogateTile(), surrogateTile(), {}, surrogateTile()}; break;
+					default: rule = {surrogateTile(), RandomTile(idCount), {}, RandomTile(idCount)}; break;
+				}
+				rule._3 = rng() % 8 != 0 ? rule._1 : rule._4;
+				rules.push_back(rule);
+			}
+			return rules;
+		}
+
+		std::mt19937 rng;
+	};
+
+	void testSymmetry()
+	{
+		std::printf("RuleSymmetry::Canonicalize and Resolve\n");
+		RuleGenerator generator(1);
+		RuleEquivalence equivalence;
+		RuleEquivalenceHash hash;
+		for (uint32_t i = 0; i < 200000; i++) {
+			// only 3 IDs, so that equivalent pairs and pairs of equal IDs are common
+			const cSC4NetworkTileConflictRule p = {generator.RandomTile(3), generator.RandomTile(3), {}, {}};
+			const cSC4NetworkTileConflictRule q = {generator.RandomTile(3), generator.RandomTile(3), {}, {}};
+			const bool baselineEquivalent = Baseline::Equivalence{}(p, q);
+			CHECK(equivalence(p, q) == baselineEquivalent);
+			CHECK((RuleSymmetry::Canonicalize(p).key == RuleSymmetry::Canonicalize(q).key) == baselineEquivalent);
+			CHECK(!baselineEquivalent || hash(p) == hash(q));
+
+			// the canonical form maps the tiles to the canonical orientation
+			const RuleSymmetry::CanonicalForm form = RuleSymmetry::Canonicalize(p);
+			const auto [c1, c2] = RuleSymmetry::Transform(form.symmetry, p._1, p._2);
+			CHECK(isSameTile(c1, form.key.Tile1()) && isSameTile(c2, form.key.Tile2()));
+
+			// a lookup of the rule in any orientation resolves to the first symmetry (in the order of the game) that maps the rule to it
+			const auto symmetry = static_cast<RuleSymmetry::Symmetry>(generator.rng() % 4);
+			const auto [a, b] = RuleSymmetry::Transform(symmetry, p._1, p._2);
+			uint32_t expected = 0;
+			while (true) {
+				const auto [t1, t2] = RuleSymmetry::Transform(static_cast<RuleSymmetry::Symmetry>(expected), p._1, p._2);
+				if (isSameTile(t1, a) && isSameTile(t2, b)) {
+					break;
+				}
+				expected++;
+			}
+			CHECK(RuleSymmetry::Resolve(RuleSymmetry::Canonicalize(a, b), form.symmetry) == expected);
+		}
+
+		// the batched hash of the lookups prepared by Rul2Rules::PrepareTilePairs
+		for (uint32_t i = 0; i < 50000; i++) {
+			std::array<RuleSymmetry::Key, 4> keys;
+			for (RuleSymmetry::Key& key : keys) {
+				key = RuleSymmetry::Canonicalize(generator.RandomTile(0x7fffffff), generator.RandomTile(0x7fffffff)).key;
+			}
+			std::array<uint32_t, 4> hashes;
+			RuleSymmetry::Hash4(keys, hashes);
+			for (size_t k = 0; k < keys.size(); k++) {
+				CHECK(hashes[k] == RuleSymmetry::Hash(keys[k]));
+			}
+		}
+	}
+
+	void testIndexes()
+	{
+		std::printf("RuleIndex and CompactRuleIndex\n");
+		RuleGenerator generator(2);
+		std::vector<cSC4NetworkTileConflictRule> rules;
+		for (const cSC4NetworkTileConflictRule& rule : generator.RandomRules(20000, 40)) {
+			if (rule._2.id != 0) {  // the wildcard rules go into WildcardRuleIndex
+				rules.push_back(rule);
+			}
+		}
+		const size_t half = rules.size() / 2;
+		Baseline::Rules baseline;
+		for (const cSC4NetworkTileConflictRule& rule : rules) {
+			baseline.Add(rule);
+		}
+
+		// built in two batches, so that the rules of the first build take precedence over equivalent rules of the second
+		RuleIndex index;
+		RuleIndex threadedIndex;
+		CompactRuleIndex compactIndex;
+		for (const auto& [begin, end] : {std::make_pair(size_t(0), half), std::make_pair(half, rules.size())}) {
+			RuleStagingBuffer buffer;
+			RuleStagingBuffer threadedBuffer;
+			RuleStagingBuffer compactBuffer;
+			for (size_t i = begin; i < end; i++) {
+				buffer.Push(rules[i]);
+				threadedBuffer.Push(rules[i]);
+				compactBuffer.Push(rules[i]);
+			}
+			index.Build(buffer);
+			threadedIndex.Build(threadedBuffer, 4);
+			CHECK(compactIndex.Build(compactBuffer));
+			CHECK(buffer.Empty() && compactBuffer.Empty());
+		}
+		CHECK(index.Size() == baseline.Size());
+		CHECK(threadedIndex.Size() == baseline.Size());
+		CHECK(compactIndex.Size() == baseline.Size());
+
+		// every tile pair of the rules (and some random pairs) in every orientation
+		std::vector<cSC4NetworkTileConflictRule> lookups = rules;
+		for (uint32_t i = 0; i < 20000; i++) {
+			lookups.push_back({generator.RandomTile(45), generator.RandomTile(45), {}, {}});
+		}
+		for (const cSC4NetworkTileConflictRule& lookup : lookups) {
+			const auto symmetry = static_cast<RuleSymmetry::Symmetry>(generator.rng() % 4);
+			const auto [a, b] = RuleSymmetry::Transform(symmetry, lookup._1, lookup._2);
+			const RuleSymmetry::Key key = RuleSymmetry::Canonicalize(a, b).key;
+			const uint32_t keyHash = RuleSymmetry::Hash(key);
+			const cSC4NetworkTileConflictRule* expected = baseline.Find({a, b, {}, {}});
+			const RuleIndex::Slot* slot = index.Find(key, keyHash);
+			const RuleIndex::Slot* threadedSlot = threadedIndex.Find(key, keyHash);
+			RuleSymmetry::RuleOutput output;
+			uint32_t position;
+			const bool compactFound = compactIndex.Find(key, output, position);
+			CHECK((slot != nullptr) == (expected != nullptr));
+			CHECK((threadedSlot != nullptr) == (expected != nullptr));
+			CHECK(compactFound == (expected != nullptr));
+			if (slot != nullptr && expected != nullptr) {
+				CHECK(isSameRule(slot->Rule(), *expected));
+				CHECK(threadedSlot != nullptr && isSameRule(threadedSlot->Rule(), *expected));
+				CHECK(compactFound && isSameTile(output._3, slot->output._3) && isSameTile(output._4, slot->output._4) && output.symmetry == slot->output.symmetry);
+			}
+		}
+
+		// decoding the stored rules gives the same rules
+		std::vector<cSC4NetworkTileConflictRule> flatRules;
+		index.ForEachRule([&flatRules](const cSC4NetworkTileConflictRule& rule) { flatRules.push_back(rule); });
+		std::vector<cSC4NetworkTileConflictRule> compactRules = compactIndex.Rules();
+		auto byBytes = [](const cSC4NetworkTileConflictRule& p, const cSC4NetworkTileConflictRule& q) {
+			const Tile ps[] = {p._1, p._2, p._3, p._4};
+			const Tile qs[] = {q._1, q._2, q._3, q._4};
+			return std::lexicographical_compare(std::begin(ps), std::end(ps), std::begin(qs), std::end(qs),
+				[](const Tile& s, const Tile& t) { return s.id < t.id || (s.id == t.id && s.rf < t.rf); });
+		};
+		std::sort(flatRules.begin(), flatRules.end(), byBytes);
+		std::sort(compactRules.begin(), compactRules.end(), byBytes);
+		CHECK(std::equal(flatRules.begin(), flatRules.end(), compactRules.begin(), compactRules.end(), isSameRule));
+	}
+
+	void testWildcardIndex()
+	{
+		std::printf("WildcardRuleIndex\n");
+		const cSC4NetworkTileConflictRule rule = {{7, R1F0}, {0, R0F0}, {8, R1F0}, {9, R3F1}};
+		const cSC4NetworkTileConflictRule equivalentRule = {{7, flipVertically(R1F0)}, {0, R2F0}, {10, R0F0}, {11, R0F0}};
+		const cSC4NetworkTileConflictRule indexedRule = {{0, R0F0}, {12, R0F0}, {13, R0F0}, {14, R0F0}};
+		WildcardRuleIndex index;
+		index.Add({{rule, 0}, {indexedRule, 1}});
+		index.Add({{equivalentRule, 5}});  // equivalent to the first rule, which wins
+		CHECK(index.Size() == 1);
+		CHECK(index.Records().size() == 2);
+
+		Tile t3, t4;
+		uint32_t position, ordinal;
+		CHECK(index.Find(rule._1, t3, t4, position, ordinal) && position == 0 && ordinal == 0);
+		CHECK(isSameTile(t3, rule._3) && isSameTile(t4, rule._4));
+		CHECK(index.Find({7, flipVertically(R1F0)}, t3, t4, position, ordinal));
+		CHECK(isSameTile(t3, {8, flipVertically(R1F0)}) && isSameTile(t4, {9, flipVertically(R3F1)}));
+		CHECK(!index.Find({7, R0F0}, t3, t4, position, ordinal));
+
+		const RuleSymmetry::Key key = RuleSymmetry::Canonicalize(indexedRule).key;
+		CHECK(index.HasEarlierIndexedRule(key, 2));
+		CHECK(!index.HasEarlierIndexedRule(key, 1));
+		CHECK(!index.HasEarlierIndexedRule(RuleSymmetry::Canonicalize({0, R1F0}, {12, R0F0}).key, 2));
+
+		// adding the records again, as RuleIndexCache does, gives the same index
+		WildcardRuleIndex copy;
+		copy.Add(index.Records());
+		CHECK(copy.Size() == 1 && copy.Find({7, flipVertically(R1F0)}, t3, t4, position, ordinal) && ordinal == 0);
+		CHECK(copy.HasEarlierIndexedRule(key, 2));
+		index.Clear();
+		CHECK(index.Size() == 0 && index.Records().empty() && !index.HasEarlierIndexedRule(key, 2));
+	}
+
+	void testFilter()
+	{
+		std::printf("RuleFilter\n");
+		RuleGenerator generator(3);
+		const std::vector<cSC4NetworkTileConflictRule> rules = generator.RandomRules(5000, 2000);
+		RuleFilter filter;
+		filter.Init(rules.size());
+		for (const cSC4NetworkTileConflictRule& rule : rules) {
+			filter.Add(rule);
+		}
+		// no false negatives in any orientation
+		for (const cSC4NetworkTileConflictRule& rule : rules) {
+			for (uint32_t symmetry = 0; symmetry < 4; symmetry++) {
+				const auto [a, b] = RuleSymmetry::Transform(static_cast<RuleSymmetry::Symmetry>(symmetry), rule._1, rule._2);
+				CHECK(filter.MayContainTiles(a, b));
+				CHECK(filter.MayContainKey(RuleSymmetry::Hash(RuleSymmetry::Canonicalize(a, b).key)));
+			}
+		}
+		// piece IDs without any rule are rejected by the first stage
+		CHECK(!filter.MayContainTiles({5000, R0F0}, {1, R0F0}));
+		CHECK(!filter.MayContainTiles({1, R0F0}, {5001, R2F1}));
+		uint32_t rejected = 0;
+		for (uint32_t i = 0; i < 10000; i++) {
+			const Tile a = generator.RandomTile(2000);
+			const Tile b = generator.RandomTile(2000);
+			rejected += !filter.MayContainTiles(a, b) || !filter.MayContainKey(RuleSymmetry::Hash(RuleSymmetry::Canonicalize(a, b).key));
+		}
+		CHECK(rejected > 9000);  // random pairs almost never match a rule
+	}
+
+	// Compares the lookups of the rules with those of the baseline, on tile pairs of the rules in every orientation and direction.
+	// With ID 0 as both tiles, PatchTilePair2 matched the second tile in any RotFlip even when applying a rule
+	// in another orientation, which is checked separately (see testBothTilesZero).
+	void compareLookups(Rul2Rules& rules, const Baseline::Rules& baseline, const std::vector<cSC4NetworkTileConflictRule>& ruleList, RuleGenerator& generator)
+	{
+		for (uint32_t round = 0; round < 2; round++) {  // the second round is answered by the lookup cache
+			for (const cSC4NetworkTileConflictRule& rule : ruleList) {
+				for (uint32_t i = 0; i < 4; i++) {
+					const auto symmetry = static_cast<RuleSymmetry::Symmetry>(generator.rng() % 4);
+					const auto dir = static_cast<int8_t>(generator.rng() % 4);
+					auto [a, b] = RuleSymmetry::Transform(symmetry, rule._1, rule._2);
+					if (i == 3) {
+						a = generator.RandomTile(12);  // mostly no rule
+					}
+					if (a.id == 0 && b.id == 0) {
+						continue;
+					}
+					Rul2Cell cell1 = {a.id, relativeToAbsolute(a.rf, dir), 1};
+					Rul2Cell cell2 = {b.id, relativeToAbsolute(b.rf, dir), 2};
+					Rul2Cell baselineCell1 = cell1;
+					Rul2Cell baselineCell2 = cell2;
+					const Rul2Rules::PatchResult result = rules.PatchTilePair(cell1, cell2, dir);
+					const Rul2Rules::PatchResult baselineResult = baseline.PatchTilePair(baselineCell1, baselineCell2, dir);
+					CHECK(result == baselineResult);
+					CHECK(result == Rul2Rules::Prevent || (isSameCell(cell1, baselineCell1) && isSameCell(cell2, baselineCell2)));
+				}
+			}
+		}
+	}
+
+	void testLookups()
+	{
+		std::printf("Rul2Rules::PatchTilePair against PatchTilePair2\n");
+		RuleGenerator generator(4);
+		const std::vector<cSC4NetworkTileConflictRule> ruleList = generator.RandomRules(3000, 12);
+		Baseline::Rules baseline;
+		for (const cSC4NetworkTileConflictRule& rule : ruleList) {
+			baseline.Add(rule);
+		}
+		for (const bool compact : {false, true}) {
+			Rul2Rules rules;
+			rules.SetUseCompactIndex(compact);
+			for (size_t i = 0; i < ruleList.size(); i++) {
+				rules.AddRule(ruleList[i]);
+				if (i == ruleList.size() / 2) {
+					rules.Build();  // rules of earlier builds take precedence
+				}
+			}
+			rules.Build();
+			CHECK(rules.UsesCompactIndex() == compact);
+			compareLookups(rules, baseline, ruleList, generator);
+		}
+	}
+
+	// TryAdjacencies with the surrogate index against tryAdjacencies trying every surrogate tile, for the orthogonal surrogates
+	// and for the diagonal ones.
+	void testAdjacencies()
+	{
+		std::printf("Rul2Rules::TryAdjacencies against tryAdjacencies\n");
+		std::vector<uint32_t> baselineIds;
+		for (const Tile& tile : Baseline::orthogonalSurrogateTiles) {
+			baselineIds.push_back(tile.id);
+		}
+		for (const auto& [first, second] : Baseline::diagonalSurrogateTiles) {
+			baselineIds.push_back(first.id);
+			baselineIds.push_back(second.id);
+		}
+		const std::vector<uint32_t> surrogateIds = Rul2Rules::SurrogateTileIds();
+		CHECK(surrogateIds == baselineIds);
+
+		const auto diagonalBegin = surrogateIds.begin() + Baseline::orthogonalSurrogateTiles.size();
+		const std::vector<uint32_t> idsByKind[] = {{surrogateIds.begin(), diagonalBegin}, {diagonalBegin, surrogateIds.end()}};
+		RuleGenerator generator(8);
+		for (const bool diagonal : {false, true}) {
+			constexpr uint32_t idCount = 4;
+			std::vector<cSC4NetworkTileConflictRule> ruleList = generator.AdjacencyRules(diagonal ? 3000 : 1000, idCount, idsByKind[diagonal]);
+			for (const cSC4NetworkTileConflictRule& rule : generator.RandomRules(300, idCount)) {
+				ruleList.push_back(rule);  // direct rules, including Prevent rules
+			}
+			Baseline::Rules baseline;
+			for (const cSC4NetworkTileConflictRule& rule : ruleList) {
+				baseline.Add(rule);
+			}
+			for (const bool compact : {false, true}) {
+				Rul2Rules rules;
+				rules.SetUseCompactIndex(compact);
+				for (const cSC4NetworkTileConflictRule& rule : ruleList) {
+					rules.AddRule(rule);
+				}
+				rules.Build();
+				uint32_t matchCount = 0;
+				for (uint32_t i = 0; i < 20000; i++) {
+					const auto dir = static_cast<int8_t>(generator.rng() % 4);
+					const Tile a = generator.RandomTile(idCount);
+					const Tile b = generator.RandomTile(idCount);
+					Rul2Cell cell1 = {a.id, relativeToAbsolute(a.rf, dir), 1};
+					Rul2Cell cell2 = {b.id, relativeToAbsolute(b.rf, dir), 2};
+					Rul2Cell baselineCell1 = cell1;
+					Rul2Cell baselineCell2 = cell2;
+					const Rul2Rules::PatchResult result = rules.TryAdjacencies(cell1, cell2, dir);
+					const Rul2Rules::PatchResult baselineResult = baseline.TryAdjacencies(baselineCell1, baselineCell2, dir);
+					CHECK(result == baselineResult);
+					CHECK(isSameCell(cell1, baselineCell1) && isSameCell(cell2, baselineCell2));
+					matchCount += result == Rul2Rules::Matched;
+				}
+				std::printf("  %s surrogates, %s index: %u of 20000 tile pairs matched\n", diagonal ? "diagonal" : "orthogonal",
+						compact ? "compact" : "flat", matchCount);
+				CHECK(matchCount > 0);
+			}
+		}
+	}
+
+	// ID 0 as both tiles: unlike in PatchTilePair2, the rule applies in the orientation of the first symmetry (in the order of the game)
+	// that maps its first tile to the looked-up first tile, or for the swapping symmetries, to the looked-up second tile,
+	// and the other tile with ID 0 matches in any RotFlip.
+	void testBothTilesZero()
+	{
+		std::printf("Lookups of ID 0 as both tiles\n");
+		const cSC4NetworkTileConflictRule rule = {{0, R1F0}, {0, R0F0}, {5, R1F0}, {6, R2F1}};
+		Rul2Rules rules;
+		rules.AddRule(rule);
+		rules.Build();
+		for (const RotFlip rf1 : rotFlipValues) {
+			for (const RotFlip rf2 : rotFlipValues) {
+				int32_t expected = -1;
+				for (uint32_t s = 0; s < 4 && expected < 0; s++) {
+					const auto symmetry = static_cast<RuleSymmetry::Symmetry>(s);
+					const auto [t1, t2] = RuleSymmetry::Transform(symmetry, rule._1, rule._2);
+					if (RuleSymmetry::IsSwapping(symmetry) ? t2.rf == rf2 : t1.rf == rf1) {
+						expected = s;
+					}
+				}
+				Rul2Cell cell1 = {0, rf1, 1};
+				Rul2Cell cell2 = {0, rf2, 2};
+				const Rul2Rules::PatchResult result = rules.PatchTilePair(cell1, cell2, 2);
+				CHECK((result == Rul2Rules::Matched) == (expected >= 0));
+				if (expected >= 0) {
+					const auto [t3, t4] = RuleSymmetry::Transform(static_cast<RuleSymmetry::Symmetry>(expected), rule._3, rule._4);
+					CHECK(isSameTile({cell1.id, cell1.rf}, t3) && isSameTile({cell2.id, cell2.rf}, t4));
+				}
+			}
+		}
+	}
+
+	// Of a rule with ID 0 as second tile and an equivalent rule with ID 0 as first tile, the rule loaded first wins,
+	// also when loaded from the cache.
+	void testWildcardPrecedence(const std::filesystem::path& folder)
+	{
+		std::printf("Precedence of wildcard rules\n");
+		const cSC4NetworkTileConflictRule indexedRule = {{0, R0F0}, {0x100, R0F0}, {0x200, R0F0}, {0x300, R0F0}};
+		const cSC4NetworkTileConflictRule wildcardRule = {{0x100, R2F0}, {0, R0F0}, {0x400, R0F0}, {0x500, R0F0}};
+		for (const bool indexedFirst : {true, false}) {
+			for (const bool compact : {false, true}) {
+				auto addRules = [&](Rul2Rules& rules) {
+					rules.SetUseCompactIndex(compact);
+					rules.AddRule(indexedFirst ? indexedRule : wildcardRule);
+					rules.AddRule(indexedFirst ? wildcardRule : indexedRule);
+				};
+				Rul2Rules built;
+				addRules(built);
+				built.Build();
+				const std::filesystem::path cacheFilePath = folder / "precedence.bin";
+				built.SaveCache(cacheFilePath);
+				Rul2Rules loaded;
+				addRules(loaded);
+				CHECK(loaded.LoadCache(cacheFilePath));
+				for (Rul2Rules* rules : {&built, &loaded}) {
+					// the tiles of both rules (the indexed rule swapped), next to ID 0 in the RotFlip of the indexed rule
+					Rul2Cell a = {0x100, R2F0, 1};
+					Rul2Cell b = {0, R2F0, 2};
+					CHECK(rules->PatchTilePair(a, b, 2) == Rul2Rules::Matched);
+					CHECK(a.id == (indexedFirst ? 0x300u : 0x400u));
+					// in any other RotFlip, only the wildcard rule matches
+					a = {0x100, R2F0, 1};
+					b = {0, R0F0, 2};
+					CHECK(rules->PatchTilePair(a, b, 2) == Rul2Rules::Matched && a.id == 0x400);
+				}
+			}
+		}
+	}
+
+	void testCache(const std::filesystem::path& folder)
+	{
+		std::printf("RuleIndexCache\n");
+		RuleGenerator generator(5);
+		const std::vector<cSC4NetworkTileConflictRule> ruleList = generator.RandomRules(3000, 12);
+		Baseline::Rules baseline;
+		for (const cSC4NetworkTileConflictRule& rule : ruleList) {
+			baseline.Add(rule);
+		}
+		auto addRules = [&ruleList](Rul2Rules& rules, bool compact) {
+			rules.SetUseCompactIndex(compact);
+			for (const cSC4NetworkTileConflictRule& rule : ruleList) {
+				rules.AddRule(rule);
+			}
+		};
+		auto readFile = [](const std::filesystem::path& path) {
+			std::ifstream in(path, std::ios::binary);
+			return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		};
+		auto writeFile = [](const std::filesystem::path& path, const std::string& data) {
+			std::ofstream(path, std::ios::binary | std::ios::trunc).write(data.data(), data.size());
+		};
+		auto readU32 = [](const std::string& data, size_t offset) {
+			uint32_t value;
+			std::memcpy(&value, data.data() + offset, sizeof(value));
+			return value;
+		};
+		auto writeU32 = [](std::string& data, size_t offset, uint32_t value) { std::memcpy(data.data() + offset, &value, sizeof(value)); };
+		// offsets in the header of the cache file
+		constexpr size_t versionOffset = 8;
+		constexpr size_t sectionsOffset = 48;
+
+		for (const bool compact : {false, true}) {
+			const std::filesystem::path cacheFilePath = folder / (compact ? "compact.bin" : "flat.bin");
+			Rul2Rules built;
+			addRules(built, compact);
+			built.Build();
+			built.SaveCache(cacheFilePath);
+
+			Rul2Rules loaded;
+			addRules(loaded, compact);
+			CHECK(loaded.LoadCache(cacheFilePath));
+			CHECK(!loaded.HasPendingRules());
+			CHECK(loaded.Size() == built.Size());
+			compareLookups(loaded, baseline, ruleList, generator);
+
+			// the other layout, other rules or a missing file
+			Rul2Rules otherLayout;
+			addRules(otherLayout, !compact);
+			CHECK(!otherLayout.LoadCache(cacheFilePath));
+			CHECK(otherLayout.HasPendingRules());
+			Rul2Rules otherRules;
+			addRules(otherRules, compact);
+			otherRules.AddRule(ruleList.front());
+			CHECK(!otherRules.LoadCache(cacheFilePath));
+			Rul2Rules missing;
+			addRules(missing, compact);
+			CHECK(!missing.LoadCache(folder / "missing.bin"));
+
+			// corrupt files are rejected
+			const std::string original = readFile(cacheFilePath);
+			const std::filesystem::path corruptFilePath = folder / "corrupt.bin";
+			std::vector<std::string> corruptions;
+			corruptions.push_back(original.substr(0, original.size() - 8));  // truncated
+			corruptions.push_back(original.substr(0, 16));
+			corruptions.push_back(original);
+			writeU32(corruptions.back(), versionOffset, readU32(original, versionOffset) - 1);  // outdated
+			corruptions.push_back(original);
+			writeU32(corruptions.back(), sectionsOffset + 8, (original.size() + 7) / 8 * 8);  // section beyond the end of the file
+			corruptions.push_back(original);
+			writeU32(corruptions.back(), sectionsOffset + 3 * 8 + 4, readU32(original, sectionsOffset + 3 * 8 + 4) - 1);  // partial wildcard rule
+			if (compact) {
+				corruptions.push_back(original);
+				writeU32(corruptions.back(), readU32(original, sectionsOffset + 8), 1);  // the first group does not start at 0
+				corruptions.push_back(original);
+				writeU32(corruptions.back(), readU32(original, sectionsOffset + 2 * 8) + 4, 0xffffffff);  // a tile beyond the piece IDs
+			} else {
+				corruptions.push_back(original);
+				writeU32(corruptions.back(), sectionsOffset + 4, readU32(original, sectionsOffset + 4) - 1);  // control bytes do not match the capacity
+			}
+			for (const std::string& corruption : corruptions) {
+				writeFile(corruptFilePath, corruption);
+				Rul2Rules rules;
+				addRules(rules, compact);
+				CHECK(!rules.LoadCache(corruptFilePath));
+				CHECK(rules.HasPendingRules());
+			}
+		}
+	}
+
+	struct Drag
+	{
+		std::vector<Rul2Cell> cells;  // in the order of the drag
+	};
+
+	// Random straight drags across the world, which is filled with random occupants (some immovable or network lots).
+	class DragGenerator
+	{
+	public:
+		DragGenerator(uint32_t seed, uint32_t idCount) : rng(seed), idCount(idCount) {}
+
+		void FillWorld(TestWorld& world)
+		{
+			world = TestWorld();
+			for (uint32_t x = 0; x < TestWorld::defaultSize; x++) {
+				for (uint32_t z = 0; z < TestWorld::defaultSize; z++) {
+					if (rng() % 3 == 0) {
+						Rul2WorldCell cell;
+						cell.hasOccupant = true;
+						cell.id = 1 + rng() % idCount;
+						cell.rf = rotFlipValues[rng() % 8];
+						cell.isImmovable = rng() % 16 == 0;
+						cell.isNetworkLot = rng() % 16 == 0;
+						world.Place(makeXZ(x, z), cell);
+					}
+				}
+			}
+		}
+
+		Drag RandomDrag()
+		{
+			const bool vertical = rng() % 2 == 0;
+			const uint32_t length = 1 + rng() % 14;
+			const uint32_t start = rng() % (TestWorld::defaultSize - length);
+			const uint32_t other = 1 + rng() % (TestWorld::defaultSize - 2);
+			const uint32_t id = 1 + rng() % idCount;
+			const RotFlip rf = rotFlipValues[rng() % 8];
+			Drag drag;
+			for (uint32_t i = 0; i < length; i++) {
+				const uint32_t xz = vertical ? makeXZ(other, start + i) : makeXZ(start + i, other);
+				drag.cells.push_back({rng() % 4 == 0 ? 1 + static_cast<uint32_t>(rng() % idCount) : id, rf, xz});
+			}
+			return drag;
+		}
+
+		std::mt19937 rng;
+		uint32_t idCount;
+	};
+
+	// Whether no tile pair of the solved cells and their neighbors matches a rule any more (with the world indexing the cells).
+	bool isFixpoint(Rul2Rules& rules, Rul2World& world, const std::vector<Rul2Cell>& cells)
+	{
+		constexpr int32_t kNextX[] = {-1, 0, 1, 0};
+		constexpr int32_t kNextZ[] = {0, -1, 0, 1};
+		for (const Rul2Cell& cell : cells) {
+			for (uint32_t dir = 0; dir < 4; dir++) {
+				const uint32_t nextCellXZ = (kNextZ[dir] + (cell.xz >> 16)) * 0x10000 + (kNextX[dir] + (cell.xz & 0xffff));
+				Rul2WorldCell info;
+				if (!world.GetCell(nextCellXZ, info)) {
+					continue;
+				}
+				Rul2Cell cell2;
+				if (info.idxInCellsBuffer >= 0) {
+					cell2 = cells[info.idxInCellsBuffer];
+				} else if (info.hasOccupant) {
+					cell2 = {info.id, info.rf, nextCellXZ};
+				} else {
+					continue;
+				}
+				if (info.isImmovable || info.isNetworkLot) {
+					cell2.id = 0;
+				}
+				Rul2Cell cell1 = cell;
+				if (rules.PatchTilePair(cell1, cell2, static_cast<int8_t>(dir)) != Rul2Rules::NoMatch) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Solves random drags frame by frame, as the game does while the user extends a drag, with the evaluation loop before the worklist
+	// and with the variants of Rul2Solver, which must give the same results.
+	void testSolver()
+	{
+		std::printf("Rul2Solver against the evaluation loop restarting after every match\n");
+		RuleGenerator generator(6);
+		std::vector<cSC4NetworkTileConflictRule> ruleList;
+		for (const cSC4NetworkTileConflictRule& rule : generator.RandomRules(160, 10)) {
+			if (rule._1.id != 0 || rule._2.id != 0) {
+				ruleList.push_back(rule);
+			}
+		}
+		for (const cSC4NetworkTileConflictRule& rule : generator.AdjacencyRules(400, 10, Rul2Rules::SurrogateTileIds())) {
+			ruleList.push_back(rule);
+		}
+		Baseline::Rules baseline;
+		Rul2Rules rules;
+		Rul2Rules compactRules;
+		compactRules.SetUseCompactIndex(true);
+		for (const cSC4NetworkTileConflictRule& rule : ruleList) {
+			baseline.Add(rule);
+			rules.AddRule(rule);
+			compactRules.AddRule(rule);
+		}
+		rules.Build();
+		compactRules.Build();
+
+		Rul2Solver full(rules);
+		Rul2Solver compact(compactRules);
+		Rul2Solver incremental(rules);
+		incremental.SetIncremental(true);
+		Rul2Solver cached(rules);
+		cached.SetIncremental(true);
+		cached.SetSolutionCache(true);
+		Rul2Solver budgeted(rules);
+		budgeted.SetIncremental(true);
+		budgeted.SetTimeBudget(std::chrono::milliseconds(60000));
+		Rul2Solver* const variants[] = {&compact, &incremental, &cached, &budgeted};
+
+		DragGenerator dragGenerator(7, 10);
+		TestWorld world;
+		uint32_t outcomeCounts[5] = {};
+		uint32_t preemptedCount = 0;
+		for (uint32_t worldIndex = 0; worldIndex < 40; worldIndex++) {
+			dragGenerator.FillWorld(world);
+			for (uint32_t dragIndex = 0; dragIndex < 50; dragIndex++) {
+				const Drag drag = dragGenerator.RandomDrag();
+				for (Rul2Solver* solver : variants) {
+					solver->ForgetLastFrame();
+				}
+				for (size_t length = 1; length <= drag.cells.size(); length++) {
+					const std::vector<Rul2Cell> input(drag.cells.begin(), drag.cells.begin() + length);
+					auto solve = [&world, &input](auto&& f) {
+						std::vector<Rul2Cell> cells = input;
+						world.BeginDrag(cells);
+						const Rul2Solver::Outcome outcome = f(cells);
+						world.EndDrag();
+						return std::make_pair(outcome, cells);
+					};
+					const auto [referenceOutcome, referenceCells] = solve([&](std::vector<Rul2Cell>& cells) { return solveWithRestarts(baseline, world, cells); });
+					const auto [outcome, cells] = solve([&](std::vector<Rul2Cell>& cells) { return full.Solve(world, cells); });
+					outcomeCounts[outcome]++;
+					if (referenceOutcome == Rul2Solver::Solved) {
+						CHECK(outcome == Rul2Solver::Solved && isSameCells(cells, referenceCells));
+						world.BeginDrag(cells);
+						CHECK(isFixpoint(rules, world, cells));
+						world.EndDrag();
+					} else if (outcome == Rul2Solver::Prevented && referenceOutcome != Rul2Solver::Prevented) {
+						preemptedCount++;  // by the Prevent pre-pass, see testLimits
+						CHECK(referenceOutcome == Rul2Solver::TooManyMatches || referenceOutcome == Rul2Solver::TooManyCells);
+					} else {
+						CHECK(outcome == referenceOutcome);
+					}
+					for (Rul2Solver* solver : variants) {
+						const auto [variantOutcome, variantCells] = solve([solver, &world](std::vector<Rul2Cell>& cells) { return solver->Solve(world, cells); });
+						CHECK(variantOutcome == outcome);
+						CHECK(outcome != Rul2Solver::Solved || isSameCells(variantCells, cells));
+					}
+				}
+			}
+		}
+		std::printf("  frames: %u solved, %u prevented (%u preempting too many matches or cells), %u too many matches, %u too many cells\n",
+				outcomeCounts[Rul2Solver::Solved], outcomeCounts[Rul2Solver::Prevented], preemptedCount, outcomeCounts[Rul2Solver::TooManyMatches],
+				outcomeCounts[Rul2Solver::TooManyCells]);
+		CHECK(outcomeCounts[Rul2Solver::Solved] > 0 && outcomeCounts[Rul2Solver::Prevented] > 0);
+		CHECK(cached.CacheStatistics().hits + cached.CacheStatistics().misses > 0);
+	}
+
+	// The outcomes of the limits of Rul2Solver, and the Prevent pre-pass preempting them:
+	// a drag whose evaluation runs out of matches before reaching a guaranteed Prevent is Prevented rather than TooManyMatches.
+	void testLimits()
+	{
+		std::printf("Rul2Solver limits and the Prevent pre-pass\n");
+		constexpr uint32_t idA = 1, idB = 2, idC = 3, idP = 4, idQ = 5, idX = 6, idY = 7;
+		auto addCycle = [](Rul2Rules& rules) {
+			// A next to B (east) turns B into C and back again
+			rules.AddRule({{idA, R0F0}, {idB, R0F0}, {idA, R0F0}, {idC, R0F0}});
+			rules.AddRule({{idA, R0F0}, {idC, R0F0}, {idA, R0F0}, {idB, R0F0}});
+		};
+		TestWorld world;
+		Rul2WorldCell occupant;
+		occupant.hasOccupant = true;
+		occupant.id = idB;
+		world.Place(makeXZ(6, 5), occupant);
+		occupant.id = idQ;
+		world.Place(makeXZ(6, 6), occupant);
+		const std::vector<Rul2Cell> input = {{idA, R0F0, makeXZ(5, 5)}, {idP, R0F0, makeXZ(5, 6)}};
+
+		auto solve = [&world, &input](Rul2Rules& rules, bool withRestarts) {
+			std::vector<Rul2Cell> cells = input;
+			Rul2Solver solver(rules);
+			world.BeginDrag(cells);
+			const Rul2Solver::Outcome outcome = withRestarts ? solveWithRestarts(rules, world, cells) : solver.Solve(world, cells);
+			world.EndDrag();
+			return outcome;
+		};
+
+		Rul2Rules cycle;
+		addCycle(cycle);
+		cycle.Build();
+		CHECK(!cycle.HasGuaranteedPrevents());
+		CHECK(solve(cycle, false) == Rul2Solver::TooManyMatches);
+		CHECK(solve(cycle, true) == Rul2Solver::TooManyMatches);
+
+		Rul2Rules cycleAndPrevent;
+		addCycle(cycleAndPrevent);
+		cycleAndPrevent.AddRule({{idP, R0F0}, {idQ, R0F0}, {0, R0F0}, {0, R0F0}});  // P next to Q (east) is red
+		cycleAndPrevent.Build();
+		CHECK(cycleAndPrevent.GuaranteedPreventCount() == 1);
+		CHECK(solve(cycleAndPrevent, false) == Rul2Solver::Prevented);
+		CHECK(solve(cycleAndPrevent, true) == Rul2Solver::TooManyMatches);  // as before the pre-pass
+
+		// a Prevent on tiles that other rules override is not guaranteed, so the evaluation runs out of matches first, as before
+		Rul2Rules overriddenPrevent;
+		addCycle(overriddenPrevent);
+		overriddenPrevent.AddRule({{idP, R0F0}, {idQ, R0F0}, {0, R0F0}, {0, R0F0}});
+		overriddenPrevent.AddRule({{idQ, R0F0}, {idX, R0F0}, {idQ, R0F0}, {idY, R0F0}});
+		overriddenPrevent.Build();
+		CHECK(!overriddenPrevent.HasGuaranteedPrevents());
+		CHECK(solve(overriddenPrevent, false) == Rul2Solver::TooManyMatches);
+
+		// A column of 100 dragged cells, each next to a row of occupants that the drag overrides one after another.
+		// Every override appends a cell, so the rows fill the cells buffer before the matches run out.
+		auto solveColumn = [](uint32_t rowLength, std::vector<Rul2Cell>& cells) {
+			TestWorld world(128);
+			Rul2WorldCell occupant;
+			occupant.hasOccupant = true;
+			occupant.id = idX;
+			for (uint32_t z = 0; z < 100; z++) {
+				cells.push_back({idY, R0F0, makeXZ(0, z)});
+				for (uint32_t x = 1; x <= rowLength; x++) {
+					world.Place(makeXZ(x, z), occupant);
+				}
+			}
+			Rul2Rules spreading;
+			spreading.AddRule({{idY, R0F0}, {idX, R0F0}, {idY, R0F0}, {idY, R0F0}});  // Y next to X (east) turns X into Y
+			spreading.Build();
+			Rul2Solver solver(spreading);
+			world.BeginDrag(cells);
+			const Rul2Solver::Outcome outcome = solver.Solve(world, cells);
+			world.EndDrag();
+			return outcome;
+		};
+		std::vector<Rul2Cell> cells;
+		CHECK(solveColumn(5, cells) == Rul2Solver::Solved);
+		CHECK(cells.size() == 600 && std::all_of(cells.begin(), cells.end(), [](const Rul2Cell& cell) { return cell.id == idY; }));
+		cells.clear();
+		CHECK(solveColumn(10, cells) == Rul2Solver::TooManyCells);
+		CHECK(cells.size() == Rul2Solver::maxCellsBufferSize);
+	}
+}
+
+int main()
+{
+	const std::filesystem::path folder = std::filesystem::temp_directory_path() / "rul2test";
+	std::filesystem::create_directories(folder);
+
+	testSymmetry();
+	testIndexes();
+	testWildcardIndex();
+	testFilter();
+	testLookups();
+	testAdjacencies();
+	testBothTilesZero();
+	testWildcardPrecedence(folder);
+	testCache(folder);
+	testSolver();
+	testLimits();
+
+	std::filesystem::remove_all(folder);
+	std::printf("%u of %u checks failed\n", failureCount, checkCount);
+	return failureCount == 0 ? 0 : 1;
+}